@@ -22,6 +22,7 @@
 #include "defs.h"
 #include "fs.h"
 #include "buf.h"
+#include "ktrace.h"
 
 #define NBUCKET 13
 #define HASH(x) ((x) % NBUCKET)
@@ -41,6 +42,8 @@ struct {
   struct spinlock lock[NBUCKET];
 } map;
 
+static int nhit, nmiss, nsteal;   // counter ids
+
 void
 binit(void)
 {
@@ -48,6 +51,9 @@ binit(void)
   char name[16];
 
   initlock(&bcache.lock, "bcache");
+  nhit = counternew("bcache_hit");
+  nmiss = counternew("bcache_miss");
+  nsteal = counternew("bcache_steal");
 
   for (int i = 0; i < NBUCKET; i++) {
     snprintf(name, sizeof(name), "bcache: bucket %d", i);
@@ -95,13 +101,15 @@ bget(uint dev, uint blockno)
     if(b->dev == dev && b->blockno == blockno){
       b->refcnt++;
       release(&map.lock[h]);
+      TRACEPOINT(TP_BGET_HIT, dev, blockno);
+      counteradd(nhit, 1);
       acquiresleep(&b->lock);
       return b;
     }
   }
 
 
-  uint min = 0xffffffff;
+  uint64 min = ~0UL;
   struct buf *empty = 0;
   // Not cached.
   // Recycle the least recently used (LRU) unused buffer.
@@ -141,6 +149,7 @@ bget(uint dev, uint blockno)
 
 
   STEAL:
+    counteradd(nsteal, 1);
     for (b = &map.head[i]; empty != b->next; b = b->next);
     b->next = empty->next;
     empty->next = map.head[h].next;
@@ -154,6 +163,8 @@ bget(uint dev, uint blockno)
     empty->valid = 0;
     empty->refcnt = 1;
     release(&map.lock[h]);
+    TRACEPOINT(TP_BGET_MISS, dev, blockno);
+    counteradd(nmiss, 1);
     acquiresleep(&empty->lock);
     return empty;
 }
@@ -195,9 +206,7 @@ brelse(struct buf *b)
 
   acquire(&map.lock[h]);
   if (--b->refcnt == 0) {
-    acquire(&tickslock);
-    b->timestamp = ticks;
-    release(&tickslock);
+    b->timestamp = clocknow();
   }
 
   release(&map.lock[h]);  
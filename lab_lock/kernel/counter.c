@@ -0,0 +1,88 @@
+//
+// a registry of named 64-bit event counters.
+//
+// a subsystem registers its counters at boot with counternew()
+// and bumps them with counteradd(). each CPU has its own copy
+// of every counter, so counteradd() is one atomic add to a
+// word no other CPU normally writes; readers sum the copies.
+//
+// the registry is mapped read-only into every process at
+// COUNTERS (see proc_pagetable()), so a program can watch
+// the counters without system calls. the statistics device
+// prints them as text too.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "riscv.h"
+#include "counter.h"
+#include "defs.h"
+
+struct counters counters __attribute__((aligned(PGSIZE)));
+static struct spinlock counterlock;
+
+void
+counterinit(void)
+{
+  if(sizeof(counters) != NCOUNTERPAGE * PGSIZE)
+    panic("counterinit");
+  initlock(&counterlock, "counter");
+  counters.ncpu = NCPU;
+}
+
+// register a counter; returns its id.
+int
+counternew(char *name)
+{
+  int id;
+
+  acquire(&counterlock);
+  if(counters.n == NCOUNTER)
+    panic("counternew");
+  id = counters.n;
+  safestrcpy(counters.name[id], name, COUNTERNAME);
+  __sync_synchronize();
+  counters.n = id + 1;
+  release(&counterlock);
+  return id;
+}
+
+// safe from any CPU, with interrupts on or off: if the
+// caller moves to another CPU, the add still lands whole.
+void
+counteradd(int id, uint64 n)
+{
+  __atomic_fetch_add(&counters.val[r_tp()][id], n, __ATOMIC_RELAXED);
+}
+
+uint64
+counterget(int id)
+{
+  uint64 v = 0;
+
+  for(int i = 0; i < NCPU; i++)
+    v += __atomic_load_n(&counters.val[i][id], __ATOMIC_RELAXED);
+  return v;
+}
+
+// the counters as "name value" lines.
+int
+statscounters(char *buf, int sz)
+{
+  int n;
+
+  n = snprintf(buf, sz, "--- counters\n");
+  for(int i = 0; i < counters.n && n < sz; i++)
+    n += snprintf(buf+n, sz-n, "%s %l\n", counters.name[i], counterget(i));
+  return n;
+}
+
+// map the registry read-only at COUNTERS in pagetable.
+int
+countermap(pagetable_t pagetable)
+{
+  return mappages(pagetable, COUNTERS, NCOUNTERPAGE * PGSIZE,
+                  (uint64)&counters, PTE_R | PTE_U);
+}
@@ -0,0 +1,13 @@
+// the counter registry, as mapped read-only at COUNTERS in
+// every process. a counter's value is the sum of its per-CPU
+// copies in val[][id], for ids below n.
+
+#define NCOUNTER    64
+#define COUNTERNAME 32
+
+struct counters {
+  int n;                              // counters registered
+  int ncpu;                           // rows of val[]
+  char name[NCOUNTER][COUNTERNAME];
+  uint64 val[NCPU][NCOUNTER] __attribute__((aligned(4096)));
+};
@@ -26,6 +26,14 @@ void            consoleinit(void);
 void            consoleintr(int);
 void            consputc(int);
 
+// counter.c
+void            counterinit(void);
+int             counternew(char*);
+void            counteradd(int, uint64);
+uint64          counterget(int);
+int             statscounters(char*, int);
+int             countermap(pagetable_t);
+
 // exec.c
 int             exec(char*, char**);
 
@@ -68,6 +76,11 @@ void*           kalloc(void);
 void            kfree(void *);
 void            kinit(void);
 
+// ktrace.c
+extern char     tpon[];
+void            ktraceinit(void);
+void            tpevent(int, uint64, uint64);
+
 // log.c
 void            initlog(int, struct superblock*);
 void            log_write(struct buf*);
@@ -84,6 +97,8 @@ int             pipewrite(struct pipe*, uint64, int);
 void            printf(char*, ...);
 void            panic(char*) __attribute__((noreturn));
 void            printfinit(void);
+int             tracefp(uint64, uint64*, int);
+int             trace(uint64*, int);
 
 // proc.c
 int             cpuid(void);
@@ -153,8 +168,11 @@ void            syscall();
 extern uint     ticks;
 void            trapinit(void);
 void            trapinithart(void);
-extern struct spinlock tickslock;
 void            usertrapret(void);
+uint            uptime(void);
+uint64          clocknow(void);
+uint64          clockns(void);
+int             ticksleep(uint);
 
 // uart.c
 void            uartinit(void);
@@ -208,6 +226,10 @@ int             copyinstr_new(pagetable_t, char *, uint64, uint64);
 void            statsinit(void);
 void            statsinc(void);
 
+// prof.c
+void            profinit(void);
+void            proftick(int, uint64, uint64);
+
 // sprintf.c
 int             snprintf(char*, int, char*, ...);
 
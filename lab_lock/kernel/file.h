@@ -46,3 +46,5 @@ extern struct devsw devsw[];
 
 #define CONSOLE 1
 #define STATS   2
+#define PROFILE 3
+#define KTRACE  4
@@ -8,6 +8,7 @@
 #include "spinlock.h"
 #include "riscv.h"
 #include "defs.h"
+#include "ktrace.h"
 
 void freerange(void *pa_start, void *pa_end);
 
@@ -23,6 +24,8 @@ struct {
   struct run *freelist;
 } kmem[NCPU];
 
+static int nalloc, nfree, nsteal, nfail;   // counter ids
+
 void
 kinit()
 {
@@ -32,6 +35,10 @@ kinit()
     snprintf(buf, 16, "kmem: CPU %d", i);
     initlock(&kmem[i].lock, buf);
   }
+  nalloc = counternew("kalloc");
+  nfree = counternew("kfree");
+  nsteal = counternew("kalloc_steal");
+  nfail = counternew("kalloc_fail");
   freerange(end, (void*)PHYSTOP);
 }
 
@@ -56,6 +63,8 @@ kfree(void *pa)
   
   if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
     panic("kfree");
+  TRACEPOINT(TP_KFREE, pa, 0);
+  counteradd(nfree, 1);
 
   // Fill with junk to catch dangling refs.
   memset(pa, 1, PGSIZE);
@@ -109,6 +118,7 @@ kalloc(void)
         current = current->next;
       }
 
+      counteradd(nsteal, 1);
       r = kmem[i].freelist;
       kmem[i].freelist = current->next;
       current->next = 0;
@@ -121,7 +131,12 @@ kalloc(void)
   }
   release(&kmem[hartid].lock);
 
-  if(r)
+  if(r){
     memset((char*)r, 5, PGSIZE); // fill with junk
+    TRACEPOINT(TP_KALLOC, r, 0);
+    counteradd(nalloc, 1);
+  } else {
+    counteradd(nfail, 1);
+  }
   return (void*)r;
 }
@@ -7,103 +7,56 @@
 #include "defs.h"
 
 //
-// Race detector using gcc's thread sanitizer. It delays all stores
+// Race detector using gcc's thread sanitizer. It delays some stores
 // and loads and monitors if any other CPU is using the same address.
 // If so, we have a race and print out the backtrace of the thread
 // that raced and the thread that set the watchpoint.
 //
+// Every access checks the watchpoints, without a lock; only every
+// KCSAN_SAMPLE'th store on a CPU sets one, in that CPU's slot, and
+// delays for KCSAN_DELAY cycles while it is set.
+//
 
 //
 // To run with kcsan:
 // make clean
 // make KCSAN=1 qemu
 //
+// To sample, for long runs such as usertests or grind:
+// make KCSAN=1 KCSAN_SAMPLE=1000 KCSAN_DELAY=20000 qemu
+//
 
-// The number of watch points.
-#define NWATCH (NCPU)
-
-// The number of cycles to delay stores, whatever that means on qemu.
-//#define DELAY_CYCLES 20000
-#define DELAY_CYCLES 200000
+// Set a watchpoint on one store in this many, per CPU.
+#ifndef KCSAN_SAMPLE
+#define KCSAN_SAMPLE 1
+#endif
 
-#define MAXTRACE 20
+// The number of cycles to delay, whatever that means on qemu.
+#ifndef KCSAN_DELAY
+#define KCSAN_DELAY 200000
+#endif
 
-int
-trace(uint64 *trace, int maxtrace)
-{
-  uint64 i = 0;
-  
-  push_off();
-  
-  uint64 fp = r_fp();
-  uint64 ra, low = PGROUNDDOWN(fp) + 16, high = PGROUNDUP(fp);
-
-  while(!(fp & 7) && fp >= low && fp < high){
-    ra = *(uint64*)(fp - 8);
-    fp = *(uint64*)(fp - 16);
-    trace[i++] = ra;
-    if(i >= maxtrace)
-      break;
-  }
+// The number of watch points: one per CPU.
+#define NWATCH (NCPU)
 
-  pop_off();
-  
-  return i;
-}
+#define MAXTRACE 20
 
 struct watch {
-  uint64 addr;
+  uint64 addr;          // 0 if not set; published last
   int write;
-  int race;
+  int race;             // set by the access that hit it
+  int busy;             // slot claimed, by atomic exchange
   uint64 trace[MAXTRACE];
   int tracesz;
-};
-  
+} __attribute__((aligned(64)));
+
 struct {
-  struct spinlock lock;
+  struct spinlock lock;   // serializes reports
   struct watch points[NWATCH];
+  uint count[NCPU];       // stores since the last watchpoint
   int on;
 } tsan;
 
-static struct watch*
-wp_lookup(uint64 addr)
-{
-  for(struct watch *w = &tsan.points[0]; w < &tsan.points[NWATCH]; w++) {
-    if(w->addr == addr) {
-      return w;
-    }
-  }
-  return 0;
-}
-
-static int
-wp_install(uint64 addr, int write)
-{
-  for(struct watch *w = &tsan.points[0]; w < &tsan.points[NWATCH]; w++) {
-    if(w->addr == 0) {
-      w->addr = addr;
-      w->write = write;
-      w->tracesz = trace(w->trace, MAXTRACE);
-      return 1;
-    }
-  }
-  panic("wp_install");
-  return 0;
-}
-
-static void
-wp_remove(uint64 addr)
-{
-  for(struct watch *w = &tsan.points[0]; w < &tsan.points[NWATCH]; w++) {
-    if(w->addr == addr) {
-      w->addr = 0;
-      w->tracesz = 0;
-      return;
-    }
-  }
-  panic("remove");
-}
-
 static void
 printtrace(uint64 *t, int n)
 {
@@ -120,12 +73,14 @@ race(char *s, struct watch *w) {
   int n;
   
   n = trace(t, MAXTRACE);
+  acquire(&tsan.lock);
   printf("== race detected ==\n");
   printf("backtrace for racing %s\n", s);
   printtrace(t, n);
   printf("backtrace for watchpoint:\n");
   printtrace(w->trace, w->tracesz);
   printf("==========\n");
+  release(&tsan.lock);
 }
 
 // cycle counter
@@ -139,55 +94,72 @@ r_cycle()
 
 static void delay(void) __attribute__((noinline));
 static void delay() {
-  uint64 stop = r_cycle() + DELAY_CYCLES;
+  uint64 stop = r_cycle() + KCSAN_DELAY;
   uint64 c = r_cycle();
   while(c < stop) {
     c = r_cycle();
   }
 }
 
+// does another access's watchpoint cover addr? a race if
+// either access is a store.
 static void
-kcsan_read(uint64 addr, int sz)
+check(uint64 addr, int write)
 {
-  struct watch *w;
-  
-  acquire(&tsan.lock);
-  if((w = wp_lookup(addr)) != 0) {
-    if(w->write) {
-      race("load", w);
+  for(struct watch *w = &tsan.points[0]; w < &tsan.points[NWATCH]; w++) {
+    if(__atomic_load_n(&w->addr, __ATOMIC_ACQUIRE) == addr &&
+       (write || w->write)) {
+      if(__atomic_exchange_n(&w->race, 1, __ATOMIC_RELAXED) == 0)
+        race(write ? "store" : "load", w);
+      return;
     }
-    release(&tsan.lock);
-    return;
   }
-  release(&tsan.lock);
 }
 
+// set a watchpoint on addr in this CPU's slot, delay, and
+// take it down. if the slot is busy (a thread this CPU was
+// running is in its delay), skip this one.
 static void
-kcsan_write(uint64 addr, int sz)
+watch(uint64 addr, int write)
 {
-  struct watch *w;
-  
-  acquire(&tsan.lock);
-  if((w = wp_lookup(addr)) != 0) {
-    race("store", w);
-    release(&tsan.lock);
-  }
+  struct watch *w = &tsan.points[r_tp()];
 
-  // no watchpoint; try to install one
-  if(wp_install(addr, 1)) {
+  if(__atomic_exchange_n(&w->busy, 1, __ATOMIC_ACQUIRE))
+    return;
+  w->write = write;
+  w->race = 0;
+  w->tracesz = trace(w->trace, MAXTRACE);
+  __atomic_store_n(&w->addr, addr, __ATOMIC_RELEASE);
 
-    release(&tsan.lock);
+  // XXX maybe read value at addr before and after delay to catch
+  // races of unknown origins (e.g., device).
 
-    // XXX maybe read value at addr before and after delay to catch
-    // races of unknown origins (e.g., device).
+  delay();
 
-    delay(); 
+  __atomic_store_n(&w->addr, 0, __ATOMIC_RELEASE);
+  __atomic_store_n(&w->busy, 0, __ATOMIC_RELEASE);
+}
 
-    acquire(&tsan.lock);
+static void
+kcsan_read(uint64 addr, int sz)
+{
+  check(addr, 0);
+}
 
-    wp_remove(addr);
-  }
-  release(&tsan.lock);
+static void
+kcsan_write(uint64 addr, int sz)
+{
+  uint *count;
+
+  check(addr, 1);
+
+  // a thread that moves CPUs may bump another CPU's count;
+  // that only shifts the sampling a little.
+  count = &tsan.count[r_tp()];
+  if(++*count < KCSAN_SAMPLE)
+    return;
+  *count = 0;
+  watch(addr, 1);
 }
 
 // tsan.on will only have effect with "make KCSAN=1"
@@ -308,6 +280,42 @@ __tsan_atomic32_store(uint *ptr, uint val, int order)
   __atomic_store(ptr, &val, __ATOMIC_SEQ_CST);
 }
 
+uint32
+__tsan_atomic32_fetch_add(uint *ptr, uint val, int order)
+{
+  return __atomic_fetch_add(ptr, val, __ATOMIC_SEQ_CST);
+}
+
+uint32
+__tsan_atomic32_fetch_sub(uint *ptr, uint val, int order)
+{
+  return __atomic_fetch_sub(ptr, val, __ATOMIC_SEQ_CST);
+}
+
+uint64
+__tsan_atomic64_load(uint64 *ptr, int order)
+{
+  return __atomic_load_n(ptr, __ATOMIC_SEQ_CST);
+}
+
+void
+__tsan_atomic64_store(uint64 *ptr, uint64 val, int order)
+{
+  __atomic_store_n(ptr, val, __ATOMIC_SEQ_CST);
+}
+
+uint64
+__tsan_atomic64_fetch_add(uint64 *ptr, uint64 val, int order)
+{
+  return __atomic_fetch_add(ptr, val, __ATOMIC_SEQ_CST);
+}
+
+uint64
+__tsan_atomic64_fetch_sub(uint64 *ptr, uint64 val, int order)
+{
+  return __atomic_fetch_sub(ptr, val, __ATOMIC_SEQ_CST);
+}
+
 // We don't use this
 void
 __tsan_func_entry(uint64 pc)
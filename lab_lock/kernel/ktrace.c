@@ -0,0 +1,159 @@
+//
+// tracepoints. an enabled tracepoint appends an event with a
+// timestamp to its CPU's ring; user/ktrace.c reads the rings
+// through the ktrace device.
+//
+// each ring has one writer, its CPU with interrupts off, and
+// readers serialized by ktrace.lock, so the rings need no
+// lock on the writing side: the writer publishes an event by
+// advancing tail, a reader frees a slot by advancing head.
+// when a ring is full, events are counted as lost.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "riscv.h"
+#include "proc.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "ktrace.h"
+#include "defs.h"
+
+#define NTPEVENT 4096   // per CPU
+
+struct tpring {
+  uint head;            // next to read
+  uint tail;            // next to write
+  uint lost;
+  struct tpevent e[NTPEVENT];
+};
+
+char tpon[NTP];
+
+static struct {
+  struct spinlock lock;
+  int on;
+  struct tpring ring[NCPU];
+} ktrace;
+
+void
+tpevent(int id, uint64 a, uint64 b)
+{
+  struct tpring *r;
+  struct tpevent *e;
+  struct proc *p;
+  uint tail;
+
+  push_off();
+  r = &ktrace.ring[cpuid()];
+  tail = r->tail;
+  if(tail - __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) == NTPEVENT){
+    __atomic_fetch_add(&r->lost, 1, __ATOMIC_RELAXED);
+  } else {
+    e = &r->e[tail % NTPEVENT];
+    p = mycpu()->proc;
+    e->time = r_time();
+    e->a = a;
+    e->b = b;
+    e->pid = p ? p->pid : 0;
+    e->id = id;
+    e->cpu = cpuid();
+    __atomic_store_n(&r->tail, tail + 1, __ATOMIC_RELEASE);
+  }
+  pop_off();
+}
+
+// take one event, or a TP_LOST record, off ring i.
+static int
+take(int i, struct tpevent *e)
+{
+  struct tpring *r = &ktrace.ring[i];
+  uint head, lost;
+
+  if((lost = __atomic_exchange_n(&r->lost, 0, __ATOMIC_RELAXED)) != 0){
+    memset(e, 0, sizeof(*e));
+    e->id = TP_LOST;
+    e->cpu = i;
+    e->a = lost;
+    e->time = r_time();
+    return 1;
+  }
+  head = r->head;
+  if(head == __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE))
+    return 0;
+  *e = r->e[head % NTPEVENT];
+  __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+  return 1;
+}
+
+// whole events from every CPU. waits a tick at a time while
+// tracing is on and there are none; returns 0 once tracing
+// is off and the rings are empty.
+static int
+ktraceread(int user_dst, uint64 dst, int n)
+{
+  struct tpevent e;
+  int got = 0, i, any;
+
+  for(;;){
+    for(i = 0; i < NCPU; i++){
+      while(got + sizeof(e) <= n){
+        acquire(&ktrace.lock);
+        any = take(i, &e);
+        release(&ktrace.lock);
+        if(!any)
+          break;
+        if(either_copyout(user_dst, dst + got, &e, sizeof(e)) < 0)
+          return got ? got : -1;
+        got += sizeof(e);
+      }
+    }
+    if(got > 0 || !ktrace.on || n < sizeof(e))
+      return got;
+    if(ticksleep(1) < 0)
+      return -1;
+  }
+}
+
+static int
+ktracewrite(int user_src, uint64 src, int n)
+{
+  uint mask;
+  int i;
+
+  if(n != sizeof(mask) || either_copyin(&mask, user_src, src, sizeof(mask)) < 0)
+    return -1;
+  for(i = 0; i < NTP; i++)
+    tpon[i] = 0;
+  ktrace.on = 0;
+  __sync_synchronize();
+
+  if(mask == 0)
+    return n;   // leave the rest for the reader
+
+  // discard what's buffered.
+  acquire(&ktrace.lock);
+  for(i = 0; i < NCPU; i++){
+    struct tpring *r = &ktrace.ring[i];
+    __atomic_store_n(&r->head, __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+    __atomic_store_n(&r->lost, 0, __ATOMIC_RELAXED);
+  }
+  release(&ktrace.lock);
+
+  for(i = 1; i < NTP; i++)
+    if(mask & (1 << i))
+      tpon[i] = 1;
+  ktrace.on = 1;
+  return n;
+}
+
+void
+ktraceinit(void)
+{
+  initlock(&ktrace.lock, "ktrace");
+  devsw[KTRACE].read = ktraceread;
+  devsw[KTRACE].write = ktracewrite;
+}
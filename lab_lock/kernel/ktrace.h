@@ -0,0 +1,41 @@
+// tracepoints, and the records the ktrace device returns.
+
+enum {
+  TP_LOST,          // a: events this cpu dropped
+  TP_BGET_HIT,      // a: dev, b: blockno
+  TP_BGET_MISS,     // a: dev, b: blockno
+  TP_DISK_SUBMIT,   // a: blockno, b: 1 if a write
+  TP_DISK_DONE,     // a: blockno
+  TP_BEGIN_OP,      // begin_op() called
+  TP_OP_ADMIT,      // begin_op() returns; a: outstanding ops
+  TP_END_OP,
+  TP_COMMIT,        // a: blocks in the transaction
+  TP_COMMIT_DONE,
+  TP_SLEEP,         // a: chan
+  TP_WAKEUP,        // a: chan, b: pid woken
+  TP_SWITCH,        // scheduler runs pid a
+  TP_KALLOC,        // a: pa
+  TP_KFREE,         // a: pa
+  NTP
+};
+
+struct tpevent {
+  uint64 time;      // time CSR
+  uint64 a;
+  uint64 b;
+  int pid;          // running process, 0 if none
+  uchar id;
+  uchar cpu;
+  ushort pad;
+};
+
+// writing a uint bit mask to the ktrace device discards
+// buffered events and enables the tracepoints whose ids have
+// their bit set; writing 0 turns tracing off and leaves the
+// events for reading.
+
+// costs a load and a branch while disabled.
+#define TRACEPOINT(id, a, b) do { \
+  if(tpon[id]) \
+    tpevent((id), (uint64)(a), (uint64)(b)); \
+} while(0)
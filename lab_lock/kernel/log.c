@@ -6,6 +6,7 @@
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "ktrace.h"
 
 // Simple logging that allows concurrent FS system calls.
 //
@@ -48,6 +49,8 @@ struct log {
 };
 struct log log;
 
+static int ncommit, nwait;   // counter ids
+
 static void recover_from_log(void);
 static void commit();
 
@@ -58,6 +61,8 @@ initlog(int dev, struct superblock *sb)
     panic("initlog: too big logheader");
 
   initlock(&log.lock, "log");
+  ncommit = counternew("log_commit");
+  nwait = counternew("log_wait");
   log.start = sb->logstart;
   log.size = sb->nlog;
   log.dev = dev;
@@ -126,15 +131,19 @@ recover_from_log(void)
 void
 begin_op(void)
 {
+  TRACEPOINT(TP_BEGIN_OP, 0, 0);
   acquire(&log.lock);
   while(1){
     if(log.committing){
+      counteradd(nwait, 1);
       sleep(&log, &log.lock);
     } else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > LOGSIZE){
       // this op might exhaust log space; wait for commit.
+      counteradd(nwait, 1);
       sleep(&log, &log.lock);
     } else {
       log.outstanding += 1;
+      TRACEPOINT(TP_OP_ADMIT, log.outstanding, 0);
       release(&log.lock);
       break;
     }
@@ -148,6 +157,7 @@ end_op(void)
 {
   int do_commit = 0;
 
+  TRACEPOINT(TP_END_OP, 0, 0);
   acquire(&log.lock);
   log.outstanding -= 1;
   if(log.committing)
@@ -193,6 +203,8 @@ write_log(void)
 static void
 commit()
 {
+  TRACEPOINT(TP_COMMIT, log.lh.n, 0);
+  counteradd(ncommit, 1);
   if (log.lh.n > 0) {
     write_log();     // Write modified blocks from cache to log
     write_head();    // Write header to disk -- the real commit
@@ -200,6 +212,7 @@ commit()
     log.lh.n = 0;
     write_head();    // Erase the transaction from the log
   }
+  TRACEPOINT(TP_COMMIT_DONE, 0, 0);
 }
 
 // Caller has modified b->data and is done with the buffer.
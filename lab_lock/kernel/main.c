@@ -14,11 +14,14 @@ main()
     consoleinit();
 #if defined(LAB_LOCK)
     statsinit();
+    profinit();
 #endif
     printfinit();
+    ktraceinit();
     printf("\n");
     printf("xv6 kernel is booting\n");
     printf("\n");
+    counterinit();   // event counters
     kinit();         // physical page allocator
     kvminit();       // create kernel page table
     kvminithart();   // turn on paging
@@ -62,6 +62,9 @@
 //   fixed-size stack
 //   expandable heap
 //   ...
+//   COUNTERS (kernel counters, read-only; see counter.h)
 //   TRAPFRAME (p->trapframe, used by the trampoline)
 //   TRAMPOLINE (the same page as in the kernel)
 #define TRAPFRAME (TRAMPOLINE - PGSIZE)
+#define NCOUNTERPAGE 2
+#define COUNTERS (TRAPFRAME - NCOUNTERPAGE*PGSIZE)
@@ -127,6 +127,34 @@ panic(char *s)
     ;
 }
 
+// the return addresses of the frames on the kernel stack
+// starting at frame pointer fp, innermost first.
+int
+tracefp(uint64 fp, uint64 *trace, int maxtrace)
+{
+  uint64 i = 0;
+  uint64 ra, low = PGROUNDDOWN(fp) + 16, high = PGROUNDUP(fp);
+
+  while(i < maxtrace && !(fp & 7) && fp >= low && fp < high){
+    ra = *(uint64*)(fp - 8);
+    fp = *(uint64*)(fp - 16);
+    trace[i++] = ra;
+  }
+  return i;
+}
+
+// a backtrace of the caller.
+int
+trace(uint64 *trace, int maxtrace)
+{
+  int n;
+
+  push_off();
+  n = tracefp(r_fp(), trace, maxtrace);
+  pop_off();
+  return n;
+}
+
 void
 printfinit(void)
 {
@@ -5,6 +5,7 @@
 #include "spinlock.h"
 #include "proc.h"
 #include "defs.h"
+#include "ktrace.h"
 
 struct cpu cpus[NCPU];
 
@@ -43,6 +44,8 @@ proc_mapstacks(pagetable_t kpgtbl)
   }
 }
 
+static int nswitch, nfork;   // counter ids
+
 // initialize the proc table.
 void
 procinit(void)
@@ -50,6 +53,8 @@ procinit(void)
   struct proc *p;
   
   initlock(&pid_lock, "nextpid");
+  nswitch = counternew("context_switch");
+  nfork = counternew("fork");
   initlock(&wait_lock, "wait_lock");
   for(p = proc; p < &proc[NPROC]; p++) {
       initlock(&p->lock, "proc");
@@ -202,6 +207,14 @@ proc_pagetable(struct proc *p)
     return 0;
   }
 
+  // the kernel's counters, read-only, below the trapframe.
+  if(countermap(pagetable) < 0){
+    uvmunmap(pagetable, TRAMPOLINE, 1, 0);
+    uvmunmap(pagetable, TRAPFRAME, 1, 0);
+    uvmfree(pagetable, 0);
+    return 0;
+  }
+
   return pagetable;
 }
 
@@ -212,6 +225,7 @@ proc_freepagetable(pagetable_t pagetable, uint64 sz)
 {
   uvmunmap(pagetable, TRAMPOLINE, 1, 0);
   uvmunmap(pagetable, TRAPFRAME, 1, 0);
+  uvmunmap(pagetable, COUNTERS, NCOUNTERPAGE, 0);
   uvmfree(pagetable, sz);
 }
 
@@ -311,6 +325,7 @@ fork(void)
   safestrcpy(np->name, p->name, sizeof(p->name));
 
   pid = np->pid;
+  counteradd(nfork, 1);
 
   release(&np->lock);
 
@@ -460,6 +475,8 @@ scheduler(void)
         // before jumping back to us.
         p->state = RUNNING;
         c->proc = p;
+        TRACEPOINT(TP_SWITCH, p->pid, 0);
+        counteradd(nswitch, 1);
         swtch(&c->context, &p->context);
 
         // Process is done running for now.
@@ -550,6 +567,7 @@ sleep(void *chan, struct spinlock *lk)
   // Go to sleep.
   p->chan = chan;
   p->state = SLEEPING;
+  TRACEPOINT(TP_SLEEP, chan, 0);
 
   sched();
 
@@ -573,6 +591,7 @@ wakeup(void *chan)
       acquire(&p->lock);
       if(p->state == SLEEPING && p->chan == chan) {
         p->state = RUNNABLE;
+        TRACEPOINT(TP_WAKEUP, chan, p->pid);
       }
       release(&p->lock);
     }
@@ -0,0 +1,151 @@
+//
+// a sampling profiler. while enabled, each timer interrupt
+// records the interrupted pc and a short frame-pointer
+// backtrace in a per-CPU buffer. user/prof.c reads the
+// samples through the profile device.
+//
+// writing "1" to the device empties the buffers and starts
+// sampling, "0" stops it. reads drain whole records.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "riscv.h"
+#include "proc.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "prof.h"
+#include "defs.h"
+
+#define NPROFSAMPLE 512   // per CPU; about 50 seconds' worth
+
+struct profcpu {
+  struct spinlock lock;
+  struct profsample s[NPROFSAMPLE];
+  int head;          // next sample to read
+  int n;             // samples in s[]
+  int lost;          // dropped since last read
+};
+
+static struct {
+  int on;
+  struct profcpu cpu[NCPU];
+} prof;
+
+// the return addresses of the user frames starting at fp,
+// read through p's page table. user stacks are one page.
+static int
+utrace(struct proc *p, uint64 fp, uint64 *trace, int maxtrace)
+{
+  uint64 i = 0;
+  uint64 frame[2], low = PGROUNDDOWN(fp) + 16, high = PGROUNDUP(fp);
+
+  while(i < maxtrace && !(fp & 7) && fp >= low && fp < high){
+    if(copyin(p->pagetable, (char*)frame, fp - 16, sizeof(frame)) < 0)
+      break;
+    trace[i++] = frame[1];
+    fp = frame[0];
+  }
+  return i;
+}
+
+// called on each timer interrupt, with interrupts off, with
+// the interrupted pc and frame pointer.
+void
+proftick(int user, uint64 pc, uint64 fp)
+{
+  struct profcpu *c;
+  struct profsample *s;
+  struct proc *p;
+
+  if(!prof.on)
+    return;
+  c = &prof.cpu[cpuid()];
+  acquire(&c->lock);
+  if(c->n == NPROFSAMPLE){
+    c->lost++;
+    release(&c->lock);
+    return;
+  }
+  s = &c->s[(c->head + c->n) % NPROFSAMPLE];
+  p = myproc();
+  s->pid = p ? p->pid : 0;
+  s->user = user;
+  s->cpu = cpuid();
+  safestrcpy(s->name, p ? p->name : "idle", sizeof(s->name));
+  s->pc[0] = pc;
+  if(user)
+    s->depth = 1 + utrace(p, fp, s->pc + 1, PROFDEPTH - 1);
+  else
+    s->depth = 1 + tracefp(fp, s->pc + 1, PROFDEPTH - 1);
+  c->n++;
+  release(&c->lock);
+}
+
+static int
+profread(int user_dst, uint64 dst, int n)
+{
+  struct profsample s;
+  int got = 0;
+
+  for(int i = 0; i < NCPU; i++){
+    struct profcpu *c = &prof.cpu[i];
+    while(got + sizeof(s) <= n){
+      acquire(&c->lock);
+      if(c->lost){
+        memset(&s, 0, sizeof(s));
+        s.pid = c->lost;
+        s.cpu = i;
+        c->lost = 0;
+      } else if(c->n > 0){
+        s = c->s[c->head];
+        c->head = (c->head + 1) % NPROFSAMPLE;
+        c->n--;
+      } else {
+        release(&c->lock);
+        break;
+      }
+      release(&c->lock);
+      if(either_copyout(user_dst, dst + got, &s, sizeof(s)) < 0)
+        return got ? got : -1;
+      got += sizeof(s);
+    }
+  }
+  return got;
+}
+
+static int
+profwrite(int user_src, uint64 src, int n)
+{
+  char c;
+
+  if(n < 1 || either_copyin(&c, user_src, src, 1) < 0)
+    return -1;
+  if(c == '1'){
+    prof.on = 0;
+    for(int i = 0; i < NCPU; i++){
+      acquire(&prof.cpu[i].lock);
+      prof.cpu[i].head = prof.cpu[i].n = prof.cpu[i].lost = 0;
+      release(&prof.cpu[i].lock);
+    }
+    __sync_synchronize();
+    prof.on = 1;
+  } else if(c == '0'){
+    prof.on = 0;
+  } else {
+    return -1;
+  }
+  return n;
+}
+
+void
+profinit(void)
+{
+  for(int i = 0; i < NCPU; i++)
+    initlock(&prof.cpu[i].lock, "prof");
+  devsw[PROFILE].read = profread;
+  devsw[PROFILE].write = profwrite;
+}
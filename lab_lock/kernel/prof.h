@@ -0,0 +1,15 @@
+// records read from the profile device.
+
+#define PROFDEPTH 8   // pcs recorded per sample
+
+struct profsample {
+  int pid;            // 0 if the CPU was idle
+  char user;          // 1 if interrupted in user mode
+  char cpu;
+  short depth;        // entries used in pc[]; 0 for a lost record
+  char name[16];      // process name
+  uint64 pc[PROFDEPTH]; // the interrupted pc, then return addresses
+};
+
+// a record with depth 0 says that pid samples were dropped
+// on cpu because its buffer was full.
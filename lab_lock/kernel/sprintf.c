@@ -44,6 +44,23 @@ sprintint(char *s, int xx, int base, int sign)
   return n;
 }
 
+static int
+sprintuint64(char *s, uint64 x)
+{
+  char buf[20];
+  int i, n;
+
+  i = 0;
+  do {
+    buf[i++] = digits[x % 10];
+  } while((x /= 10) != 0);
+
+  n = 0;
+  while(--i >= 0)
+    n += sputc(s+n, buf[i]);
+  return n;
+}
+
 int
 snprintf(char *buf, int sz, char *fmt, ...)
 {
@@ -71,6 +88,9 @@ snprintf(char *buf, int sz, char *fmt, ...)
     case 'x':
       off += sprintint(buf+off, va_arg(ap, int), 16, 1);
       break;
+    case 'l':
+      off += sprintuint64(buf+off, va_arg(ap, uint64));
+      break;
     case 's':
       if((s = va_arg(ap, char*)) == 0)
         s = "(null)";
@@ -38,10 +38,10 @@ start()
   w_mideleg(0xffff);
   w_sie(r_sie() | SIE_SEIE | SIE_STIE | SIE_SSIE);
 
-#ifdef KCSAN
-  // allow supervisor to read cycle counter register
-  w_mcounteren(r_mcounteren()|0x3);
-#endif
+  // let supervisor and user code read the cycle and time
+  // CSRs (rdcycle, rdtime), for cheap timestamps.
+  w_mcounteren(r_mcounteren() | 3);
+  w_scounteren(r_scounteren() | 3);
   
   // configure Physical Memory Protection to give supervisor mode
   // access to all of physical memory.
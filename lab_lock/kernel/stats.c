@@ -19,6 +19,7 @@ static struct {
 
 int statscopyin(char*, int);
 int statslock(char*, int);
+int statscounters(char*, int);
   
 int
 statswrite(int user_src, uint64 src, int n)
@@ -38,7 +39,10 @@ statsread(int user_dst, uint64 dst, int n)
     stats.sz = statscopyin(stats.buf, BUFSZ);
 #endif
 #ifdef LAB_LOCK
+    // lock stats first: kalloctest and bcachetest look for
+    // the first "=", in "tot= ".
     stats.sz = statslock(stats.buf, BUFSZ);
+    stats.sz += statscounters(stats.buf+stats.sz, BUFSZ-stats.sz);
 #endif
   }
   m = stats.sz - stats.off;
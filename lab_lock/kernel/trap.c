@@ -6,7 +6,12 @@
 #include "proc.h"
 #include "defs.h"
 
-struct spinlock tickslock;
+// ticks counts CPU 0's timer interrupts. it is read without a
+// lock; tickslock only orders clockintr()'s wakeup against
+// processes going to sleep in ticksleep(), and is taken only
+// while one is.
+static struct spinlock tickslock;
+static int nticksleep;
 uint ticks;
 
 extern char trampoline[], uservec[], userret[];
@@ -16,10 +21,15 @@ void kernelvec();
 
 extern int devintr();
 
+static int nsyscall, ntimer, ndev;   // counter ids
+
 void
 trapinit(void)
 {
   initlock(&tickslock, "time");
+  nsyscall = counternew("syscall");
+  ntimer = counternew("intr_timer");
+  ndev = counternew("intr_dev");
 }
 
 // set up to take exceptions and traps while in the kernel.
@@ -64,6 +74,7 @@ usertrap(void)
     // so enable only now that we're done with those registers.
     intr_on();
 
+    counteradd(nsyscall, 1);
     syscall();
   } else if((which_dev = devintr()) != 0){
     // ok
@@ -73,6 +84,11 @@ usertrap(void)
     setkilled(p);
   }
 
+#ifdef LAB_LOCK
+  if(which_dev == 2)
+    proftick(1, p->trapframe->epc, p->trapframe->s0);
+#endif
+
   if(killed(p))
     exit(-1);
 
@@ -150,6 +166,13 @@ kerneltrap()
     panic("kerneltrap");
   }
 
+#ifdef LAB_LOCK
+  // kernelvec doesn't touch s0, so the frame pointer that
+  // kerneltrap() saved is the interrupted code's.
+  if(which_dev == 2)
+    proftick(0, sepc, *(uint64*)(r_fp() - 16));
+#endif
+
   // give up the CPU if this is a timer interrupt.
   if(which_dev == 2 && myproc() != 0 && myproc()->state == RUNNING)
     yield();
@@ -160,13 +183,63 @@ kerneltrap()
   w_sstatus(sstatus);
 }
 
+// CPU 0's timer interrupt. each CPU's own count of timer
+// interrupts is the intr_timer counter.
 void
 clockintr()
 {
+  __atomic_add_fetch(&ticks, 1, __ATOMIC_SEQ_CST);
+  if(__atomic_load_n(&nticksleep, __ATOMIC_SEQ_CST) > 0){
+    acquire(&tickslock);
+    wakeup(&ticks);
+    release(&tickslock);
+  }
+}
+
+// clock ticks since boot.
+uint
+uptime(void)
+{
+  return __atomic_load_n(&ticks, __ATOMIC_RELAXED);
+}
+
+// the time CSR: monotonic, the same on every CPU, and cheap
+// to read, at TIMEFREQ per second.
+uint64
+clocknow(void)
+{
+  return r_time();
+}
+
+uint64
+clockns(void)
+{
+  return r_time() * (1000000000 / TIMEFREQ);
+}
+
+// sleep for n clock ticks. returns -1 if killed.
+int
+ticksleep(uint n)
+{
+  uint ticks0;
+  int r = 0;
+
+  // clockintr() increments ticks then looks at nticksleep;
+  // this increments nticksleep then looks at ticks. one of
+  // them sees the other, so a wakeup is not lost.
+  __atomic_add_fetch(&nticksleep, 1, __ATOMIC_SEQ_CST);
   acquire(&tickslock);
-  ticks++;
-  wakeup(&ticks);
+  ticks0 = __atomic_load_n(&ticks, __ATOMIC_SEQ_CST);
+  while(__atomic_load_n(&ticks, __ATOMIC_SEQ_CST) - ticks0 < n){
+    if(killed(myproc())){
+      r = -1;
+      break;
+    }
+    sleep(&ticks, &tickslock);
+  }
   release(&tickslock);
+  __atomic_sub_fetch(&nticksleep, 1, __ATOMIC_SEQ_CST);
+  return r;
 }
 
 // check if it's an external interrupt or software interrupt,
@@ -200,6 +273,7 @@ devintr()
     if(irq)
       plic_complete(irq);
 
+    counteradd(ndev, 1);
     return 1;
   } else if(scause == 0x8000000000000001L){
     // software interrupt from a machine-mode timer interrupt,
@@ -212,6 +286,7 @@ devintr()
     // acknowledge the software interrupt by clearing
     // the SSIP bit in sip.
     w_sip(r_sip() & ~2);
+    counteradd(ntimer, 1);
 
     return 2;
   } else {
@@ -15,6 +15,7 @@
 #include "fs.h"
 #include "buf.h"
 #include "virtio.h"
+#include "ktrace.h"
 
 // the address of virtio mmio register r.
 #define R(r) ((volatile uint32 *)(VIRTIO0 + (r)))
@@ -58,12 +59,16 @@ static struct disk {
   
 } disk;
 
+static int nread, nwrite;   // counter ids
+
 void
 virtio_disk_init(void)
 {
   uint32 status = 0;
 
   initlock(&disk.vdisk_lock, "virtio_disk");
+  nread = counternew("disk_read");
+  nwrite = counternew("disk_write");
 
   if(*R(VIRTIO_MMIO_MAGIC_VALUE) != 0x74726976 ||
      *R(VIRTIO_MMIO_VERSION) != 2 ||
@@ -278,6 +283,9 @@ virtio_disk_rw(struct buf *b, int write)
 
   __sync_synchronize();
 
+  TRACEPOINT(TP_DISK_SUBMIT, b->blockno, write);
+  counteradd(write ? nwrite : nread, 1);
+
   *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
 
   // Wait for virtio_disk_intr() to say request has finished.
@@ -317,6 +325,7 @@ virtio_disk_intr()
       panic("virtio_disk_intr status");
 
     struct buf *b = disk.info[id].b;
+    TRACEPOINT(TP_DISK_DONE, b->blockno, 0);
     b->disk = 0;   // disk is done with buf
     wakeup(b);
 
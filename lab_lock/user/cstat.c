@@ -0,0 +1,74 @@
+//
+// print the kernel's counters.
+//
+// usage: cstat [-c] [interval [count]]
+//
+// reads the counter registry the kernel maps read-only at
+// COUNTERS, without system calls. with an interval (in
+// ticks), prints the counters that changed, and by how much,
+// every interval, count times or forever. -c also prints
+// each CPU's share.
+//
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/riscv.h"
+#include "kernel/memlayout.h"
+#include "kernel/counter.h"
+#include "user/user.h"
+
+static struct counters *c = (struct counters *)COUNTERS;
+static uint64 prev[NCOUNTER];
+static int percpu;
+
+static uint64
+sum(int id)
+{
+  uint64 v = 0;
+
+  for(int i = 0; i < c->ncpu; i++)
+    v += c->val[i][id];
+  return v;
+}
+
+static void
+show(int id, uint64 v)
+{
+  printf("%s %l", c->name[id], v);
+  if(percpu){
+    for(int i = 0; i < c->ncpu; i++)
+      printf(" %l", c->val[i][id]);
+  }
+  printf("\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i = 1, interval = 0, count = -1;
+
+  if(argc > 1 && strcmp(argv[1], "-c") == 0){
+    percpu = 1;
+    i++;
+  }
+  if(i < argc)
+    interval = atoi(argv[i++]);
+  if(i < argc)
+    count = atoi(argv[i++]);
+
+  for(int id = 0; id < c->n; id++){
+    prev[id] = sum(id);
+    show(id, prev[id]);
+  }
+  for(; interval > 0 && count != 0; count--){
+    sleep(interval);
+    printf("---\n");
+    for(int id = 0; id < c->n; id++){
+      uint64 v = sum(id);
+      if(v != prev[id])
+        show(id, v - prev[id]);
+      prev[id] = v;
+    }
+  }
+  exit(0);
+}
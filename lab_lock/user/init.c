@@ -19,6 +19,8 @@ main(void)
   if(open("console", O_RDWR) < 0){
     mknod("console", CONSOLE, 0);
     mknod("statistics", STATS, 0);
+    mknod("profile", PROFILE, 0);
+    mknod("ktrace", KTRACE, 0);
     open("console", O_RDWR);
   }
   dup(0);  // stdout
@@ -0,0 +1,351 @@
+//
+// microbenchmarks of xv6's primitives.
+//
+// usage: kbench [-s scale] [test ...]
+//
+// runs the named tests (default: all of them) and prints one
+// key=value line per result, times in nanoseconds and
+// bandwidths in KB/s, so that runs are easy to compare.
+// scale multiplies every test's iteration count.
+//
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/fcntl.h"
+#include "kernel/fs.h"
+#include "user/user.h"
+
+#define NSPERTICK 100   // the time CSR runs at 10 MHz
+#define NRAND     16    // one-block files for the random I/O tests
+
+static int scale = 1;
+static char buf[4096];
+static uint64 seed = 1;
+
+static uint64
+now(void)
+{
+  return rdtime() * NSPERTICK;
+}
+
+static void
+report(char *key, uint64 v)
+{
+  printf("%s=%l\n", key, v);
+}
+
+static uint
+rnd(void)
+{
+  seed ^= seed << 13;
+  seed ^= seed >> 7;
+  seed ^= seed << 17;
+  return seed;
+}
+
+static void
+fail(char *what)
+{
+  fprintf(2, "kbench: %s failed\n", what);
+  exit(1);
+}
+
+// a system call that fails at once: close()'s argument check.
+static void
+nullsys(void)
+{
+  int n = 10000 * scale;
+  uint64 t = now();
+
+  for(int i = 0; i < n; i++)
+    close(-1);
+  report("null_syscall_ns", (now() - t) / n);
+}
+
+static void
+getpidbench(void)
+{
+  int n = 10000 * scale;
+  uint64 t = now();
+
+  for(int i = 0; i < n; i++)
+    getpid();
+  report("getpid_ns", (now() - t) / n);
+}
+
+static void
+forkbench(void)
+{
+  int n = 100 * scale, pid;
+  uint64 t = now();
+
+  for(int i = 0; i < n; i++){
+    if((pid = fork()) < 0)
+      fail("fork");
+    if(pid == 0)
+      exit(0);
+    wait(0);
+  }
+  report("fork_exit_wait_ns", (now() - t) / n);
+}
+
+static void
+execbench(void)
+{
+  char *argv[] = { "kbench", "-x", 0 };
+  int n = 50 * scale, pid;
+  uint64 t = now();
+
+  for(int i = 0; i < n; i++){
+    if((pid = fork()) < 0)
+      fail("fork");
+    if(pid == 0){
+      exec("kbench", argv);
+      fail("exec");
+    }
+    wait(0);
+  }
+  report("fork_exec_ns", (now() - t) / n);
+}
+
+// a round trip between two processes through two pipes.
+// ctxsw_ns is half of it, less the cost of a write and a
+// read on a pipe with no switch (as lmbench's lat_ctx does).
+static void
+pipebench(void)
+{
+  int n = 1000 * scale, p[2], q[2], pid;
+  uint64 t, rtt, local;
+  char c = 0;
+
+  if(pipe(p) < 0 || pipe(q) < 0)
+    fail("pipe");
+
+  t = now();
+  for(int i = 0; i < n; i++){
+    write(p[1], &c, 1);
+    read(p[0], &c, 1);
+  }
+  local = (now() - t) / n;
+
+  if((pid = fork()) < 0)
+    fail("fork");
+  if(pid == 0){
+    for(int i = 0; i < n; i++){
+      if(read(p[0], &c, 1) != 1)
+        break;
+      write(q[1], &c, 1);
+    }
+    exit(0);
+  }
+  t = now();
+  for(int i = 0; i < n; i++){
+    write(p[1], &c, 1);
+    if(read(q[0], &c, 1) != 1)
+      fail("pipe read");
+  }
+  rtt = (now() - t) / n;
+  wait(0);
+  close(p[0]);
+  close(p[1]);
+  close(q[0]);
+  close(q[1]);
+
+  report("pipe_rtt_ns", rtt);
+  report("ctxsw_ns", rtt > 2 * local ? (rtt - 2 * local) / 2 : 0);
+}
+
+static void
+pipebw(void)
+{
+  int total = 1024 * 1024 * scale, got = 0, p[2], pid, m;
+  uint64 t;
+
+  if(pipe(p) < 0)
+    fail("pipe");
+  if((pid = fork()) < 0)
+    fail("fork");
+  if(pid == 0){
+    close(p[0]);
+    for(int i = 0; i < total; i += sizeof(buf))
+      write(p[1], buf, sizeof(buf));
+    exit(0);
+  }
+  close(p[1]);
+  t = now();
+  while((m = read(p[0], buf, sizeof(buf))) > 0)
+    got += m;
+  t = now() - t;
+  close(p[0]);
+  wait(0);
+  if(got != total)
+    fail("pipe bandwidth");
+  report("pipe_bw_kbps", (uint64)got * 1000000 / (t ? t : 1));
+}
+
+static void
+sbrkbench(void)
+{
+  int n = 1000 * scale;
+  uint64 t = now();
+
+  for(int i = 0; i < n; i++){
+    if(sbrk(4096) == (char*)-1)
+      fail("sbrk");
+    sbrk(-4096);
+  }
+  report("sbrk_grow_shrink_ns", (now() - t) / n);
+}
+
+static void
+createbench(void)
+{
+  int n = 100 * scale, fd;
+  uint64 t = now();
+
+  for(int i = 0; i < n; i++){
+    if((fd = open("kb.tmp", O_CREATE | O_RDWR)) < 0)
+      fail("create");
+    close(fd);
+    unlink("kb.tmp");
+  }
+  report("create_unlink_ns", (now() - t) / n);
+}
+
+// write or read nblock blocks of name; returns the time taken.
+static uint64
+xfer(char *name, int nblock, int writing)
+{
+  int fd;
+  uint64 t;
+
+  fd = open(name, writing ? O_CREATE | O_WRONLY : O_RDONLY);
+  if(fd < 0)
+    fail(name);
+  t = now();
+  for(int i = 0; i < nblock; i++){
+    if((writing ? write(fd, buf, BSIZE) : read(fd, buf, BSIZE)) != BSIZE)
+      fail(writing ? "write" : "read");
+  }
+  t = now() - t;
+  close(fd);
+  return t;
+}
+
+static void
+seqbench(void)
+{
+  int nblock = 100, n = scale;
+  uint64 tw = 0, tr = 0;
+
+  for(int i = 0; i < n; i++){
+    tw += xfer("kb.seq", nblock, 1);
+    tr += xfer("kb.seq", nblock, 0);
+    unlink("kb.seq");
+  }
+  report("seq_write_kbps", (uint64)n * nblock * BSIZE * 1000000 / (tw ? tw : 1));
+  report("seq_read_kbps", (uint64)n * nblock * BSIZE * 1000000 / (tr ? tr : 1));
+}
+
+// xv6 has no lseek, so a random block access opens one of
+// NRAND one-block files; the times include open and close.
+static void
+randbench(void)
+{
+  int n = 200 * scale;
+  char name[] = "kb.r00";
+  uint64 t = 0;
+  uint r;
+
+  for(int i = 0; i < NRAND; i++){
+    name[4] = '0' + i / 10;
+    name[5] = '0' + i % 10;
+    xfer(name, 1, 1);
+  }
+  for(int i = 0; i < n; i++){
+    r = rnd() % NRAND;
+    name[4] = '0' + r / 10;
+    name[5] = '0' + r % 10;
+    t += xfer(name, 1, rnd() & 1);
+  }
+  for(int i = 0; i < NRAND; i++){
+    name[4] = '0' + i / 10;
+    name[5] = '0' + i % 10;
+    unlink(name);
+  }
+  report("rand_rw_ns", t / n);
+}
+
+// bread() of a block the buffer cache holds, and of one it
+// doesn't: reading a file twice the size of the cache from
+// start to end evicts each block before it comes round again.
+static void
+bcachebench(void)
+{
+  int small = 8, big = 2 * NBUF, n = 50 * scale, m = 2 * scale;
+  uint64 t = 0;
+
+  xfer("kb.hit", small, 1);
+  xfer("kb.hit", small, 0);
+  for(int i = 0; i < n; i++)
+    t += xfer("kb.hit", small, 0);
+  report("bcache_hit_ns", t / (n * small));
+  unlink("kb.hit");
+
+  xfer("kb.miss", big, 1);
+  t = 0;
+  for(int i = 0; i < m; i++)
+    t += xfer("kb.miss", big, 0);
+  report("bcache_miss_ns", t / (m * big));
+  unlink("kb.miss");
+}
+
+struct test {
+  char *name;
+  void (*fn)(void);
+} tests[] = {
+  { "null",    nullsys },
+  { "getpid",  getpidbench },
+  { "fork",    forkbench },
+  { "exec",    execbench },
+  { "pipe",    pipebench },
+  { "pipebw",  pipebw },
+  { "sbrk",    sbrkbench },
+  { "create",  createbench },
+  { "seq",     seqbench },
+  { "rand",    randbench },
+  { "bcache",  bcachebench },
+};
+#define NTEST (sizeof(tests) / sizeof(tests[0]))
+
+int
+main(int argc, char *argv[])
+{
+  int i = 1, ran = 0;
+
+  if(argc > 1 && strcmp(argv[1], "-x") == 0)
+    exit(0);   // execbench's child
+  if(argc > 2 && strcmp(argv[1], "-s") == 0){
+    scale = atoi(argv[2]);
+    i = 3;
+  }
+  if(scale < 1)
+    scale = 1;
+
+  report("scale", scale);
+  for(int k = 0; k < NTEST; k++){
+    int want = i == argc;
+    for(int j = i; j < argc; j++)
+      if(strcmp(argv[j], tests[k].name) == 0)
+        want = 1;
+    if(want){
+      tests[k].fn();
+      ran++;
+    }
+  }
+  if(ran == 0){
+    fprintf(2, "usage: kbench [-s scale] [test ...]\n");
+    exit(1);
+  }
+  exit(0);
+}
@@ -0,0 +1,338 @@
+//
+// trace the kernel while a command runs.
+//
+// usage: ktrace [-v] [-e event,...] cmd [arg ...]
+//
+// events are bget, disk, log, sched and kalloc; the default
+// is all of them. ktrace reads the kernel's tracepoint events
+// as cmd runs, puts them in time order, and pairs them up
+// into requests: a disk read or write from submission to
+// completion (and from the bget() miss that caused it), a
+// file system operation from begin_op() to end_op(), a commit,
+// and a sleep from sleep() to wakeup() to running again.
+// it prints latency percentiles for each kind of request, and
+// with -v a timeline of the disk and log requests.
+//
+
+#include "kernel/types.h"
+#include "kernel/fcntl.h"
+#include "kernel/ktrace.h"
+#include "user/user.h"
+
+#define NSPERTICK 100   // the time CSR runs at 10 MHz
+#define NPEND     64    // disk requests, bget misses in flight
+#define NPID      64    // per-process state, by pid % NPID
+
+struct group {
+  char *name;
+  uint mask;
+} groups[] = {
+  { "bget",   1<<TP_BGET_HIT | 1<<TP_BGET_MISS },
+  { "disk",   1<<TP_DISK_SUBMIT | 1<<TP_DISK_DONE },
+  { "log",    1<<TP_BEGIN_OP | 1<<TP_OP_ADMIT | 1<<TP_END_OP |
+              1<<TP_COMMIT | 1<<TP_COMMIT_DONE },
+  { "sched",  1<<TP_SLEEP | 1<<TP_WAKEUP | 1<<TP_SWITCH },
+  { "kalloc", 1<<TP_KALLOC | 1<<TP_KFREE },
+};
+#define NGROUP (sizeof(groups) / sizeof(groups[0]))
+
+// latencies of one kind of request, in ns.
+struct lat {
+  char *name;
+  uint64 *v;
+  int n;
+  int max;
+};
+
+enum { DISKREAD, DISKWRITE, MISSREAD, OPWAIT, OPRUN, COMMIT, SLEEP, RUNQ, NLAT };
+struct lat lats[NLAT] = {
+  { "disk_read" }, { "disk_write" }, { "miss_to_data" }, { "begin_op_wait" },
+  { "op" }, { "commit" }, { "sleep" }, { "wakeup_to_run" },
+};
+
+static struct tpevent *ev;
+static int nev, maxev;
+static int verbose;
+
+// grow a malloc'd array of n elements of size sz to hold
+// at least one more.
+static void *
+grow(void *a, int n, int *max, int sz)
+{
+  void *b;
+
+  if(n < *max)
+    return a;
+  *max = *max ? 2 * *max : 1024;
+  if((b = malloc(*max * sz)) == 0){
+    fprintf(2, "ktrace: out of memory\n");
+    exit(1);
+  }
+  if(a){
+    memmove(b, a, n * sz);
+    free(a);
+  }
+  return b;
+}
+
+static void
+addlat(int k, uint64 t0, uint64 t1)
+{
+  struct lat *l = &lats[k];
+
+  l->v = grow(l->v, l->n, &l->max, sizeof(uint64));
+  l->v[l->n++] = (t1 - t0) * NSPERTICK;
+}
+
+// shell sort, gaps from Ciura.
+static int gaps[] = { 1750, 701, 301, 132, 57, 23, 10, 4, 1 };
+
+static void
+sortlat(uint64 *v, int n)
+{
+  for(int g = 0; g < sizeof(gaps) / sizeof(gaps[0]); g++){
+    int h = gaps[g];
+    for(int i = h; i < n; i++){
+      uint64 x = v[i];
+      int j;
+      for(j = i; j >= h && v[j - h] > x; j -= h)
+        v[j] = v[j - h];
+      v[j] = x;
+    }
+  }
+}
+
+// each CPU's events arrive in order, so this is nearly sorted.
+static void
+sortev(struct tpevent *e, int n)
+{
+  for(int g = 0; g < sizeof(gaps) / sizeof(gaps[0]); g++){
+    int h = gaps[g];
+    for(int i = h; i < n; i++){
+      struct tpevent x = e[i];
+      int j;
+      for(j = i; j >= h && e[j - h].time > x.time; j -= h)
+        e[j] = e[j - h];
+      e[j] = x;
+    }
+  }
+}
+
+static uint
+parsegroups(char *s)
+{
+  uint mask = 0;
+  char *p;
+  int i;
+
+  while(*s){
+    for(p = s; *p && *p != ','; p++)
+      ;
+    for(i = 0; i < NGROUP; i++){
+      if(strlen(groups[i].name) == p - s &&
+         memcmp(groups[i].name, s, p - s) == 0)
+        break;
+    }
+    if(i == NGROUP){
+      fprintf(2, "ktrace: unknown event group; use bget, disk, log, sched, kalloc\n");
+      exit(1);
+    }
+    mask |= groups[i].mask;
+    s = *p ? p + 1 : p;
+  }
+  return mask;
+}
+
+static void
+analyze(int self)
+{
+  // static: too big for the one-page stack.
+  static struct { uint blockno; uint64 t; int write; uint64 miss; } pend[NPEND];
+  static struct { uint blockno; uint64 t; } miss[NPEND];
+  static uint64 begin[NPID], admit[NPID], slept[NPID], woken[NPID];
+  uint64 commit = 0;
+  int nhit = 0, nmiss = 0, nalloc = 0, nfree = 0, live = 0, peak = 0;
+  int lost = 0, nextmiss = 0;
+  uint64 t0 = nev ? ev[0].time : 0;
+
+  for(struct tpevent *e = ev; e < ev + nev; e++){
+    int pid = e->pid % NPID, i;
+    uint64 us = (e->time - t0) * NSPERTICK / 1000;
+
+    switch(e->id){
+    case TP_LOST:
+      lost += e->a;
+      break;
+    case TP_BGET_HIT:
+      nhit++;
+      break;
+    case TP_BGET_MISS:
+      nmiss++;
+      miss[nextmiss].blockno = e->b;
+      miss[nextmiss].t = e->time;
+      nextmiss = (nextmiss + 1) % NPEND;
+      break;
+    case TP_DISK_SUBMIT:
+      for(i = 0; i < NPEND && pend[i].t; i++)
+        ;
+      if(i == NPEND)
+        break;
+      pend[i].blockno = e->a;
+      pend[i].t = e->time;
+      pend[i].write = e->b;
+      pend[i].miss = 0;
+      for(int j = 0; j < NPEND; j++){
+        if(!e->b && miss[j].t && miss[j].blockno == e->a){
+          pend[i].miss = miss[j].t;
+          miss[j].t = 0;
+        }
+      }
+      break;
+    case TP_DISK_DONE:
+      for(i = 0; i < NPEND; i++){
+        if(pend[i].t && pend[i].blockno == e->a)
+          break;
+      }
+      if(i == NPEND)
+        break;
+      addlat(pend[i].write ? DISKWRITE : DISKREAD, pend[i].t, e->time);
+      if(pend[i].miss)
+        addlat(MISSREAD, pend[i].miss, e->time);
+      if(verbose)
+        printf("%l us: disk %s block %d took %l ns\n", us, pend[i].write ? "write" : "read",
+               pend[i].blockno, (e->time - pend[i].t) * NSPERTICK);
+      pend[i].t = 0;
+      break;
+    case TP_BEGIN_OP:
+      begin[pid] = e->time;
+      break;
+    case TP_OP_ADMIT:
+      if(begin[pid])
+        addlat(OPWAIT, begin[pid], e->time);
+      begin[pid] = 0;
+      admit[pid] = e->time;
+      break;
+    case TP_END_OP:
+      if(admit[pid]){
+        addlat(OPRUN, admit[pid], e->time);
+        if(verbose)
+          printf("%l us: pid %d op took %l ns\n", us, e->pid,
+                 (e->time - admit[pid]) * NSPERTICK);
+      }
+      admit[pid] = 0;
+      break;
+    case TP_COMMIT:
+      commit = e->time;
+      if(verbose)
+        printf("%l us: commit of %l blocks\n", us, e->a);
+      break;
+    case TP_COMMIT_DONE:
+      if(commit)
+        addlat(COMMIT, commit, e->time);
+      commit = 0;
+      break;
+    case TP_SLEEP:
+      if(e->pid != self)
+        slept[pid] = e->time;
+      break;
+    case TP_WAKEUP:
+      if(slept[e->b % NPID])
+        addlat(SLEEP, slept[e->b % NPID], e->time);
+      slept[e->b % NPID] = 0;
+      if(e->b != self)
+        woken[e->b % NPID] = e->time;
+      break;
+    case TP_SWITCH:
+      if(woken[e->a % NPID])
+        addlat(RUNQ, woken[e->a % NPID], e->time);
+      woken[e->a % NPID] = 0;
+      break;
+    case TP_KALLOC:
+      nalloc++;
+      if(++live > peak)
+        peak = live;
+      break;
+    case TP_KFREE:
+      nfree++;
+      live--;
+      break;
+    }
+  }
+
+  printf("ktrace: %d events, %d lost\n", nev, lost);
+  printf("bget: hit=%d miss=%d\n", nhit, nmiss);
+  printf("kalloc: %d kfree: %d peak_outstanding=%d\n", nalloc, nfree, peak);
+  for(int k = 0; k < NLAT; k++){
+    struct lat *l = &lats[k];
+    uint64 sum = 0;
+    if(l->n == 0)
+      continue;
+    sortlat(l->v, l->n);
+    for(int i = 0; i < l->n; i++)
+      sum += l->v[i];
+    printf("%s: n=%d mean=%l p50=%l p99=%l max=%l ns\n", l->name, l->n, sum / l->n,
+           l->v[l->n / 2], l->v[l->n * 99 / 100], l->v[l->n - 1]);
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  static struct tpevent buf[64];
+  uint mask = 0, off = 0;
+  int fd, i, n;
+
+  for(i = 1; i < argc && argv[i][0] == '-'; i++){
+    if(strcmp(argv[i], "-v") == 0)
+      verbose = 1;
+    else if(strcmp(argv[i], "-e") == 0 && i + 1 < argc)
+      mask |= parsegroups(argv[++i]);
+    else
+      break;
+  }
+  if(i == argc){
+    fprintf(2, "usage: ktrace [-v] [-e event,...] cmd [arg ...]\n");
+    exit(1);
+  }
+  if(mask == 0)
+    mask = ~1;
+  if((fd = open("ktrace", O_RDWR)) < 0){
+    fprintf(2, "ktrace: cannot open ktrace\n");
+    exit(1);
+  }
+  if(write(fd, &mask, sizeof(mask)) != sizeof(mask)){
+    fprintf(2, "ktrace: cannot enable tracing\n");
+    exit(1);
+  }
+
+  // a helper runs cmd and turns tracing off when it exits;
+  // meanwhile this process drains the events.
+  if((n = fork()) < 0){
+    fprintf(2, "ktrace: fork failed\n");
+    exit(1);
+  }
+  if(n == 0){
+    if((n = fork()) == 0){
+      close(fd);
+      exec(argv[i], argv + i);
+      fprintf(2, "ktrace: exec %s failed\n", argv[i]);
+      exit(1);
+    }
+    wait(0);
+    write(fd, &off, sizeof(off));
+    exit(0);
+  }
+
+  while((n = read(fd, buf, sizeof(buf))) > 0){
+    for(int k = 0; k < n / sizeof(buf[0]); k++){
+      ev = grow(ev, nev, &maxev, sizeof(ev[0]));
+      ev[nev++] = buf[k];
+    }
+  }
+  wait(0);
+  close(fd);
+
+  sortev(ev, nev);
+  analyze(getpid());
+  exit(0);
+}
@@ -0,0 +1,66 @@
+//
+// profile a command: prof cmd [arg ...]
+//
+// samples the pc and a short backtrace on every CPU at each
+// timer interrupt while cmd runs, then prints one line per
+// sample for prof-lab-lock on the host to symbolize:
+//
+//   prof: pid name k|u cpu pc [return address ...]
+//
+// samples come from every process and the idle loop (pid 0),
+// not just cmd.
+//
+
+#include "kernel/types.h"
+#include "kernel/fcntl.h"
+#include "kernel/prof.h"
+#include "user/user.h"
+
+static struct profsample s[16];
+
+int
+main(int argc, char *argv[])
+{
+  int fd, pid, n, nsample = 0, nlost = 0;
+
+  if(argc < 2){
+    fprintf(2, "usage: prof cmd [arg ...]\n");
+    exit(1);
+  }
+  if((fd = open("profile", O_RDWR)) < 0){
+    fprintf(2, "prof: cannot open profile\n");
+    exit(1);
+  }
+  if(write(fd, "1", 1) != 1){
+    fprintf(2, "prof: cannot start profiling\n");
+    exit(1);
+  }
+  if((pid = fork()) < 0){
+    fprintf(2, "prof: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    exec(argv[1], argv + 1);
+    fprintf(2, "prof: exec %s failed\n", argv[1]);
+    exit(1);
+  }
+  wait(0);
+  write(fd, "0", 1);
+
+  while((n = read(fd, s, sizeof(s))) > 0){
+    for(struct profsample *p = s; p < s + n / sizeof(s[0]); p++){
+      if(p->depth == 0){
+        nlost += p->pid;
+        continue;
+      }
+      printf("prof: %d %s %c %d", p->pid, p->name, p->user ? 'u' : 'k', p->cpu);
+      for(int i = 0; i < p->depth; i++)
+        printf(" %p", p->pc[i]);
+      printf("\n");
+      nsample++;
+    }
+  }
+  close(fd);
+  printf("prof: %d samples, %d lost\n", nsample, nlost);
+  exit(0);
+}
@@ -7,6 +7,7 @@ int
 statistics(void *buf, int sz)
 {
   int fd, i, n;
+  char tmp[64];
   
   fd = open("statistics", O_RDONLY);
   if(fd < 0) {
@@ -19,6 +20,10 @@ statistics(void *buf, int sz)
     }
     i += n;
   }
+  // read to the end, even if buf is full, so that the next
+  // reader starts from a fresh snapshot.
+  while(i == sz && read(fd, tmp, sizeof(tmp)) > 0)
+    ;
   close(fd);
   return i;
 }
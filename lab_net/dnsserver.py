@@ -0,0 +1,46 @@
+import socket
+import struct
+import sys
+
+# a stub DNS server for resolvtest: answers A queries from a fixed
+# table. "queries.xv6" resolves to 0.0.0.N, where N counts the
+# other queries answered so far, so tests can tell cache hits.
+names = {
+    'pdos.csail.mit.edu': '128.52.129.126',
+    'host.xv6': '10.0.2.2',
+    'short.xv6': '10.0.2.3',
+}
+ttls = {'short.xv6': 1, 'queries.xv6': 0}
+
+sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+addr = ('localhost', int(sys.argv[1]))
+print('dns listening on %s port %s' % addr, file=sys.stderr)
+sock.bind(addr)
+
+count = 0
+while True:
+    buf, raddr = sock.recvfrom(4096)
+    if len(buf) < 12:
+        continue
+    qid, flags, qdcount = struct.unpack('!HHH', buf[:6])
+    labels, off = [], 12
+    while off < len(buf) and buf[off] != 0:
+        n = buf[off]
+        labels.append(buf[off+1:off+1+n].decode())
+        off += n + 1
+    question = buf[12:off+5]
+    name = '.'.join(labels)
+    print('query for %s' % name, file=sys.stderr)
+
+    if name == 'queries.xv6':
+        ip = '0.0.0.%d' % count
+    else:
+        count += 1
+        ip = names.get(name)
+    hdr = struct.pack('!HHHHHH', qid, 0x8180 if ip else 0x8183, 1,
+                      1 if ip else 0, 0, 0)
+    reply = hdr + question
+    if ip:
+        reply += struct.pack('!HHHIH', 0xc00c, 1, 1, ttls.get(name, 300), 4)
+        reply += socket.inet_aton(ip)
+    sock.sendto(reply, raddr)
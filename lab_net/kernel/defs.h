@@ -11,6 +11,7 @@ struct superblock;
 #ifdef LAB_NET
 struct mbuf;
 struct sock;
+struct epoll;
 #endif
 
 // bio.c
@@ -37,6 +38,11 @@ void            fileinit(void);
 int             fileread(struct file*, uint64, int n);
 int             filestat(struct file*, uint64 addr);
 int             filewrite(struct file*, uint64, int n);
+struct file*    fdget(struct proc*, int);
+int             fdalloc(struct proc*, struct file*);
+void            fdclear(struct proc*, int);
+int             fdcopy(struct proc*, struct proc*);
+void            fdcloseall(struct proc*);
 
 // fs.c
 void            fsinit(int);
@@ -94,6 +100,7 @@ void            proc_mapstacks(pagetable_t);
 pagetable_t     proc_pagetable(struct proc *);
 void            proc_freepagetable(pagetable_t, uint64);
 int             kill(int);
+int             kthread(void (*)(void*), void*, char*);
 int             killed(struct proc*);
 void            setkilled(struct proc*);
 struct cpu*     mycpu(void);
@@ -226,14 +233,25 @@ void            e1000_intr(void);
 int             e1000_transmit(struct mbuf*);
 
 // net.c
+void            netinit(void);
 void            net_rx(struct mbuf*);
+void            net_rx_steer(struct mbuf*);
+void            netrxinithart(void);
 void            net_tx_udp(struct mbuf*, uint32, uint16, uint16);
 
+// pcap.c
+void            pcapinit(void);
+void            pcap_tap(struct mbuf*);
+
 // sysnet.c
 void            sockinit(void);
 int             sockalloc(struct file **, uint32, uint16, uint16);
 void            sockclose(struct sock *);
-int             sockread(struct sock *, uint64, int);
-int             sockwrite(struct sock *, uint64, int);
+int             sockread(struct sock *, int, uint64, int, uint32*, uint16*);
+int             sockwrite(struct sock *, uint64, int, uint32, uint16);
 void            sockrecvudp(struct mbuf*, uint32, uint16, uint16);
+int             epollalloc(struct file **);
+void            epollclose(struct epoll *);
+int             epollctl(struct epoll *, int, struct file *, uint64);
+int             epollwait(struct epoll *, uint64, int, int);
 #endif
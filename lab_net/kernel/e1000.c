@@ -16,6 +16,11 @@ static struct mbuf *tx_mbufs[TX_RING_SIZE];
 static struct rx_desc rx_ring[RX_RING_SIZE] __attribute__((aligned(16)));
 static struct mbuf *rx_mbufs[RX_RING_SIZE];
 
+// a packet that spans several rx buffers is collected here
+// until the descriptor with EOP arrives.
+static struct mbuf *rx_pkt, *rx_last;
+static int rx_drop; // discard the rest of the current packet
+
 // remember where the e1000's registers live.
 static volatile uint32 *regs;
 
@@ -83,7 +88,11 @@ e1000_init(uint32 *xregs)
   // receiver control bits.
   regs[E1000_RCTL] = E1000_RCTL_EN | // enable receiver
     E1000_RCTL_BAM |                 // enable broadcast
-    E1000_RCTL_SZ_2048 |             // 2048-byte rx buffers
+    E1000_RCTL_BSEX |                // 4096-byte rx buffers,
+    E1000_RCTL_SZ_4096 |             // i.e. MBUF_SIZE
+#if NET_MTU > 1500
+    E1000_RCTL_LPE |                 // accept jumbo frames
+#endif
     E1000_RCTL_SECRC;                // strip CRC
   
   // ask e1000 for receive interrupts.
@@ -137,28 +146,48 @@ e1000_transmit(struct mbuf *m)
   // Vyziadanie indexu okruhu
   // Kontrola DD ci nepretiekol, ak ano uvolnime zamok
 
+  // Jumbo packets arrive as a chain of mbufs and take one
+  // descriptor per buffer; only the last one carries EOP.
+
+  struct mbuf *b;
+  uint64 n, i, index, slot;
+
+  n = 0;
+  for (b = m; b; b = b->more)
+    n++;
+
   acquire(&e1000_lock);
-  uint64 index = regs[E1000_TDT];
-  if ((tx_ring[index].status & E1000_TXD_STAT_DD) == 0) {
+  index = regs[E1000_TDT];
+  // keep one descriptor unused so that a full ring never looks empty (H == T)
+  if (n > (regs[E1000_TDH] + TX_RING_SIZE - index - 1) % TX_RING_SIZE) {
     release(&e1000_lock);
     return -1;
   }
-  // Uvolnime buffer ak na danom indexe nieco je
-  if (tx_mbufs[index] != 0) {
-    mbuffree(tx_mbufs[index]);
+  for (i = 0; i < n; i++) {
+    if ((tx_ring[(index + i) % TX_RING_SIZE].status & E1000_TXD_STAT_DD) == 0) {
+      release(&e1000_lock);
+      return -1;
+    }
   }
 
-  // Vyplnanie deskriptora TX, addr -> jead, length -> len, pripocitanie cmd priznakov EOP RS
-  // Ukladanie na neskorsie uvolneine
-  // Aktualizacia pozicie, posun o jedno nizsie modulo
-  // Uvolnenie zamku
-  tx_ring[index].addr = (uint64) m->head;
-  tx_ring[index].length = m->len;
-  tx_ring[index].cmd = E1000_TXD_CMD_EOP | E1000_TXD_CMD_RS;
-  tx_mbufs[index] = m;
-  regs[E1000_TDT] = (regs[E1000_TDT] + 1) % TX_RING_SIZE;
-  release(&e1000_lock);
+  // fill in the descriptors, freeing whatever was sent from them before
+  for (b = m, i = 0; b; b = b->more, i++) {
+    slot = (index + i) % TX_RING_SIZE;
+    if (tx_mbufs[slot] != 0) {
+      mbuffree(tx_mbufs[slot]);
+      tx_mbufs[slot] = 0;
+    }
+    tx_ring[slot].addr = (uint64) b->head;
+    tx_ring[slot].length = b->len;
+    tx_ring[slot].cmd = (b->more ? 0 : E1000_TXD_CMD_EOP) | E1000_TXD_CMD_RS;
+    tx_ring[slot].status = 0;
+  }
+  // the whole chain is freed when its last descriptor is reused
+  tx_mbufs[(index + n - 1) % TX_RING_SIZE] = m;
 
+  __sync_synchronize();
+  regs[E1000_TDT] = (index + n) % TX_RING_SIZE;
+  release(&e1000_lock);
 
   return 0;
 }
@@ -196,37 +225,51 @@ e1000_recv(void)
   // RD + 1 % RING_SIZE
   // Kontrola DD
 
-  acquire(&e1000_lock);
-  uint64 index = (regs[E1000_RDT] + 1) % RX_RING_SIZE;
+  // Packets larger than one buffer span several descriptors;
+  // only the last one has EOP set.
 
-  struct mbuf *buf[RX_RING_SIZE];
-  for (uint64 i = 0; i < RX_RING_SIZE; i++) {
-    buf[i] = 0;
-  }
-  uint64 i = 0;
-  while (index != regs[E1000_RDH]) {
-    if ((rx_ring[index].status & E1000_RXD_STAT_DD) == 0) {
-      // Neskor sa uvolni zamok
-      break;
+  struct mbufq done;
+  struct mbuf *m, *newBuf;
+  uint64 index;
+  uint8 status;
+
+  mbufq_init(&done);
+  acquire(&e1000_lock);
+  index = (regs[E1000_RDT] + 1) % RX_RING_SIZE;
+  while ((status = rx_ring[index].status) & E1000_RXD_STAT_DD) {
+    m = rx_mbufs[index];
+    if ((newBuf = mbufalloc(0)) == 0) {
+      // out of buffers: drop the packet and reuse this buffer
+      newBuf = m;
+      rx_drop = 1;
+    } else {
+      m->len = rx_ring[index].length;
+      if (rx_pkt == 0)
+        rx_pkt = m;
+      else
+        rx_last->more = m;
+      rx_last = m;
     }
-    rx_mbufs[index]->len = rx_ring[index].length;
-    buf[i++] = rx_mbufs[index];           // odoslany do net_rx
 
-    struct mbuf *newBuf = mbufalloc(0);   // alokovanie noveho buffera
+    if (status & E1000_RXD_STAT_EOP) {
+      if (rx_drop || rx_ring[index].errors)
+        mbuffree(rx_pkt);
+      else if (rx_pkt)
+        mbufq_pushtail(&done, rx_pkt);
+      rx_pkt = rx_last = 0;
+      rx_drop = 0;
+    }
 
+    rx_ring[index].status = 0;
     rx_ring[index].addr = (uint64) newBuf->head;
     rx_mbufs[index] = newBuf;
-    regs[E1000_RDT] = index;              // nastavenie registra na posledny spracovany deskriptor
+    regs[E1000_RDT] = index;
     index = (index + 1) % RX_RING_SIZE;
   }
   release(&e1000_lock);
 
-  i = 0;
-  while (buf[i] != 0) {
-    net_rx(buf[i]);
-    i = (i + 1) % RX_RING_SIZE;
-  }
-  return;
+  while (!mbufq_empty(&done))
+    net_rx_steer(mbufq_pophead(&done));
 }
 
 void
@@ -0,0 +1,14 @@
+//
+// edge-triggered readiness notification for sockets.
+//
+
+#define EPOLLIN  0x001  // data is waiting to be read
+
+#define EPOLL_CTL_ADD 1
+#define EPOLL_CTL_DEL 2
+#define EPOLL_CTL_MOD 3
+
+struct epoll_event {
+  uint32 events;
+  uint64 data; // returned unchanged by epoll_wait()
+};
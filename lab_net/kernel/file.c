@@ -14,44 +14,127 @@
 #include "proc.h"
 
 struct devsw devsw[NDEV];
+
+// struct files come from pages carved up as needed, and are
+// never given back to kalloc(). each CPU keeps its own free
+// list; a CPU with too many spare files passes half of them
+// to ftable, and one with none takes some back, or carves a
+// new page.
+#define FCACHEMAX 64
+
 struct {
   struct spinlock lock;
-  struct file file[NFILE];
+  struct file *free;
+  int n;
 } ftable;
 
+struct fcache {
+  struct spinlock lock;
+  struct file *free;
+  int n;
+} fcache[NCPU];
+
 void
 fileinit(void)
 {
   initlock(&ftable.lock, "ftable");
+  for(int i = 0; i < NCPU; i++)
+    initlock(&fcache[i].lock, "fcache");
+}
+
+static struct fcache *
+mycache(void)
+{
+  struct fcache *c;
+
+  push_off();
+  c = &fcache[cpuid()];
+  pop_off();
+  return c;
+}
+
+// move up to n files from *from to *to.
+static int
+movefiles(struct file **from, struct file **to, int n)
+{
+  struct file *f;
+  int i;
+
+  for(i = 0; i < n && (f = *from) != 0; i++){
+    *from = f->next;
+    f->next = *to;
+    *to = f;
+  }
+  return i;
+}
+
+// give c some spare files. called with c->lock held.
+static void
+refill(struct fcache *c)
+{
+  struct file *f;
+  char *pg;
+  int m;
+
+  acquire(&ftable.lock);
+  m = movefiles(&ftable.free, &c->free, FCACHEMAX / 2);
+  ftable.n -= m;
+  c->n += m;
+  release(&ftable.lock);
+  if(m > 0 || (pg = kalloc()) == 0)
+    return;
+  for(f = (struct file*)pg; f + 1 <= (struct file*)(pg + PGSIZE); f++){
+    f->next = c->free;
+    c->free = f;
+    c->n++;
+  }
 }
 
 // Allocate a file structure.
 struct file*
 filealloc(void)
 {
+  struct fcache *c = mycache();
   struct file *f;
 
-  acquire(&ftable.lock);
-  for(f = ftable.file; f < ftable.file + NFILE; f++){
-    if(f->ref == 0){
-      f->ref = 1;
-      release(&ftable.lock);
-      return f;
-    }
+  acquire(&c->lock);
+  if(c->free == 0)
+    refill(c);
+  if((f = c->free) != 0){
+    c->free = f->next;
+    c->n--;
   }
-  release(&ftable.lock);
-  return 0;
+  release(&c->lock);
+  if(f == 0)
+    return 0;
+  memset(f, 0, sizeof(*f));
+  f->ref = 1;
+  return f;
+}
+
+static void
+filefree(struct file *f)
+{
+  struct fcache *c = mycache();
+
+  acquire(&c->lock);
+  f->next = c->free;
+  c->free = f;
+  if(++c->n > FCACHEMAX){
+    acquire(&ftable.lock);
+    ftable.n += movefiles(&c->free, &ftable.free, FCACHEMAX / 2);
+    release(&ftable.lock);
+    c->n -= FCACHEMAX / 2;
+  }
+  release(&c->lock);
 }
 
 // Increment ref count for file f.
 struct file*
 filedup(struct file *f)
 {
-  acquire(&ftable.lock);
-  if(f->ref < 1)
+  if(__atomic_fetch_add(&f->ref, 1, __ATOMIC_RELAXED) < 1)
     panic("filedup");
-  f->ref++;
-  release(&ftable.lock);
   return f;
 }
 
@@ -60,18 +143,16 @@ void
 fileclose(struct file *f)
 {
   struct file ff;
+  int ref;
 
-  acquire(&ftable.lock);
-  if(f->ref < 1)
+  ref = __atomic_sub_fetch(&f->ref, 1, __ATOMIC_ACQ_REL);
+  if(ref < 0)
     panic("fileclose");
-  if(--f->ref > 0){
-    release(&ftable.lock);
+  if(ref > 0)
     return;
-  }
   ff = *f;
-  f->ref = 0;
   f->type = FD_NONE;
-  release(&ftable.lock);
+  filefree(f);
 
   if(ff.type == FD_PIPE){
     pipeclose(ff.pipe, ff.writable);
@@ -83,10 +164,109 @@ fileclose(struct file *f)
 #ifdef LAB_NET
   else if(ff.type == FD_SOCK){
     sockclose(ff.sock);
+  } else if(ff.type == FD_EPOLL){
+    epollclose(ff.epoll);
   }
 #endif
 }
 
+// p's file for fd, or 0.
+struct file*
+fdget(struct proc *p, int fd)
+{
+  struct file **pg;
+
+  if(fd < 0 || fd >= NOFILE || (pg = p->fdt.page[fd / NFDPAGE]) == 0)
+    return 0;
+  return pg[fd % NFDPAGE];
+}
+
+// Allocate the lowest free file descriptor for f.
+// Takes over file reference from caller on success.
+int
+fdalloc(struct proc *p, struct file *f)
+{
+  struct fdtable *t = &p->fdt;
+  struct file ***pg;
+  int w, fd;
+
+  if(t->full == ~0UL)
+    return -1;
+  w = __builtin_ctzl(~t->full);
+  fd = w * 64 + __builtin_ctzl(~t->used[w]);
+  pg = &t->page[fd / NFDPAGE];
+  if(*pg == 0){
+    if((*pg = (struct file**)kalloc()) == 0)
+      return -1;
+    memset(*pg, 0, PGSIZE);
+  }
+  (*pg)[fd % NFDPAGE] = f;
+  t->used[w] |= 1UL << (fd % 64);
+  if(t->used[w] == ~0UL)
+    t->full |= 1UL << w;
+  return fd;
+}
+
+// forget fd, without closing its file.
+void
+fdclear(struct proc *p, int fd)
+{
+  struct fdtable *t = &p->fdt;
+
+  t->page[fd / NFDPAGE][fd % NFDPAGE] = 0;
+  t->used[fd / 64] &= ~(1UL << (fd % 64));
+  t->full &= ~(1UL << (fd / 64));
+}
+
+// give np a copy of p's descriptors, for fork().
+// on failure the files np took are still open in p, so
+// closing them only drops references and never sleeps.
+int
+fdcopy(struct proc *np, struct proc *p)
+{
+  struct file *f;
+
+  for(int i = 0; i < NOFILE / NFDPAGE; i++){
+    if(p->fdt.page[i] == 0)
+      continue;
+    if((np->fdt.page[i] = (struct file**)kalloc()) == 0){
+      fdcloseall(np);
+      return -1;
+    }
+    for(int j = 0; j < NFDPAGE; j++){
+      if((f = p->fdt.page[i][j]) != 0)
+        filedup(f);
+      np->fdt.page[i][j] = f;
+    }
+  }
+  memmove(np->fdt.used, p->fdt.used, sizeof(p->fdt.used));
+  np->fdt.full = p->fdt.full;
+  return 0;
+}
+
+// close all of p's files, and free its table.
+void
+fdcloseall(struct proc *p)
+{
+  struct fdtable *t = &p->fdt;
+  struct file *f;
+
+  for(int i = 0; i < NOFILE / NFDPAGE; i++){
+    if(t->page[i] == 0)
+      continue;
+    for(int j = 0; j < NFDPAGE; j++){
+      if((f = t->page[i][j]) != 0){
+        t->page[i][j] = 0;
+        fileclose(f);
+      }
+    }
+    kfree(t->page[i]);
+    t->page[i] = 0;
+  }
+  memset(t->used, 0, sizeof(t->used));
+  t->full = 0;
+}
+
 // Get metadata about file f.
 // addr is a user virtual address, pointing to a struct stat.
 int
@@ -130,7 +310,7 @@ fileread(struct file *f, uint64 addr, int n)
   }
 #ifdef LAB_NET
   else if(f->type == FD_SOCK){
-    r = sockread(f->sock, addr, n);
+    r = sockread(f->sock, f->nonblock, addr, n, 0, 0);
   }
 #endif
   else {
@@ -187,7 +367,7 @@ filewrite(struct file *f, uint64 addr, int n)
   }
 #ifdef LAB_NET
   else if(f->type == FD_SOCK){
-    ret = sockwrite(f->sock, addr, n);
+    ret = sockwrite(f->sock, addr, n, 0, 0);
   }
 #endif
   else {
@@ -1,19 +1,22 @@
 struct file {
 #ifdef LAB_NET
-  enum { FD_NONE, FD_PIPE, FD_INODE, FD_DEVICE, FD_SOCK } type;
+  enum { FD_NONE, FD_PIPE, FD_INODE, FD_DEVICE, FD_SOCK, FD_EPOLL } type;
 #else
   enum { FD_NONE, FD_PIPE, FD_INODE, FD_DEVICE } type;
 #endif
-  int ref; // reference count
+  int ref; // reference count, updated atomically
   char readable;
   char writable;
+  char nonblock;     // O_NONBLOCK
   struct pipe *pipe; // FD_PIPE
   struct inode *ip;  // FD_INODE and FD_DEVICE
 #ifdef LAB_NET
   struct sock *sock; // FD_SOCK
+  struct epoll *epoll; // FD_EPOLL
 #endif
   uint off;          // FD_INODE
   short major;       // FD_DEVICE
+  struct file *next; // on a free list
 };
 
 #define major(dev)  ((dev) >> 16 & 0xFFFF)
@@ -46,3 +49,4 @@ extern struct devsw devsw[];
 
 #define CONSOLE 1
 #define STATS   2
+#define PCAP    3
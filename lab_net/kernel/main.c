@@ -32,10 +32,15 @@ main()
     fileinit();      // file table
     virtio_disk_init(); // emulated hard disk
 #ifdef LAB_NET
+    netinit();
     pci_init();
     sockinit();
+    pcapinit();
 #endif    
     userinit();      // first user process
+#ifdef LAB_NET
+    netrxinithart(); // this hart's network receive thread
+#endif
 #ifdef KCSAN
     kcsaninit();
 #endif
@@ -49,6 +54,9 @@ main()
     kvminithart();    // turn on paging
     trapinithart();   // install kernel trap vector
     plicinithart();   // ask PLIC for device interrupts
+#ifdef LAB_NET
+    netrxinithart();
+#endif
   }
 
   scheduler();        
@@ -15,6 +15,32 @@ static uint32 local_ip = MAKE_IP_ADDR(10, 0, 2, 15); // qemu's idea of the guest
 static uint8 local_mac[ETHADDR_LEN] = { 0x52, 0x54, 0x00, 0x12, 0x34, 0x56 };
 static uint8 broadcast_mac[ETHADDR_LEN] = { 0xFF, 0XFF, 0XFF, 0XFF, 0XFF, 0XFF };
 
+static void net_rx_ip(struct mbuf *m);
+
+// 127.0.0.0/8
+#define IS_LOOPBACK(ip) (((ip) >> 24) == 127)
+
+// mbuf headers live in a fixed pool so that each buffer can
+// have a whole page of backing store.
+static struct {
+  struct spinlock lock;
+  struct mbuf *free;
+  struct mbuf mbuf[NMBUF];
+} mpool;
+
+static struct spinlock netrxlock;
+
+void
+netinit(void)
+{
+  initlock(&netrxlock, "netrx");
+  initlock(&mpool.lock, "mbuf");
+  for(int i = 0; i < NMBUF; i++){
+    mpool.mbuf[i].next = mpool.free;
+    mpool.free = &mpool.mbuf[i];
+  }
+}
+
 // Strips data from the start of the buffer and returns a pointer to it.
 // Returns 0 if less than the full requested length is available.
 char *
@@ -45,7 +71,7 @@ mbufput(struct mbuf *m, unsigned int len)
 {
   char *tmp = m->head + m->len;
   m->len += len;
-  if (m->len > MBUF_SIZE)
+  if (m->head + m->len > m->buf + MBUF_SIZE)
     panic("mbufput");
   return tmp;
 }
@@ -66,24 +92,54 @@ struct mbuf *
 mbufalloc(unsigned int headroom)
 {
   struct mbuf *m;
+  char *buf;
  
   if (headroom > MBUF_SIZE)
     return 0;
-  m = kalloc();
-  if (m == 0)
+  if ((buf = kalloc()) == 0)
     return 0;
+  acquire(&mpool.lock);
+  m = mpool.free;
+  if (m)
+    mpool.free = m->next;
+  release(&mpool.lock);
+  if (m == 0) {
+    kfree(buf);
+    return 0;
+  }
   m->next = 0;
-  m->head = (char *)m->buf + headroom;
+  m->more = 0;
+  m->buf = buf;
+  m->head = buf + headroom;
   m->len = 0;
-  memset(m->buf, 0, sizeof(m->buf));
   return m;
 }
 
-// Frees a packet buffer.
+// Frees a packet buffer, along with the rest of its packet.
 void
 mbuffree(struct mbuf *m)
 {
-  kfree(m);
+  struct mbuf *more;
+
+  for (; m; m = more) {
+    more = m->more;
+    kfree(m->buf);
+    acquire(&mpool.lock);
+    m->next = mpool.free;
+    mpool.free = m;
+    release(&mpool.lock);
+  }
+}
+
+// Returns the length of the whole packet that starts at m.
+unsigned int
+mbufpktlen(struct mbuf *m)
+{
+  unsigned int len = 0;
+
+  for (; m; m = m->more)
+    len += m->len;
+  return len;
 }
 
 // Pushes an mbuf to the end of the queue.
@@ -124,6 +180,20 @@ mbufq_init(struct mbufq *q)
   q->head = 0;
 }
 
+// Trims a packet to its first len bytes, freeing any buffers
+// that are no longer needed. len must not exceed mbufpktlen(m).
+static void
+mbufpkttrim(struct mbuf *m, unsigned int len)
+{
+  while (len > m->len) {
+    len -= m->len;
+    m = m->more;
+  }
+  m->len = len;
+  mbuffree(m->more);
+  m->more = 0;
+}
+
 // This code is lifted from FreeBSD's ping.c, and is copyright by the Regents
 // of the University of California.
 static unsigned short
@@ -172,6 +242,7 @@ net_tx_eth(struct mbuf *m, uint16 ethtype)
   // to broadcast instead.
   memmove(ethhdr->dhost, broadcast_mac, ETHADDR_LEN);
   ethhdr->type = htons(ethtype);
+  pcap_tap(m);
   if (e1000_transmit(m)) {
     mbuffree(m);
   }
@@ -188,12 +259,18 @@ net_tx_ip(struct mbuf *m, uint8 proto, uint32 dip)
   memset(iphdr, 0, sizeof(*iphdr));
   iphdr->ip_vhl = (4 << 4) | (20 >> 2);
   iphdr->ip_p = proto;
-  iphdr->ip_src = htonl(local_ip);
+  iphdr->ip_src = htonl(IS_LOOPBACK(dip) ? dip : local_ip);
   iphdr->ip_dst = htonl(dip);
-  iphdr->ip_len = htons(m->len);
+  iphdr->ip_len = htons(mbufpktlen(m));
   iphdr->ip_ttl = 100;
   iphdr->ip_sum = in_cksum((unsigned char *)iphdr, sizeof(*iphdr));
 
+  // packets to ourselves never reach the wire
+  if (dip == local_ip || IS_LOOPBACK(dip)) {
+    net_rx_ip(m);
+    return;
+  }
+
   // now on to the ethernet layer
   net_tx_eth(m, ETHTYPE_IP);
 }
@@ -209,7 +286,7 @@ net_tx_udp(struct mbuf *m, uint32 dip,
   udphdr = mbufpushhdr(m, *udphdr);
   udphdr->sport = htons(sport);
   udphdr->dport = htons(dport);
-  udphdr->ulen = htons(m->len);
+  udphdr->ulen = htons(mbufpktlen(m));
   udphdr->sum = 0; // zero means no checksum is provided
 
   // now on to the IP layer
@@ -300,10 +377,10 @@ net_rx_udp(struct mbuf *m, uint16 len, struct ip *iphdr)
   if (ntohs(udphdr->ulen) != len)
     goto fail;
   len -= sizeof(*udphdr);
-  if (len > m->len)
+  if (len > mbufpktlen(m))
     goto fail;
   // minimum packet size could be larger than the payload
-  mbuftrim(m, m->len - len);
+  mbufpkttrim(m, len);
 
   // parse the necessary fields
   sip = ntohl(iphdr->ip_src);
@@ -337,11 +414,14 @@ net_rx_ip(struct mbuf *m)
   if (htons(iphdr->ip_off) != 0)
     goto fail;
   // is the packet addressed to us?
-  if (htonl(iphdr->ip_dst) != local_ip)
+  if (ntohl(iphdr->ip_dst) != local_ip && !IS_LOOPBACK(ntohl(iphdr->ip_dst)))
     goto fail;
   // can only support UDP
   if (iphdr->ip_p != IPPROTO_UDP)
     goto fail;
+  // is the packet larger than our MTU, or than its own header?
+  if (ntohs(iphdr->ip_len) > NET_MTU || ntohs(iphdr->ip_len) < sizeof(*iphdr))
+    goto fail;
 
   len = ntohs(iphdr->ip_len) - sizeof(*iphdr);
   net_rx_udp(m, len, iphdr);
@@ -358,6 +438,7 @@ void net_rx(struct mbuf *m)
   struct eth *ethhdr;
   uint16 type;
 
+  pcap_tap(m);
   ethhdr = mbufpullhdr(m, *ethhdr);
   if (!ethhdr) {
     mbuffree(m);
@@ -372,3 +453,109 @@ void net_rx(struct mbuf *m)
   else
     mbuffree(m);
 }
+
+//
+// receive steering. e1000_intr() hashes each packet's flow onto
+// one of several backlog queues, one per hart, each drained by
+// its own kernel thread that runs net_rx(). packets of one flow
+// stay in order, while different flows are processed in parallel
+// by whichever harts are idle.
+//
+
+struct netrxq {
+  struct spinlock lock;
+  struct mbufq q;
+};
+
+static struct netrxq netrxq[NCPU];
+static int nnetrxq; // queues with a running thread, set under netrxlock
+
+static void
+netrxthread(void *arg)
+{
+  struct netrxq *rq = arg;
+  struct mbufq batch;
+
+  for(;;){
+    acquire(&rq->lock);
+    while(mbufq_empty(&rq->q))
+      sleep(rq, &rq->lock);
+    batch = rq->q;
+    mbufq_init(&rq->q);
+    release(&rq->lock);
+
+    while(!mbufq_empty(&batch))
+      net_rx(mbufq_pophead(&batch));
+  }
+}
+
+// start this hart's receive thread.
+void
+netrxinithart(void)
+{
+  static char names[NCPU][8];
+  struct netrxq *rq;
+  int i;
+
+  // harts start in any order; queue i is only used by
+  // net_rx_steer() once nnetrxq > i.
+  acquire(&netrxlock);
+  i = nnetrxq;
+  rq = &netrxq[i];
+  initlock(&rq->lock, "netrxq");
+  mbufq_init(&rq->q);
+  safestrcpy(names[i], "netrx0", sizeof(names[i]));
+  names[i][5] += i;
+  if(kthread(netrxthread, rq, names[i]) < 0)
+    panic("netrxinithart");
+  __sync_synchronize();
+  nnetrxq = i + 1;
+  release(&netrxlock);
+}
+
+// hash the UDP flow (or the IP source, for other protocols)
+// of an Ethernet frame. non-IP frames all hash to 0.
+static uint
+net_flowhash(struct mbuf *m)
+{
+  struct eth *eth = (struct eth *)m->head;
+  struct ip *ip = (struct ip *)(eth + 1);
+  struct udp *udp = (struct udp *)(ip + 1);
+  uint h;
+
+  if(m->len < sizeof(*eth) + sizeof(*ip) || ntohs(eth->type) != ETHTYPE_IP)
+    return 0;
+  h = ip->ip_src;
+  if(ip->ip_p == IPPROTO_UDP && m->len >= sizeof(*eth) + sizeof(*ip) + sizeof(*udp))
+    h ^= ((uint)udp->sport << 16) | udp->dport;
+  h ^= h >> 16;
+  h *= 0x45d9f3b;
+  h ^= h >> 16;
+  return h;
+}
+
+// called by the e1000 driver's interrupt handler to hand a
+// packet to the receive thread for its flow.
+void
+net_rx_steer(struct mbuf *m)
+{
+  struct netrxq *rq;
+  int n, wasempty;
+
+  n = nnetrxq;
+  __sync_synchronize();
+  if(n == 0){
+    net_rx(m);
+    return;
+  }
+
+  rq = &netrxq[net_flowhash(m) % n];
+  acquire(&rq->lock);
+  wasempty = mbufq_empty(&rq->q);
+  mbufq_pushtail(&rq->q, m);
+  // the thread takes the whole queue at once, so it only needs
+  // waking when the queue was empty.
+  if(wasempty)
+    wakeup(rq);
+  release(&rq->lock);
+}
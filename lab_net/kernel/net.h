@@ -2,14 +2,20 @@
 // packet buffer management
 //
 
-#define MBUF_SIZE              2048
+#define MBUF_SIZE              4096 // one page, the largest rx buffer a page can back
 #define MBUF_DEFAULT_HEADROOM  128
+#define NMBUF                  512  // mbuf headers in the pool
 
+// a packet larger than one buffer is a chain of mbufs linked
+// through more; only the first holds the protocol headers.
 struct mbuf {
-  struct mbuf  *next; // the next mbuf in the chain
+  struct mbuf  *next; // the next mbuf in the queue
+  struct mbuf  *more; // the next buffer of the same packet
   char         *head; // the current start position of the buffer
-  unsigned int len;   // the length of the buffer
-  char         buf[MBUF_SIZE]; // the backing store
+  unsigned int len;   // the length of this buffer
+  char         *buf;  // the backing store, a page of MBUF_SIZE bytes
+  uint32       raddr; // received datagrams: the sender's IPv4 address
+  uint16       rport; // ... and UDP port
 };
 
 char *mbufpull(struct mbuf *m, unsigned int len);
@@ -32,6 +38,7 @@ char *mbuftrim(struct mbuf *m, unsigned int len);
 
 struct mbuf *mbufalloc(unsigned int headroom);
 void mbuffree(struct mbuf *m);
+unsigned int mbufpktlen(struct mbuf *m);
 
 struct mbufq {
   struct mbuf *head;  // the first element in the queue
@@ -103,6 +110,12 @@ struct ip {
 #define IPPROTO_TCP  6  // Transmission control protocol
 #define IPPROTO_UDP  17 // User datagram protocol
 
+// the largest IP packet, header included, that the stack sends or
+// accepts. build with MTU=9000 to use jumbo frames.
+#ifndef NET_MTU
+#define NET_MTU 1500
+#endif
+
 #define MAKE_IP_ADDR(a, b, c, d)           \
   (((uint32)a << 24) | ((uint32)b << 16) | \
    ((uint32)c << 8) | (uint32)d)
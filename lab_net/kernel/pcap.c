@@ -0,0 +1,283 @@
+//
+// in-kernel packet capture.
+//
+// net_rx() and net_tx_eth() hand every frame to pcap_tap(), which
+// returns at once unless a capture is active. Frames that pass the
+// filter are copied into a ring of fixed-size slots. A tap claims a
+// slot with an atomic increment and publishes it by storing the
+// slot's sequence number, so taps on different harts never share
+// a lock. If the reader falls a whole ring behind, the oldest
+// frames are overwritten and counted as drops.
+//
+// The reader sees a libpcap stream on the pcap device, and starts
+// or stops a capture by writing a struct pcapctl to it.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "proc.h"
+#include "defs.h"
+#include "net.h"
+#include "pcap.h"
+
+// qemu's virt machine runs the time CSR at 10 MHz.
+#define TIMEBASE_HZ 10000000
+
+struct pcapslot {
+  uint64 seq;             // 1 + ring index once published, 0 while written
+  struct pcap_rec rec;
+  char data[PCAP_SNAPLEN];
+};
+
+static struct {
+  struct spinlock lock;   // protects the reader's state below
+  volatile int active;
+  int ntap;               // taps between checking active and publishing
+  struct pcapctl ctl;     // filter; taps read it only while counted in ntap
+  uint64 widx;            // next slot to claim, bumped atomically
+  struct pcapslot slot[PCAP_NSLOT];
+
+  // reader
+  uint64 ridx;            // next slot to read
+  int waiting;            // a reader is (about to be) asleep
+  uint64 drops;
+  char out[sizeof(struct pcap_hdr) + sizeof(struct pcap_rec) + PCAP_SNAPLEN];
+  int outlen;             // bytes staged in out[]
+  int outoff;             // bytes of out[] already returned
+} pcap;
+
+// does the frame at buf match the capture filter?
+static int
+pcap_match(char *buf, uint len)
+{
+  struct eth *eth;
+  struct ip *ip;
+  struct udp *udp;
+  uint32 src, dst;
+
+  if(len < sizeof(*eth))
+    return 0;
+  eth = (struct eth *)buf;
+  if(pcap.ctl.ethtype && ntohs(eth->type) != pcap.ctl.ethtype)
+    return 0;
+  if(!pcap.ctl.proto && !pcap.ctl.ip && !pcap.ctl.port)
+    return 1;
+
+  if(ntohs(eth->type) != ETHTYPE_IP || len < sizeof(*eth) + sizeof(*ip))
+    return 0;
+  ip = (struct ip *)(eth + 1);
+  if(pcap.ctl.proto && ip->ip_p != pcap.ctl.proto)
+    return 0;
+  src = ntohl(ip->ip_src);
+  dst = ntohl(ip->ip_dst);
+  if(pcap.ctl.ip && src != pcap.ctl.ip && dst != pcap.ctl.ip)
+    return 0;
+  if(!pcap.ctl.port)
+    return 1;
+
+  if(ip->ip_p != IPPROTO_UDP ||
+     len < sizeof(*eth) + sizeof(*ip) + sizeof(*udp))
+    return 0;
+  udp = (struct udp *)(ip + 1);
+  return ntohs(udp->sport) == pcap.ctl.port || ntohs(udp->dport) == pcap.ctl.port;
+}
+
+// called for every frame received or sent; m->head points at
+// the Ethernet header. only the first buffer of a chained
+// jumbo frame is saved.
+void
+pcap_tap(struct mbuf *m)
+{
+  struct pcapslot *s;
+  uint64 seq, t;
+  uint n;
+
+  if(!pcap.active)
+    return;
+  // count this tap before looking at ctl; pcapwrite() clears
+  // active and then waits for ntap to drain before changing it.
+  // taps also run in preemptible threads, so keep interrupts
+  // off while counted: a counted tap is never descheduled, and
+  // pcapwrite() can't be spinning on its own hart.
+  push_off();
+  __atomic_add_fetch(&pcap.ntap, 1, __ATOMIC_SEQ_CST);
+  if(!pcap.active || !pcap_match(m->head, m->len)){
+    __atomic_sub_fetch(&pcap.ntap, 1, __ATOMIC_SEQ_CST);
+    pop_off();
+    return;
+  }
+
+  seq = __sync_fetch_and_add(&pcap.widx, 1);
+  s = &pcap.slot[seq % PCAP_NSLOT];
+  s->seq = 0;
+  __sync_synchronize();
+
+  n = m->len;
+  if(n > pcap.ctl.snaplen)
+    n = pcap.ctl.snaplen;
+  t = r_time();
+  s->rec.ts_sec = t / TIMEBASE_HZ;
+  s->rec.ts_usec = (t % TIMEBASE_HZ) / (TIMEBASE_HZ / 1000000);
+  s->rec.incl_len = n;
+  s->rec.orig_len = mbufpktlen(m);
+  memmove(s->data, m->head, n);
+
+  __sync_synchronize();
+  s->seq = seq + 1;
+  __atomic_sub_fetch(&pcap.ntap, 1, __ATOMIC_SEQ_CST);
+  pop_off();
+
+  // pcapread() sets waiting while holding pcap.lock, and sleep()
+  // only drops the lock once the reader is asleep.
+  if(pcap.waiting){
+    acquire(&pcap.lock);
+    wakeup(&pcap.ridx);
+    release(&pcap.lock);
+  }
+}
+
+// copy the next published frame into pcap.out.
+// returns 0 if the ring holds nothing new.
+// caller holds pcap.lock.
+static int
+pcap_next(void)
+{
+  struct pcapslot *s;
+  uint64 widx;
+  int n;
+
+  widx = pcap.widx;
+  if(widx - pcap.ridx > PCAP_NSLOT){
+    // lapped by the taps; skip to the oldest slot still intact.
+    pcap.drops += widx - pcap.ridx - PCAP_NSLOT;
+    pcap.ridx = widx - PCAP_NSLOT;
+  }
+
+  while(pcap.ridx != widx){
+    s = &pcap.slot[pcap.ridx % PCAP_NSLOT];
+    if(s->seq != pcap.ridx + 1)
+      return 0; // claimed but not yet published
+    __sync_synchronize();
+    n = s->rec.incl_len;
+    memmove(pcap.out, &s->rec, sizeof(s->rec));
+    memmove(pcap.out + sizeof(s->rec), s->data, n);
+    __sync_synchronize();
+    if(s->seq == pcap.ridx + 1){
+      pcap.ridx++;
+      pcap.outlen = sizeof(s->rec) + n;
+      pcap.outoff = 0;
+      return 1;
+    }
+    // overwritten while we copied it.
+    pcap.drops++;
+    pcap.ridx++;
+  }
+  return 0;
+}
+
+// returns whole records while any are buffered, blocks until
+// at least one arrives, and returns 0 (end of file) once the
+// capture has been stopped and drained.
+int
+pcapread(int user_dst, uint64 dst, int n)
+{
+  int tot, m;
+
+  acquire(&pcap.lock);
+  tot = 0;
+  while(tot < n){
+    if(pcap.outoff == pcap.outlen && !pcap_next()){
+      if(tot > 0 || !pcap.active)
+        break;
+      pcap.waiting = 1;
+      __sync_synchronize();
+      if(!pcap_next()){
+        if(killed(myproc())){
+          pcap.waiting = 0;
+          release(&pcap.lock);
+          return -1;
+        }
+        sleep(&pcap.ridx, &pcap.lock);
+        pcap.waiting = 0;
+        continue;
+      }
+      pcap.waiting = 0;
+    }
+    m = pcap.outlen - pcap.outoff;
+    if(m > n - tot)
+      m = n - tot;
+    if(either_copyout(user_dst, dst + tot, pcap.out + pcap.outoff, m) == -1)
+      break;
+    pcap.outoff += m;
+    tot += m;
+  }
+  release(&pcap.lock);
+  return tot;
+}
+
+// write a struct pcapctl to start or stop a capture.
+int
+pcapwrite(int user_src, uint64 src, int n)
+{
+  struct pcapctl ctl;
+  struct pcap_hdr *h;
+
+  if(n != sizeof(ctl))
+    return -1;
+  if(either_copyin(&ctl, user_src, src, sizeof(ctl)) == -1)
+    return -1;
+
+  acquire(&pcap.lock);
+  if(!ctl.enable){
+    pcap.active = 0;
+    if(pcap.drops)
+      printf("pcap: %d frames dropped\n", (int)pcap.drops);
+    wakeup(&pcap.ridx);
+    release(&pcap.lock);
+    return n;
+  }
+
+  // stop the taps, and wait for those already past the check
+  // to publish, before the filter changes. a counted tap runs
+  // with interrupts off and never takes pcap.lock, so it is on
+  // another hart and finishes without waiting for us.
+  pcap.active = 0;
+  __sync_synchronize();
+  while(__atomic_load_n(&pcap.ntap, __ATOMIC_SEQ_CST) != 0)
+    ;
+  if(ctl.snaplen == 0 || ctl.snaplen > PCAP_SNAPLEN)
+    ctl.snaplen = PCAP_SNAPLEN;
+  pcap.ctl = ctl;
+  pcap.ridx = pcap.widx;
+  pcap.drops = 0;
+
+  // the stream starts with the file header.
+  h = (struct pcap_hdr *)pcap.out;
+  memset(h, 0, sizeof(*h));
+  h->magic = PCAP_MAGIC;
+  h->version_major = 2;
+  h->version_minor = 4;
+  h->snaplen = ctl.snaplen;
+  h->network = PCAP_LINKTYPE;
+  pcap.outlen = sizeof(*h);
+  pcap.outoff = 0;
+
+  __sync_synchronize();
+  pcap.active = 1;
+  release(&pcap.lock);
+  return n;
+}
+
+void
+pcapinit(void)
+{
+  initlock(&pcap.lock, "pcap");
+  devsw[PCAP].read = pcapread;
+  devsw[PCAP].write = pcapwrite;
+}
@@ -0,0 +1,40 @@
+//
+// in-kernel packet capture, read from the "pcap" device.
+//
+
+#define PCAP_NSLOT   32    // captured frames buffered in the ring
+#define PCAP_SNAPLEN 1536  // max bytes saved per frame
+
+// write one of these to the pcap device to start (enable != 0)
+// or stop (enable == 0) a capture. zero fields match anything.
+struct pcapctl {
+  uint32 enable;
+  uint32 snaplen; // bytes saved per frame, at most PCAP_SNAPLEN
+  uint32 ip;      // IPv4 source or destination, host byte order
+  uint16 ethtype; // e.g. ETHTYPE_IP
+  uint16 port;    // UDP source or destination port
+  uint8  proto;   // e.g. IPPROTO_UDP
+};
+
+// a read of the pcap device returns a standard libpcap stream:
+// one pcap_hdr when the capture starts, then a pcap_rec followed
+// by incl_len bytes for each captured frame.
+#define PCAP_MAGIC    0xa1b2c3d4
+#define PCAP_LINKTYPE 1 // Ethernet
+
+struct pcap_hdr {
+  uint32 magic;
+  uint16 version_major;
+  uint16 version_minor;
+  uint32 thiszone;
+  uint32 sigfigs;
+  uint32 snaplen;
+  uint32 network;
+};
+
+struct pcap_rec {
+  uint32 ts_sec;
+  uint32 ts_usec;
+  uint32 incl_len;
+  uint32 orig_len;
+};
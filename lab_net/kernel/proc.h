@@ -82,6 +82,18 @@ struct trapframe {
 enum procstate { UNUSED, USED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
 // Per-process state
+// a process's open files. fd's file is at page[fd / NFDPAGE]
+// [fd % NFDPAGE]; the pages are allocated as fds need them.
+// used[] has a bit set for each fd in use, and full a bit
+// set for each word of used[] with no clear bits, so finding
+// the lowest free fd takes two count-trailing-zeros.
+#define NFDPAGE 512   // file pointers per page
+struct fdtable {
+  struct file **page[NOFILE / NFDPAGE];
+  uint64 used[NOFILE / 64];
+  uint64 full;
+};
+
 struct proc {
   struct spinlock lock;
 
@@ -101,7 +113,9 @@ struct proc {
   pagetable_t pagetable;       // User page table
   struct trapframe *trapframe; // data page for trampoline.S
   struct context context;      // swtch() here to run process
-  struct file *ofile[NOFILE];  // Open files
+  struct fdtable fdt;          // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
+  void (*kfn)(void*);          // Kernel thread function, see kthread()
+  void *karg;                  // ... and its argument
 };
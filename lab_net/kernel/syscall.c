@@ -104,6 +104,12 @@ extern uint64 sys_close(void);
 
 #ifdef LAB_NET
 extern uint64 sys_connect(void);
+extern uint64 sys_fcntl(void);
+extern uint64 sys_epoll_create(void);
+extern uint64 sys_epoll_ctl(void);
+extern uint64 sys_epoll_wait(void);
+extern uint64 sys_sendto(void);
+extern uint64 sys_recvfrom(void);
 #endif
 #ifdef LAB_PGTBL
 extern uint64 sys_pgaccess(void);
@@ -135,6 +141,12 @@ static uint64 (*syscalls[])(void) = {
 [SYS_close]   sys_close,
 #ifdef LAB_NET
 [SYS_connect] sys_connect,
+[SYS_fcntl]   sys_fcntl,
+[SYS_epoll_create] sys_epoll_create,
+[SYS_epoll_ctl] sys_epoll_ctl,
+[SYS_epoll_wait] sys_epoll_wait,
+[SYS_sendto]  sys_sendto,
+[SYS_recvfrom] sys_recvfrom,
 #endif
 #ifdef LAB_PGTBL
 [SYS_pgaccess] sys_pgaccess,
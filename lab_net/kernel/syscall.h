@@ -31,3 +31,9 @@
 #define SYS_munmap    28
 #define SYS_connect   29
 #define SYS_pgaccess  30
+#define SYS_fcntl     31
+#define SYS_epoll_create 32
+#define SYS_epoll_ctl 33
+#define SYS_epoll_wait 34
+#define SYS_sendto    35
+#define SYS_recvfrom  36
@@ -15,6 +15,9 @@
 #include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
+#ifdef LAB_NET
+#include "epoll.h"
+#endif
 
 // Fetch the nth word-sized system call argument as a file descriptor
 // and return both the descriptor and the corresponding struct file.
@@ -25,7 +28,7 @@ argfd(int n, int *pfd, struct file **pf)
   struct file *f;
 
   argint(n, &fd);
-  if(fd < 0 || fd >= NOFILE || (f=myproc()->ofile[fd]) == 0)
+  if((f=fdget(myproc(), fd)) == 0)
     return -1;
   if(pfd)
     *pfd = fd;
@@ -34,23 +37,6 @@ argfd(int n, int *pfd, struct file **pf)
   return 0;
 }
 
-// Allocate a file descriptor for the given file.
-// Takes over file reference from caller on success.
-static int
-fdalloc(struct file *f)
-{
-  int fd;
-  struct proc *p = myproc();
-
-  for(fd = 0; fd < NOFILE; fd++){
-    if(p->ofile[fd] == 0){
-      p->ofile[fd] = f;
-      return fd;
-    }
-  }
-  return -1;
-}
-
 uint64
 sys_dup(void)
 {
@@ -59,7 +45,7 @@ sys_dup(void)
 
   if(argfd(0, 0, &f) < 0)
     return -1;
-  if((fd=fdalloc(f)) < 0)
+  if((fd=fdalloc(myproc(), f)) < 0)
     return -1;
   filedup(f);
   return fd;
@@ -102,7 +88,7 @@ sys_close(void)
 
   if(argfd(0, &fd, &f) < 0)
     return -1;
-  myproc()->ofile[fd] = 0;
+  fdclear(myproc(), fd);
   fileclose(f);
   return 0;
 }
@@ -341,7 +327,7 @@ sys_open(void)
     return -1;
   }
 
-  if((f = filealloc()) == 0 || (fd = fdalloc(f)) < 0){
+  if((f = filealloc()) == 0 || (fd = fdalloc(myproc(), f)) < 0){
     if(f)
       fileclose(f);
     iunlockput(ip);
@@ -486,17 +472,17 @@ sys_pipe(void)
   if(pipealloc(&rf, &wf) < 0)
     return -1;
   fd0 = -1;
-  if((fd0 = fdalloc(rf)) < 0 || (fd1 = fdalloc(wf)) < 0){
+  if((fd0 = fdalloc(p, rf)) < 0 || (fd1 = fdalloc(p, wf)) < 0){
     if(fd0 >= 0)
-      p->ofile[fd0] = 0;
+      fdclear(p, fd0);
     fileclose(rf);
     fileclose(wf);
     return -1;
   }
   if(copyout(p->pagetable, fdarray, (char*)&fd0, sizeof(fd0)) < 0 ||
      copyout(p->pagetable, fdarray+sizeof(fd0), (char *)&fd1, sizeof(fd1)) < 0){
-    p->ofile[fd0] = 0;
-    p->ofile[fd1] = 0;
+    fdclear(p, fd0);
+    fdclear(p, fd1);
     fileclose(rf);
     fileclose(wf);
     return -1;
@@ -521,11 +507,131 @@ sys_connect(void)
 
   if(sockalloc(&f, raddr, lport, rport) < 0)
     return -1;
-  if((fd=fdalloc(f)) < 0){
+  if((fd=fdalloc(myproc(), f)) < 0){
     fileclose(f);
     return -1;
   }
 
   return fd;
 }
+
+uint64
+sys_sendto(void)
+{
+  struct file *f;
+  uint64 p;
+  int n;
+  uint32 raddr;
+  uint32 rport;
+
+  if(argfd(0, 0, &f) < 0 || f->type != FD_SOCK)
+    return -1;
+  argaddr(1, &p);
+  argint(2, &n);
+  argint(3, (int*)&raddr);
+  argint(4, (int*)&rport);
+  if(raddr == 0)
+    return -1;
+  return sockwrite(f->sock, p, n, raddr, rport);
+}
+
+uint64
+sys_recvfrom(void)
+{
+  struct proc *p = myproc();
+  struct file *f;
+  uint64 buf, raddrp, rportp;
+  uint32 raddr;
+  uint16 rport;
+  int n, r;
+
+  if(argfd(0, 0, &f) < 0 || f->type != FD_SOCK)
+    return -1;
+  argaddr(1, &buf);
+  argint(2, &n);
+  argaddr(3, &raddrp);
+  argaddr(4, &rportp);
+  if((r = sockread(f->sock, f->nonblock, buf, n, &raddr, &rport)) < 0)
+    return r;
+  if(raddrp && copyout(p->pagetable, raddrp, (char*)&raddr, sizeof(raddr)) < 0)
+    return -1;
+  if(rportp && copyout(p->pagetable, rportp, (char*)&rport, sizeof(rport)) < 0)
+    return -1;
+  return r;
+}
+
+uint64
+sys_fcntl(void)
+{
+  struct file *f;
+  int cmd, arg;
+
+  if(argfd(0, 0, &f) < 0)
+    return -1;
+  argint(1, &cmd);
+  argint(2, &arg);
+
+  switch(cmd){
+  case F_GETFL:
+    return f->nonblock ? O_NONBLOCK : 0;
+  case F_SETFL:
+    f->nonblock = (arg & O_NONBLOCK) != 0;
+    return 0;
+  }
+  return -1;
+}
+
+uint64
+sys_epoll_create(void)
+{
+  struct file *f;
+  int fd;
+
+  if(epollalloc(&f) < 0)
+    return -1;
+  if((fd=fdalloc(myproc(), f)) < 0){
+    fileclose(f);
+    return -1;
+  }
+  return fd;
+}
+
+uint64
+sys_epoll_ctl(void)
+{
+  struct file *ef, *f;
+  struct epoll_event ev;
+  uint64 evaddr;
+  int op;
+
+  if(argfd(0, 0, &ef) < 0 || ef->type != FD_EPOLL)
+    return -1;
+  argint(1, &op);
+  if(argfd(2, 0, &f) < 0)
+    return -1;
+  argaddr(3, &evaddr);
+
+  ev.data = 0;
+  if(op != EPOLL_CTL_DEL &&
+     copyin(myproc()->pagetable, (char*)&ev, evaddr, sizeof(ev)) < 0)
+    return -1;
+  return epollctl(ef->epoll, op, f, ev.data);
+}
+
+uint64
+sys_epoll_wait(void)
+{
+  struct file *f;
+  uint64 evaddr;
+  int max, timeout;
+
+  if(argfd(0, 0, &f) < 0 || f->type != FD_EPOLL)
+    return -1;
+  argaddr(1, &evaddr);
+  argint(2, &max);
+  argint(3, &timeout);
+  if(max <= 0)
+    return -1;
+  return epollwait(f->epoll, evaddr, max, timeout);
+}
 #endif
@@ -13,7 +13,12 @@
 #include "sleeplock.h"
 #include "file.h"
 #include "net.h"
+#include "fcntl.h"
+#include "epoll.h"
 
+// a socket connected with raddr and rport both 0 is bound to lport
+// only: it receives datagrams from any sender that no connected
+// socket claims, and needs sendto() to transmit.
 struct sock {
   struct sock *next; // the next socket in the list
   uint32 raddr;      // the remote IPv4 address
@@ -21,8 +26,29 @@ struct sock {
   uint16 rport;      // the remote UDP port number
   struct spinlock lock; // protects the rxq
   struct mbufq rxq;  // a queue of packets waiting to be received
+
+  // epoll registration, protected by the socket table lock
+  struct epoll *ep;  // the epoll instance watching this socket, if any
+  struct sock *epnext; // the next socket watched by ep
+
+  // protected by ep->lock
+  uint64 epdata;       // returned by epoll_wait()
+  struct sock *rdnext; // the next socket on ep's ready list
+  int rdlisted;        // on ep's ready list?
 };
 
+// an epoll instance. a socket can be watched by at most one.
+// readiness is edge-triggered: a socket is put on the ready list
+// when a packet is queued on it, and taken off by epoll_wait().
+struct epoll {
+  struct spinlock lock; // protects the ready list
+  struct sock *rdhead;
+  struct sock *rdtail;
+  struct sock *watched; // protected by the socket table lock
+};
+
+// the socket table lock; also protects epoll registrations.
+// lock order: lock, then sock lock, then epoll lock.
 static struct spinlock lock;
 static struct sock *sockets;
 
@@ -50,6 +76,10 @@ sockalloc(struct file **f, uint32 raddr, uint16 lport, uint16 rport)
   si->rport = rport;
   initlock(&si->lock, "sock");
   mbufq_init(&si->rxq);
+  si->ep = 0;
+  si->epnext = 0;
+  si->rdnext = 0;
+  si->rdlisted = 0;
   (*f)->type = FD_SOCK;
   (*f)->readable = 1;
   (*f)->writable = 1;
@@ -80,6 +110,56 @@ bad:
   return -1;
 }
 
+// put si on its epoll's ready list.
+// caller holds the socket table lock.
+static void
+epollready(struct sock *si)
+{
+  struct epoll *ep = si->ep;
+
+  acquire(&ep->lock);
+  if (!si->rdlisted) {
+    si->rdlisted = 1;
+    si->rdnext = 0;
+    if (ep->rdtail)
+      ep->rdtail->rdnext = si;
+    else
+      ep->rdhead = si;
+    ep->rdtail = si;
+    wakeup(ep);
+  }
+  release(&ep->lock);
+}
+
+// stop watching si.
+// caller holds the socket table lock.
+static void
+epollforget(struct sock *si)
+{
+  struct epoll *ep = si->ep;
+  struct sock **pos, *prev;
+
+  for (pos = &ep->watched; *pos; pos = &(*pos)->epnext) {
+    if (*pos == si) {
+      *pos = si->epnext;
+      break;
+    }
+  }
+
+  acquire(&ep->lock);
+  if (si->rdlisted) {
+    prev = 0;
+    for (pos = &ep->rdhead; *pos != si; pos = &(*pos)->rdnext)
+      prev = *pos;
+    *pos = si->rdnext;
+    if (ep->rdtail == si)
+      ep->rdtail = prev;
+    si->rdlisted = 0;
+  }
+  release(&ep->lock);
+  si->ep = 0;
+}
+
 void
 sockclose(struct sock *si)
 {
@@ -96,6 +176,8 @@ sockclose(struct sock *si)
     }
     pos = &(*pos)->next;
   }
+  if (si->ep)
+    epollforget(si);
   release(&lock);
 
   // free any pending mbufs
@@ -107,15 +189,22 @@ sockclose(struct sock *si)
   kfree((char*)si);
 }
 
+// receive one datagram; if raddr and rport are not 0, fill
+// them in with its sender.
 int
-sockread(struct sock *si, uint64 addr, int n)
+sockread(struct sock *si, int nonblock, uint64 addr, int n,
+         uint32 *raddr, uint16 *rport)
 {
   struct proc *pr = myproc();
-  struct mbuf *m;
+  struct mbuf *m, *b;
   int len;
 
   acquire(&si->lock);
   while (mbufq_empty(&si->rxq) && !pr->killed) {
+    if (nonblock) {
+      release(&si->lock);
+      return -EAGAIN;
+    }
     sleep(&si->rxq, &si->lock);
   }
   if (pr->killed) {
@@ -125,32 +214,72 @@ sockread(struct sock *si, uint64 addr, int n)
   m = mbufq_pophead(&si->rxq);
   release(&si->lock);
 
-  len = m->len;
-  if (len > n)
-    len = n;
-  if (copyout(pr->pagetable, addr, m->head, len) == -1) {
-    mbuffree(m);
-    return -1;
+  if (raddr)
+    *raddr = m->raddr;
+  if (rport)
+    *rport = m->rport;
+
+  // a jumbo datagram is a chain of buffers
+  len = 0;
+  for (b = m; b && len < n; b = b->more) {
+    int cc = b->len;
+    if (cc > n - len)
+      cc = n - len;
+    if (copyout(pr->pagetable, addr + len, b->head, cc) == -1) {
+      mbuffree(m);
+      return -1;
+    }
+    len += cc;
   }
   mbuffree(m);
   return len;
 }
 
+// send one datagram, to raddr:rport or, if raddr is 0, to the
+// socket's connected peer.
 int
-sockwrite(struct sock *si, uint64 addr, int n)
+sockwrite(struct sock *si, uint64 addr, int n, uint32 raddr, uint16 rport)
 {
   struct proc *pr = myproc();
-  struct mbuf *m;
+  struct mbuf *m, *b, *last;
+  int len, cc;
+
+  if (raddr == 0) {
+    raddr = si->raddr;
+    rport = si->rport;
+  }
+  if (raddr == 0)
+    return -1;
+
+  // the datagram must fit in one IP packet
+  if (n < 0 || n > NET_MTU - sizeof(struct ip) - sizeof(struct udp))
+    return -1;
 
   m = mbufalloc(MBUF_DEFAULT_HEADROOM);
   if (!m)
     return -1;
 
-  if (copyin(pr->pagetable, mbufput(m, n), addr, n) == -1) {
-    mbuffree(m);
-    return -1;
+  // spill data that doesn't fit after the headroom into more buffers
+  b = last = m;
+  for (len = 0; len < n; len += cc) {
+    if (b == 0) {
+      if ((b = mbufalloc(0)) == 0) {
+        mbuffree(m);
+        return -1;
+      }
+      last->more = b;
+      last = b;
+    }
+    cc = MBUF_SIZE - (b->head - b->buf);
+    if (cc > n - len)
+      cc = n - len;
+    if (copyin(pr->pagetable, mbufput(b, cc), addr + len, cc) == -1) {
+      mbuffree(m);
+      return -1;
+    }
+    b = 0;
   }
-  net_tx_udp(m, si->raddr, si->lport, si->rport);
+  net_tx_udp(m, raddr, si->lport, rport);
   return n;
 }
 
@@ -163,15 +292,23 @@ sockrecvudp(struct mbuf *m, uint32 raddr, uint16 lport, uint16 rport)
   // any sleeping reader. Free the mbuf if there are no sockets
   // registered to handle it.
   //
-  struct sock *si;
+  struct sock *si, *bound;
+
+  m->raddr = raddr;
+  m->rport = rport;
 
   acquire(&lock);
+  bound = 0;
   si = sockets;
   while (si) {
     if (si->raddr == raddr && si->lport == lport && si->rport == rport)
       goto found;
+    if (si->raddr == 0 && si->rport == 0 && si->lport == lport)
+      bound = si;
     si = si->next;
   }
+  if ((si = bound) != 0)
+    goto found;
   release(&lock);
   mbuffree(m);
   return;
@@ -180,6 +317,132 @@ found:
   acquire(&si->lock);
   mbufq_pushtail(&si->rxq, m);
   wakeup(&si->rxq);
+  if (si->ep)
+    epollready(si);
   release(&si->lock);
   release(&lock);
 }
+
+int
+epollalloc(struct file **f)
+{
+  struct epoll *ep;
+
+  if ((*f = filealloc()) == 0)
+    return -1;
+  if ((ep = (struct epoll*)kalloc()) == 0) {
+    fileclose(*f);
+    return -1;
+  }
+  initlock(&ep->lock, "epoll");
+  ep->rdhead = ep->rdtail = 0;
+  ep->watched = 0;
+  (*f)->type = FD_EPOLL;
+  (*f)->readable = 0;
+  (*f)->writable = 0;
+  (*f)->epoll = ep;
+  return 0;
+}
+
+void
+epollclose(struct epoll *ep)
+{
+  acquire(&lock);
+  while (ep->watched)
+    epollforget(ep->watched);
+  release(&lock);
+  kfree((char*)ep);
+}
+
+int
+epollctl(struct epoll *ep, int op, struct file *f, uint64 data)
+{
+  struct sock *si;
+  int r = 0;
+
+  if (f->type != FD_SOCK)
+    return -1;
+  si = f->sock;
+
+  acquire(&lock);
+  switch (op) {
+  case EPOLL_CTL_ADD:
+    if (si->ep) {
+      r = -1;
+      break;
+    }
+    si->ep = ep;
+    acquire(&ep->lock);
+    si->epdata = data;
+    release(&ep->lock);
+    si->epnext = ep->watched;
+    ep->watched = si;
+    // report packets that arrived before the socket was added
+    acquire(&si->lock);
+    if (!mbufq_empty(&si->rxq))
+      epollready(si);
+    release(&si->lock);
+    break;
+  case EPOLL_CTL_MOD:
+    if (si->ep != ep)
+      r = -1;
+    else {
+      acquire(&ep->lock);
+      si->epdata = data;
+      release(&ep->lock);
+    }
+    break;
+  case EPOLL_CTL_DEL:
+    if (si->ep != ep)
+      r = -1;
+    else
+      epollforget(si);
+    break;
+  default:
+    r = -1;
+  }
+  release(&lock);
+  return r;
+}
+
+// copy out up to max ready events to the user array at addr.
+// with timeout 0, return 0 at once if nothing is ready;
+// otherwise sleep until something is.
+int
+epollwait(struct epoll *ep, uint64 addr, int max, int timeout)
+{
+  struct proc *pr = myproc();
+  struct epoll_event ev;
+  struct sock *si;
+  int n;
+
+  acquire(&ep->lock);
+  while (ep->rdhead == 0) {
+    if (timeout == 0 || killed(pr)) {
+      release(&ep->lock);
+      return killed(pr) ? -1 : 0;
+    }
+    sleep(ep, &ep->lock);
+  }
+  for (n = 0; n < max && ep->rdhead; n++) {
+    si = ep->rdhead;
+    ep->rdhead = si->rdnext;
+    if (ep->rdhead == 0)
+      ep->rdtail = 0;
+    si->rdlisted = 0;
+    ev.events = EPOLLIN;
+    ev.data = si->epdata;
+    if (copyout(pr->pagetable, addr + n*sizeof(ev), (char*)&ev, sizeof(ev)) < 0) {
+      // put it back so that the event isn't lost
+      si->rdlisted = 1;
+      si->rdnext = ep->rdhead;
+      ep->rdhead = si;
+      if (ep->rdtail == 0)
+        ep->rdtail = si;
+      release(&ep->lock);
+      return n > 0 ? n : -1;
+    }
+  }
+  release(&ep->lock);
+  return n;
+}
@@ -0,0 +1,128 @@
+//
+// caching DNS daemon for the processes on this machine.
+//
+// usage: dnsd [a.b.c.d [port]]
+//
+// listens on 127.0.0.1:DNSD_PORT and answers A queries from
+// resolve()'s cache, asking the given name server (default
+// 8.8.8.8:53) on a miss. answers carry the remaining TTL.
+//
+
+#include "kernel/types.h"
+#include "kernel/net.h"
+#include "user/user.h"
+
+static uint32
+parseip(char *s)
+{
+  uint32 ip = 0;
+
+  for(int i = 0; i < 4; i++){
+    ip = (ip << 8) | atoi(s);
+    while(*s && *s != '.')
+      s++;
+    if(*s)
+      s++;
+  }
+  return ip;
+}
+
+// decode the question name at buf+off into name; returns the
+// offset just past it, or -1.
+static int
+qname(uint8 *buf, int cc, int off, char *name, int max)
+{
+  int n = 0;
+
+  while(off < cc && buf[off] != 0){
+    int l = buf[off++];
+    if(l > 63 || off + l > cc || n + l + 1 >= max)
+      return -1;
+    if(n > 0)
+      name[n++] = '.';
+    memmove(name + n, buf + off, l);
+    n += l;
+    off += l;
+  }
+  if(off >= cc)
+    return -1;
+  name[n] = 0;
+  return off + 1;
+}
+
+// turn the query in buf into an answer in place; returns its length.
+static int
+answer(uint8 *buf, int cc)
+{
+  struct dns *hdr = (struct dns *)buf;
+  struct dns_question *q;
+  struct dns_data *d;
+  char name[64];
+  uint32 addr, ttl;
+  int off;
+
+  if(cc < sizeof(*hdr) || hdr->qr || ntohs(hdr->qdcount) != 1)
+    return -1;
+  if((off = qname(buf, cc, sizeof(*hdr), name, sizeof(name))) < 0 ||
+     off + sizeof(*q) > cc)
+    return -1;
+  q = (struct dns_question *)(buf + off);
+  off += sizeof(*q);
+
+  hdr->qr = 1;
+  hdr->ra = 1;
+  hdr->ancount = 0;
+  hdr->nscount = 0;
+  hdr->arcount = 0;
+  if(ntohs(q->qtype) != ARECORD || resolvettl(name, &addr, &ttl) < 0){
+    hdr->rcode = 2; // server failure
+    return off;
+  }
+
+  // a pointer (0xc00c) to the name in the question
+  buf[off++] = 0xc0;
+  buf[off++] = sizeof(*hdr);
+  d = (struct dns_data *)(buf + off);
+  d->type = htons(ARECORD);
+  d->class = htons(QCLASS);
+  d->ttl = htonl(ttl);
+  d->len = htons(4);
+  off += sizeof(*d);
+  buf[off++] = addr >> 24;
+  buf[off++] = addr >> 16;
+  buf[off++] = addr >> 8;
+  buf[off++] = addr;
+  hdr->ancount = htons(1);
+  return off;
+}
+
+int
+main(int argc, char *argv[])
+{
+  uint8 buf[512];
+  uint32 raddr;
+  uint16 rport;
+  int fd, cc;
+
+  if(argc > 1)
+    resolvinit(parseip(argv[1]), argc > 2 ? atoi(argv[2]) : 53, 0);
+
+  // bound to DNSD_PORT, from any sender
+  if((fd = connect(0, DNSD_PORT, 0)) < 0){
+    fprintf(2, "dnsd: cannot bind port %d\n", DNSD_PORT);
+    exit(1);
+  }
+
+  for(;;){
+    cc = recvfrom(fd, buf, sizeof(buf), &raddr, &rport);
+    if(cc < 0){
+      fprintf(2, "dnsd: recvfrom failed\n");
+      exit(1);
+    }
+    // only serve this machine
+    if((raddr >> 24) != 127)
+      continue;
+    if((cc = answer(buf, cc)) > 0)
+      sendto(fd, buf, cc, raddr, rport);
+  }
+}
@@ -1,6 +1,8 @@
 #include "kernel/types.h"
 #include "kernel/net.h"
 #include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/epoll.h"
 #include "user/user.h"
 
 //
@@ -48,6 +50,111 @@ ping(uint16 sport, uint16 dport, int attempts)
   }
 }
 
+//
+// send the largest UDP datagram the MTU allows, and make sure
+// that one byte more is refused.
+//
+static void
+bigping(uint16 sport, uint16 dport)
+{
+  static char obuf[NET_MTU];
+  int fd, n;
+  uint32 dst;
+
+  n = NET_MTU - sizeof(struct ip) - sizeof(struct udp);
+  memset(obuf, 'x', n);
+  dst = (10 << 24) | (0 << 16) | (2 << 8) | (2 << 0);
+  if((fd = connect(dst, sport, dport)) < 0){
+    fprintf(2, "bigping: connect() failed\n");
+    exit(1);
+  }
+  if(write(fd, obuf, n+1) >= 0){
+    fprintf(2, "bigping: oversized send() succeeded\n");
+    exit(1);
+  }
+  if(write(fd, obuf, n) != n){
+    fprintf(2, "bigping: send() failed\n");
+    exit(1);
+  }
+
+  char ibuf[128];
+  int cc = read(fd, ibuf, sizeof(ibuf)-1);
+  if(cc < 0){
+    fprintf(2, "bigping: recv() failed\n");
+    exit(1);
+  }
+  close(fd);
+  ibuf[cc] = '\0';
+  if(strcmp(ibuf, "this is the host!") != 0){
+    fprintf(2, "bigping didn't receive correct payload\n");
+    exit(1);
+  }
+}
+
+//
+// a non-blocking socket registered with epoll: reads fail with
+// EAGAIN until the reply arrives and epoll_wait() reports it.
+//
+static void
+epollping(uint16 sport, uint16 dport)
+{
+  char *obuf = "a message from xv6!";
+  struct epoll_event ev;
+  char ibuf[128];
+  int fd, ep, cc;
+  uint32 dst;
+
+  dst = (10 << 24) | (0 << 16) | (2 << 8) | (2 << 0);
+  if((fd = connect(dst, sport, dport)) < 0 || (ep = epoll_create()) < 0){
+    fprintf(2, "epollping: connect() or epoll_create() failed\n");
+    exit(1);
+  }
+  if(fcntl(fd, F_SETFL, O_NONBLOCK) < 0 || fcntl(fd, F_GETFL, 0) != O_NONBLOCK){
+    fprintf(2, "epollping: fcntl() failed\n");
+    exit(1);
+  }
+  if(read(fd, ibuf, sizeof(ibuf)) != -EAGAIN){
+    fprintf(2, "epollping: empty read didn't return -EAGAIN\n");
+    exit(1);
+  }
+
+  ev.events = EPOLLIN;
+  ev.data = 42;
+  if(epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev) < 0){
+    fprintf(2, "epollping: epoll_ctl() failed\n");
+    exit(1);
+  }
+  if(epoll_wait(ep, &ev, 1, 0) != 0){
+    fprintf(2, "epollping: epoll_wait() reported an idle socket\n");
+    exit(1);
+  }
+
+  if(write(fd, obuf, strlen(obuf)) < 0){
+    fprintf(2, "epollping: send() failed\n");
+    exit(1);
+  }
+  if(epoll_wait(ep, &ev, 1, -1) != 1 || ev.data != 42 || !(ev.events & EPOLLIN)){
+    fprintf(2, "epollping: epoll_wait() failed\n");
+    exit(1);
+  }
+  cc = read(fd, ibuf, sizeof(ibuf)-1);
+  if(cc < 0){
+    fprintf(2, "epollping: recv() failed\n");
+    exit(1);
+  }
+  ibuf[cc] = '\0';
+  if(strcmp(ibuf, "this is the host!") != 0){
+    fprintf(2, "epollping didn't receive correct payload\n");
+    exit(1);
+  }
+  if(read(fd, ibuf, sizeof(ibuf)) != -EAGAIN){
+    fprintf(2, "epollping: drained read didn't return -EAGAIN\n");
+    exit(1);
+  }
+  close(ep);
+  close(fd);
+}
+
 // Encode a DNS name
 static void
 encode_qname(char *qn, char *host)
@@ -288,6 +395,14 @@ main(int argc, char *argv[])
   }
   printf("OK\n");
   
+  printf("testing MTU-sized ping: ");
+  bigping(2011, dport);
+  printf("OK\n");
+
+  printf("testing non-blocking epoll: ");
+  epollping(2012, dport);
+  printf("OK\n");
+
   printf("testing DNS\n");
   dns();
   printf("DNS OK\n");
@@ -0,0 +1,132 @@
+//
+// capture packets from the kernel's pcap device into a file.
+//
+// usage: pcapdump [-e ip|arp] [-p udp|icmp] [-a a.b.c.d] [-P port]
+//                 [-s snaplen] [-n count] file
+//
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/spinlock.h"
+#include "kernel/sleeplock.h"
+#include "kernel/fs.h"
+#include "kernel/file.h"
+#include "kernel/net.h"
+#include "kernel/pcap.h"
+#include "user/user.h"
+
+static void
+usage(void)
+{
+  fprintf(2, "usage: pcapdump [-e ip|arp] [-p udp|icmp] [-a a.b.c.d] "
+          "[-P port] [-s snaplen] [-n count] file\n");
+  exit(1);
+}
+
+static uint32
+parseip(char *s)
+{
+  uint32 ip = 0;
+
+  for(int i = 0; i < 4; i++){
+    ip = (ip << 8) | atoi(s);
+    while(*s && *s != '.')
+      s++;
+    if(*s)
+      s++;
+  }
+  return ip;
+}
+
+// read exactly n bytes, or fail at end of capture.
+static int
+readn(int fd, void *buf, int n)
+{
+  int i, cc;
+
+  for(i = 0; i < n; i += cc){
+    if((cc = read(fd, (char*)buf + i, n - i)) <= 0)
+      return -1;
+  }
+  return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  static char frame[PCAP_SNAPLEN];
+  struct pcapctl ctl;
+  struct pcap_hdr hdr;
+  struct pcap_rec rec;
+  int dev, out, i, count;
+
+  memset(&ctl, 0, sizeof(ctl));
+  count = 10;
+  for(i = 1; i + 1 < argc && argv[i][0] == '-'; i += 2){
+    char *a = argv[i+1];
+    switch(argv[i][1]){
+    case 'e':
+      ctl.ethtype = strcmp(a, "arp") == 0 ? ETHTYPE_ARP : ETHTYPE_IP;
+      break;
+    case 'p':
+      ctl.proto = strcmp(a, "icmp") == 0 ? IPPROTO_ICMP : IPPROTO_UDP;
+      break;
+    case 'a':
+      ctl.ip = parseip(a);
+      break;
+    case 'P':
+      ctl.port = atoi(a);
+      break;
+    case 's':
+      ctl.snaplen = atoi(a);
+      break;
+    case 'n':
+      count = atoi(a);
+      break;
+    default:
+      usage();
+    }
+  }
+  if(i != argc - 1)
+    usage();
+
+  if((dev = open("pcap", O_RDWR)) < 0){
+    mknod("pcap", PCAP, 0);
+    if((dev = open("pcap", O_RDWR)) < 0){
+      fprintf(2, "pcapdump: cannot open pcap device\n");
+      exit(1);
+    }
+  }
+  if((out = open(argv[i], O_CREATE|O_TRUNC|O_WRONLY)) < 0){
+    fprintf(2, "pcapdump: cannot create %s\n", argv[i]);
+    exit(1);
+  }
+
+  ctl.enable = 1;
+  if(write(dev, &ctl, sizeof(ctl)) != sizeof(ctl)){
+    fprintf(2, "pcapdump: cannot start capture\n");
+    exit(1);
+  }
+
+  if(readn(dev, &hdr, sizeof(hdr)) < 0 || hdr.magic != PCAP_MAGIC){
+    fprintf(2, "pcapdump: bad stream header\n");
+    exit(1);
+  }
+  write(out, &hdr, sizeof(hdr));
+
+  for(i = 0; i < count; i++){
+    if(readn(dev, &rec, sizeof(rec)) < 0 ||
+       readn(dev, frame, rec.incl_len) < 0)
+      break;
+    write(out, &rec, sizeof(rec));
+    write(out, frame, rec.incl_len);
+  }
+
+  ctl.enable = 0;
+  write(dev, &ctl, sizeof(ctl));
+  close(out);
+  close(dev);
+  printf("pcapdump: %d frames\n", i);
+  exit(0);
+}
@@ -0,0 +1,240 @@
+//
+// stub DNS resolver with a per-process cache.
+//
+// resolve() answers from the cache while an entry's TTL lasts.
+// on a miss it asks the caching daemon (dnsd) on 127.0.0.1 if
+// resolvinit() enabled that, and otherwise, or if the daemon
+// doesn't answer, the configured name server.
+//
+
+#include "kernel/types.h"
+#include "kernel/net.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+#define TICKS_PER_SEC   10  // timer interrupts are ~1/10th second apart
+#define RESOLV_NCACHE   32
+#define RESOLV_TIMEOUT  20  // ticks to wait for a reply
+#define RESOLV_MAXNAME  64
+
+static struct {
+  char name[RESOLV_MAXNAME];
+  uint32 addr;
+  int expires;   // in ticks; 0 means unused
+} cache[RESOLV_NCACHE];
+
+static uint32 server = MAKE_IP_ADDR(8, 8, 8, 8);
+static uint16 serverport = 53;
+static int usedaemon;
+static int nquery;  // to pick distinct local ports
+
+void
+resolvinit(uint32 addr, uint16 port, int daemon)
+{
+  server = addr;
+  serverport = port;
+  usedaemon = daemon;
+}
+
+// look name up in the cache; sets *ttl to the seconds left.
+static int
+cachelookup(const char *name, uint32 *addr, uint32 *ttl)
+{
+  int now = uptime();
+
+  for(int i = 0; i < RESOLV_NCACHE; i++){
+    if(cache[i].expires > now && strcmp(cache[i].name, name) == 0){
+      *addr = cache[i].addr;
+      *ttl = (cache[i].expires - now) / TICKS_PER_SEC;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+// remember name for ttl seconds, replacing the entry that
+// expires first.
+static void
+cacheinsert(const char *name, uint32 addr, uint32 ttl)
+{
+  int i, victim = 0;
+
+  if(ttl == 0 || strlen(name) >= RESOLV_MAXNAME)
+    return;
+  for(i = 0; i < RESOLV_NCACHE; i++){
+    if(strcmp(cache[i].name, name) == 0){
+      victim = i;
+      break;
+    }
+    if(cache[i].expires < cache[victim].expires)
+      victim = i;
+  }
+  strcpy(cache[victim].name, name);
+  cache[victim].addr = addr;
+  cache[victim].expires = uptime() + ttl * TICKS_PER_SEC;
+}
+
+// encode "a.b.c" as DNS labels at qn; returns the length.
+static int
+encodename(char *qn, const char *name)
+{
+  const char *l = name, *c;
+  int len = 0;
+
+  for(c = name; ; c++){
+    if(*c == '.' || *c == 0){
+      if(c - l > 63)
+        return -1;
+      if(c > l){
+        qn[len++] = c - l;
+        memmove(qn + len, l, c - l);
+        len += c - l;
+      }
+      if(*c == 0)
+        break;
+      l = c + 1;
+    }
+  }
+  qn[len++] = 0;
+  return len;
+}
+
+// skip a possibly compressed name at off; returns the offset
+// just past it, or -1.
+static int
+skipname(uint8 *buf, int cc, int off)
+{
+  while(off < cc){
+    if(buf[off] == 0)
+      return off + 1;
+    if((buf[off] & 0xc0) == 0xc0)
+      return off + 2 <= cc ? off + 2 : -1;
+    off += buf[off] + 1;
+  }
+  return -1;
+}
+
+// build a query for name's A record; returns its length.
+static int
+dnsmkquery(uint8 *buf, int id, const char *name)
+{
+  struct dns *hdr = (struct dns *)buf;
+  struct dns_question *q;
+  int len;
+
+  memset(hdr, 0, sizeof(*hdr));
+  hdr->id = htons(id);
+  hdr->rd = 1;
+  hdr->qdcount = htons(1);
+  if((len = encodename((char *)(hdr + 1), name)) < 0)
+    return -1;
+  len += sizeof(*hdr);
+  q = (struct dns_question *)(buf + len);
+  q->qtype = htons(ARECORD);
+  q->qclass = htons(QCLASS);
+  return len + sizeof(*q);
+}
+
+// find the first A record in a reply to query id. returns -1 if
+// buf isn't that reply, and -2 if the reply has no A record.
+static int
+dnsparse(uint8 *buf, int cc, int id, uint32 *addr, uint32 *ttl)
+{
+  struct dns *hdr = (struct dns *)buf;
+  struct dns_data *d;
+  int off, i;
+
+  if(cc < sizeof(*hdr) || !hdr->qr || ntohs(hdr->id) != id)
+    return -1;
+  if(hdr->rcode != 0)
+    return -2;
+  off = sizeof(*hdr);
+  for(i = 0; i < ntohs(hdr->qdcount); i++){
+    if((off = skipname(buf, cc, off)) < 0)
+      return -2;
+    off += sizeof(struct dns_question);
+  }
+  for(i = 0; i < ntohs(hdr->ancount); i++){
+    if((off = skipname(buf, cc, off)) < 0 || off + sizeof(*d) > cc)
+      return -2;
+    d = (struct dns_data *)(buf + off);
+    off += sizeof(*d);
+    if(off + ntohs(d->len) > cc)
+      return -2;
+    if(ntohs(d->type) == ARECORD && ntohs(d->len) == 4){
+      *addr = MAKE_IP_ADDR(buf[off], buf[off+1], buf[off+2], buf[off+3]);
+      *ttl = ntohl(d->ttl);
+      return 0;
+    }
+    off += ntohs(d->len);
+  }
+  return -2;
+}
+
+// ask the name server at dst:dport, waiting at most
+// RESOLV_TIMEOUT ticks for the answer.
+static int
+query(uint32 dst, uint16 dport, const char *name, uint32 *addr, uint32 *ttl)
+{
+  uint8 obuf[512], ibuf[512];
+  int fd, len, cc, id, start, r;
+  uint16 lport;
+
+  id = (getpid() << 8 | nquery) & 0xffff;
+  lport = 20000 + (getpid() % 64) * 64 + nquery++ % 64;
+  if((len = dnsmkquery(obuf, id, name)) < 0)
+    return -1;
+  if((fd = connect(dst, lport, dport)) < 0)
+    return -1;
+  fcntl(fd, F_SETFL, O_NONBLOCK);
+  if(write(fd, obuf, len) != len){
+    close(fd);
+    return -1;
+  }
+
+  start = uptime();
+  r = -1;
+  while(uptime() - start <= RESOLV_TIMEOUT){
+    cc = read(fd, ibuf, sizeof(ibuf));
+    if(cc == -EAGAIN){
+      sleep(1);
+      continue;
+    }
+    if(cc < 0)
+      break;
+    // ignore stray datagrams; stop at our reply
+    if((r = dnsparse(ibuf, cc, id, addr, ttl)) != -1)
+      break;
+  }
+  close(fd);
+  return r == 0 ? 0 : -1;
+}
+
+// resolve name to an IPv4 address; returns 0 on success.
+// if ttl is not 0, it is set to the seconds the answer is good for.
+int
+resolvettl(const char *name, uint32 *addr, uint32 *ttl)
+{
+  uint32 t;
+
+  if(cachelookup(name, addr, &t) == 0)
+    goto done;
+  if(usedaemon && query(MAKE_IP_ADDR(127, 0, 0, 1), DNSD_PORT, name, addr, &t) == 0)
+    goto found;
+  if(query(server, serverport, name, addr, &t) == 0)
+    goto found;
+  return -1;
+
+found:
+  cacheinsert(name, *addr, t);
+done:
+  if(ttl)
+    *ttl = t;
+  return 0;
+}
+
+int
+resolve(const char *name, uint32 *addr)
+{
+  return resolvettl(name, addr, 0);
+}
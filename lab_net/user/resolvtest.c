@@ -0,0 +1,141 @@
+#include "kernel/types.h"
+#include "kernel/net.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+//
+// tests for the resolver library and dnsd, against the stub
+// name server in dnsserver.py (make dnsserver).
+//
+
+static uint32 host = MAKE_IP_ADDR(10, 0, 2, 2);
+
+// how many queries has the stub server answered?
+static int
+queries(void)
+{
+  uint32 addr;
+
+  if(resolve("queries.xv6", &addr) < 0){
+    fprintf(2, "resolvtest: stub server not answering\n");
+    exit(1);
+  }
+  return addr;
+}
+
+static void
+expect(char *name, uint32 want)
+{
+  uint32 addr;
+
+  if(resolve(name, &addr) < 0){
+    fprintf(2, "resolvtest: cannot resolve %s\n", name);
+    exit(1);
+  }
+  if(addr != want){
+    fprintf(2, "resolvtest: wrong address for %s\n", name);
+    exit(1);
+  }
+}
+
+static void
+cachetest(void)
+{
+  int n;
+
+  expect("host.xv6", host);
+  n = queries();
+  expect("host.xv6", host);
+  if(queries() != n){
+    fprintf(2, "resolvtest: cached name was queried again\n");
+    exit(1);
+  }
+}
+
+static void
+ttltest(void)
+{
+  int n;
+
+  expect("short.xv6", MAKE_IP_ADDR(10, 0, 2, 3));
+  n = queries();
+  sleep(20);
+  expect("short.xv6", MAKE_IP_ADDR(10, 0, 2, 3));
+  if(queries() != n + 1){
+    fprintf(2, "resolvtest: expired name was not queried again\n");
+    exit(1);
+  }
+}
+
+// format n, which is positive, into buf.
+static void
+itoa(char *buf, int n)
+{
+  char tmp[16];
+  int i = 0;
+
+  do {
+    tmp[i++] = '0' + n % 10;
+    n /= 10;
+  } while(n > 0);
+  while(i > 0)
+    *buf++ = tmp[--i];
+  *buf = 0;
+}
+
+static void
+dnsdtest(void)
+{
+  char port[16], *argv[] = { "dnsd", "10.0.2.2", port, 0 };
+  int i, n, pid, xstatus;
+
+  itoa(port, DNS_TESTS_PORT);
+
+  if((pid = fork()) == 0){
+    exec("dnsd", argv);
+    fprintf(2, "resolvtest: exec dnsd failed\n");
+    exit(1);
+  }
+  sleep(5);
+
+  // each child has an empty cache, but only the first
+  // lookup should get past the daemon.
+  n = queries();
+  for(i = 0; i < 4; i++){
+    if(fork() == 0){
+      resolvinit(MAKE_IP_ADDR(10, 0, 2, 2), DNS_TESTS_PORT, 1);
+      expect("pdos.csail.mit.edu", MAKE_IP_ADDR(128, 52, 129, 126));
+      exit(0);
+    }
+    wait(&xstatus);
+    if(xstatus != 0)
+      exit(1);
+  }
+  kill(pid);
+  wait(0);
+  if(queries() != n + 1){
+    fprintf(2, "resolvtest: dnsd didn't cache\n");
+    exit(1);
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  resolvinit(host, DNS_TESTS_PORT, 0);
+
+  printf("testing resolver cache: ");
+  cachetest();
+  printf("OK\n");
+
+  printf("testing resolver TTL: ");
+  ttltest();
+  printf("OK\n");
+
+  printf("testing dnsd: ");
+  dnsdtest();
+  printf("OK\n");
+
+  printf("all resolver tests passed.\n");
+  exit(0);
+}
@@ -1,4 +1,5 @@
 struct stat;
+struct epoll_event;
 
 // system calls
 int fork(void);
@@ -24,6 +25,18 @@ int sleep(int);
 int uptime(void);
 #ifdef LAB_NET
 int connect(uint32, uint16, uint16);
+int fcntl(int, int, int);
+int epoll_create(void);
+int epoll_ctl(int, int, int, struct epoll_event*);
+int epoll_wait(int, struct epoll_event*, int, int);
+int sendto(int, const void*, int, uint32, uint16);
+int recvfrom(int, void*, int, uint32*, uint16*);
+
+// resolv.c
+#define DNSD_PORT 5353  // dnsd listens here on 127.0.0.1
+void resolvinit(uint32, uint16, int);
+int resolve(const char*, uint32*);
+int resolvettl(const char*, uint32*, uint32*);
 #endif
 #ifdef LAB_PGTBL
 int pgaccess(void *base, int len, void *mask);
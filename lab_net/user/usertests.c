@@ -1145,6 +1145,55 @@ sharedfd(char *s)
   }
 }
 
+// fill the file descriptor table, check that the lowest free
+// descriptor is reused, and that fork copies a large table.
+void
+manyfds(char *s)
+{
+  int fds[2], fd, n, pid, xstatus;
+  char c;
+
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  for(n = fds[1] + 1; (fd = dup(fds[1])) >= 0; n++){
+    if(fd != n){
+      printf("%s: dup returned %d, expected %d\n", s, fd, n);
+      exit(1);
+    }
+  }
+  if(n != NOFILE){
+    printf("%s: only %d descriptors\n", s, n);
+    exit(1);
+  }
+  close(NOFILE - 100);
+  close(700);
+  if(dup(fds[1]) != 700 || dup(fds[1]) != NOFILE - 100){
+    printf("%s: lowest free descriptor not reused\n", s);
+    exit(1);
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    if(write(NOFILE - 1, "x", 1) != 1)
+      exit(1);
+    exit(0);
+  }
+  wait(&xstatus);
+  for(fd = fds[1]; fd < NOFILE; fd++)
+    close(fd);
+  if(xstatus != 0 || read(fds[0], &c, 1) != 1 || c != 'x'){
+    printf("%s: child could not use its copied descriptors\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+}
+
 // four processes write different files at the same
 // time, to test block allocation.
 void
@@ -2604,6 +2653,7 @@ struct test {
   {reparent2, "reparent2"},
   {mem, "mem"},
   {sharedfd, "sharedfd"},
+  {manyfds, "manyfds"},
   {fourfiles, "fourfiles"},
   {createdelete, "createdelete"},
   {unlinkread, "unlinkread"},
@@ -37,4 +37,10 @@ entry("sbrk");
 entry("sleep");
 entry("uptime");
 entry("connect");
+entry("fcntl");
+entry("epoll_create");
+entry("epoll_ctl");
+entry("epoll_wait");
+entry("sendto");
+entry("recvfrom");
 entry("pgaccess");
@@ -21,6 +21,7 @@
 #include "riscv.h"
 #include "defs.h"
 #include "proc.h"
+#include "poll.h"
 
 #define BACKSPACE 0x100
 #define C(x)  ((x)-'@')  // Control-x
@@ -52,6 +53,18 @@ struct {
   uint e;  // Edit index
 } cons;
 
+// a read won't block once a line has arrived.
+static int
+consolepoll(void)
+{
+  int r;
+
+  acquire(&cons.lock);
+  r = POLLOUT | (cons.r != cons.w ? POLLIN : 0);
+  release(&cons.lock);
+  return r;
+}
+
 //
 // user write()s to the console go here.
 //
@@ -170,6 +183,7 @@ consoleintr(int c)
         // has arrived.
         cons.w = cons.e;
         wakeup(&cons.r);
+        pollwakeup();
       }
     }
     break;
@@ -189,4 +203,5 @@ consoleinit(void)
   // to consoleread and consolewrite.
   devsw[CONSOLE].read = consoleread;
   devsw[CONSOLE].write = consolewrite;
+  devsw[CONSOLE].poll = consolepoll;
 }
@@ -31,6 +31,14 @@ exec(char *path, char **argv)
   pagetable_t pagetable = 0, oldpagetable;
   struct proc *p = myproc();
 
+  // other threads are still running in the old image.
+  acquire(&p->mm->lock);
+  if(p->mm->ref > 1){
+    release(&p->mm->lock);
+    return -1;
+  }
+  release(&p->mm->lock);
+
   begin_op();
 
   if((ip = namei(path)) == 0){
@@ -73,7 +81,7 @@ exec(char *path, char **argv)
   ip = 0;
 
   p = myproc();
-  uint64 oldsz = p->sz;
+  uint64 oldsz = p->mm->sz;
 
   // Allocate two pages at the next page boundary.
   // Make the first inaccessible as a stack guard.
@@ -122,8 +130,16 @@ exec(char *path, char **argv)
     
   // Commit to the user image.
   oldpagetable = p->pagetable;
+  acquire(&p->mm->lock);
+  p->mm->pagetable = pagetable;
+  p->mm->sz = sz;
+  p->mm->tfslots = 1; // proc_pagetable() used TRAPFRAME
+  release(&p->mm->lock);
   p->pagetable = pagetable;
-  p->sz = sz;
+  p->tfslot = 0;
+  p->ctid = 0;
+  p->alarm_interval = 0;
+  p->fpon = 0;
   p->trapframe->epc = elf.entry;  // initial program counter = main
   p->trapframe->sp = sp; // initial stack pointer
   proc_freepagetable(oldpagetable, oldsz);
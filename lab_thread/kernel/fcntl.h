@@ -3,3 +3,17 @@
 #define O_RDWR    0x002
 #define O_CREATE  0x200
 #define O_TRUNC   0x400
+#define O_NONBLOCK 0x004
+
+// fcntl() commands
+#define F_GETFL   3
+#define F_SETFL   4
+
+// returned (negated) by a read or write that would have
+// to sleep on a non-blocking file.
+#define EAGAIN    11
+
+#define PROT_NONE       0x0
+#define PROT_READ       0x1
+#define PROT_WRITE      0x2
+#define PROT_EXEC       0x4
@@ -10,6 +10,8 @@
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "fcntl.h"
+#include "poll.h"
 #include "stat.h"
 #include "proc.h"
 
@@ -35,6 +37,7 @@ filealloc(void)
   for(f = ftable.file; f < ftable.file + NFILE; f++){
     if(f->ref == 0){
       f->ref = 1;
+      f->nonblock = 0;
       release(&ftable.lock);
       return f;
     }
@@ -112,10 +115,12 @@ fileread(struct file *f, uint64 addr, int n)
     return -1;
 
   if(f->type == FD_PIPE){
-    r = piperead(f->pipe, addr, n);
+    r = piperead(f->pipe, f->nonblock, addr, n);
   } else if(f->type == FD_DEVICE){
     if(f->major < 0 || f->major >= NDEV || !devsw[f->major].read)
       return -1;
+    if(f->nonblock && devsw[f->major].poll && !(devsw[f->major].poll() & POLLIN))
+      return -EAGAIN;
     r = devsw[f->major].read(1, addr, n);
   } else if(f->type == FD_INODE){
     ilock(f->ip);
@@ -140,7 +145,7 @@ filewrite(struct file *f, uint64 addr, int n)
     return -1;
 
   if(f->type == FD_PIPE){
-    ret = pipewrite(f->pipe, addr, n);
+    ret = pipewrite(f->pipe, f->nonblock, addr, n);
   } else if(f->type == FD_DEVICE){
     if(f->major < 0 || f->major >= NDEV || !devsw[f->major].write)
       return -1;
@@ -180,3 +185,18 @@ filewrite(struct file *f, uint64 addr, int n)
   return ret;
 }
 
+
+// which of POLLIN, POLLOUT and POLLHUP hold for f.
+int
+filepoll(struct file *f)
+{
+  int r = 0;
+
+  if(f->type == FD_PIPE)
+    return pipepoll(f->pipe, f->writable);
+  if(f->type == FD_DEVICE && f->major >= 0 && f->major < NDEV && devsw[f->major].poll)
+    r = devsw[f->major].poll();
+  else
+    r = POLLIN | POLLOUT;
+  return r & ((f->readable ? POLLIN : 0) | (f->writable ? POLLOUT : 0));
+}
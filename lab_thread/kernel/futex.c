@@ -0,0 +1,116 @@
+//
+// futexes, for user-level locks and thread join.
+//
+// A thread that finds a lock word busy sleeps on it with
+// FUTEX_WAIT; whoever changes the word wakes it with
+// FUTEX_WAKE. Waiters are keyed by address space and user
+// address, and hashed into buckets, each with its own lock
+// and a FIFO list of the waiters sleeping there.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+
+#define NFUTEXQ 64
+
+// lives on the waiting thread's kernel stack.
+struct futexw {
+  struct mm *mm;
+  uint64 addr;
+  int woken;
+  struct futexw *next;
+};
+
+struct futexq {
+  struct spinlock lock;
+  struct futexw *head;
+};
+
+static struct futexq futexq[NFUTEXQ];
+
+void
+futexinit(void)
+{
+  for(int i = 0; i < NFUTEXQ; i++)
+    initlock(&futexq[i].lock, "futex");
+}
+
+static struct futexq*
+futexhash(struct mm *mm, uint64 addr)
+{
+  uint64 h = (addr >> 2) ^ ((uint64)mm >> 6);
+
+  return &futexq[(h ^ (h >> 6)) % NFUTEXQ];
+}
+
+// Sleep until woken, if the int at user address addr
+// still holds val. Returns 0 after a wakeup, -1 if the
+// value differed, addr is bad, or the thread was killed.
+int
+futexwait(uint64 addr, int val)
+{
+  struct proc *p = myproc();
+  struct futexq *q = futexhash(p->mm, addr);
+  struct futexw w, **pw;
+  int cur;
+
+  if(addr % sizeof(int) != 0)
+    return -1;
+
+  // a waker stores to the word before taking q->lock, so
+  // the store can't slip in between this check and sleep().
+  acquire(&q->lock);
+  if(copyin(p->pagetable, (char *)&cur, addr, sizeof(cur)) < 0 || cur != val){
+    release(&q->lock);
+    return -1;
+  }
+
+  w.mm = p->mm;
+  w.addr = addr;
+  w.woken = 0;
+  w.next = 0;
+  for(pw = &q->head; *pw; pw = &(*pw)->next)
+    ;
+  *pw = &w;
+
+  while(!w.woken && !killed(p))
+    sleep(&w, &q->lock);
+
+  if(!w.woken){
+    for(pw = &q->head; *pw != &w; pw = &(*pw)->next)
+      ;
+    *pw = w.next;
+  }
+  release(&q->lock);
+  return w.woken ? 0 : -1;
+}
+
+// Wake at most n threads of mm sleeping on addr, oldest
+// first. Returns the number woken.
+int
+futexwake(struct mm *mm, uint64 addr, int n)
+{
+  struct futexq *q = futexhash(mm, addr);
+  struct futexw *w, **pw;
+  int woken = 0;
+
+  acquire(&q->lock);
+  for(pw = &q->head; *pw && woken < n; ){
+    w = *pw;
+    if(w->mm == mm && w->addr == addr){
+      *pw = w->next;
+      w->woken = 1;
+      wakeup(w);
+      woken++;
+    } else {
+      pw = &w->next;
+    }
+  }
+  release(&q->lock);
+  return woken;
+}
@@ -62,6 +62,13 @@
 //   fixed-size stack
 //   expandable heap
 //   ...
+//   ...
+//   TRAPFRAME_SLOT(n) (trapframes of clone()d threads)
 //   TRAPFRAME (p->trapframe, used by the trampoline)
 //   TRAMPOLINE (the same page as in the kernel)
 #define TRAPFRAME (TRAMPOLINE - PGSIZE)
+
+// threads share a page table, so each maps its trapframe
+// in its own slot below TRAPFRAME. userret leaves the
+// address in sscratch for uservec.
+#define TRAPFRAME_SLOT(n) (TRAPFRAME - (uint64)(n)*PGSIZE)
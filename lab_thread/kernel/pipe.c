@@ -7,6 +7,8 @@
 #include "fs.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "fcntl.h"
+#include "poll.h"
 
 #define PIPESIZE 512
 
@@ -66,6 +68,7 @@ pipeclose(struct pipe *pi, int writable)
     pi->readopen = 0;
     wakeup(&pi->nwrite);
   }
+  pollwakeup();
   if(pi->readopen == 0 && pi->writeopen == 0){
     release(&pi->lock);
     kfree((char*)pi);
@@ -73,8 +76,10 @@ pipeclose(struct pipe *pi, int writable)
     release(&pi->lock);
 }
 
+// a non-blocking write returns what fit, or -EAGAIN
+// if nothing did.
 int
-pipewrite(struct pipe *pi, uint64 addr, int n)
+pipewrite(struct pipe *pi, int nonblock, uint64 addr, int n)
 {
   int i = 0;
   struct proc *pr = myproc();
@@ -86,7 +91,13 @@ pipewrite(struct pipe *pi, uint64 addr, int n)
       return -1;
     }
     if(pi->nwrite == pi->nread + PIPESIZE){ //DOC: pipewrite-full
+      if(nonblock){
+        if(i == 0)
+          i = -EAGAIN;
+        break;
+      }
       wakeup(&pi->nread);
+      pollwakeup();
       sleep(&pi->nwrite, &pi->lock);
     } else {
       char ch;
@@ -97,13 +108,14 @@ pipewrite(struct pipe *pi, uint64 addr, int n)
     }
   }
   wakeup(&pi->nread);
+  pollwakeup();
   release(&pi->lock);
 
   return i;
 }
 
 int
-piperead(struct pipe *pi, uint64 addr, int n)
+piperead(struct pipe *pi, int nonblock, uint64 addr, int n)
 {
   int i;
   struct proc *pr = myproc();
@@ -115,6 +127,10 @@ piperead(struct pipe *pi, uint64 addr, int n)
       release(&pi->lock);
       return -1;
     }
+    if(nonblock){
+      release(&pi->lock);
+      return -EAGAIN;
+    }
     sleep(&pi->nread, &pi->lock); //DOC: piperead-sleep
   }
   for(i = 0; i < n; i++){  //DOC: piperead-copy
@@ -125,6 +141,29 @@ piperead(struct pipe *pi, uint64 addr, int n)
       break;
   }
   wakeup(&pi->nwrite);  //DOC: piperead-wakeup
+  pollwakeup();
   release(&pi->lock);
   return i;
 }
+
+// readiness of the read (writable == 0) or write end.
+int
+pipepoll(struct pipe *pi, int writable)
+{
+  int r = 0;
+
+  acquire(&pi->lock);
+  if(writable){
+    if(!pi->readopen)
+      r = POLLOUT | POLLHUP;  // the write will fail at once
+    else if(pi->nwrite < pi->nread + PIPESIZE)
+      r = POLLOUT;
+  } else {
+    if(pi->nread != pi->nwrite)
+      r = POLLIN;
+    if(!pi->writeopen)
+      r |= POLLIN | POLLHUP;  // reads return 0 at once
+  }
+  release(&pi->lock);
+  return r;
+}
@@ -0,0 +1,149 @@
+//
+// poll(fds, nfds, timeout) checks each file, and if none is
+// ready, sleeps until something changes and checks again.
+//
+// Rather than register with every file, a poller notes a
+// global event count before it checks, and sleeps only if
+// the count hasn't moved since. Pipes and the console bump
+// the count with pollwakeup() whenever they would wake a
+// reader or writer, and the timer bumps it every tick while
+// some poller has a timeout. With no poll() in progress,
+// pollwakeup() returns without touching the lock, so pipes
+// don't serialize on it.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "poll.h"
+#include "defs.h"
+
+#define NPOLLFD 64
+
+static struct {
+  struct spinlock lock;
+  uint64 seq;     // bumped on every event
+  int npolling;   // in poll(), updated atomically
+  int nwaiting;   // pollers asleep
+  int ntimed;     // ... of which with a timeout
+} pollq;
+
+void
+pollinit(void)
+{
+  initlock(&pollq.lock, "poll");
+}
+
+// something may have become readable or writable.
+void
+pollwakeup(void)
+{
+  // the caller changed some file's state before calling; a
+  // poller counts itself in npolling before it first scans.
+  // one of the two sees the other, so no event is missed.
+  __sync_synchronize();
+  if(__atomic_load_n(&pollq.npolling, __ATOMIC_SEQ_CST) == 0)
+    return;
+  acquire(&pollq.lock);
+  pollq.seq++;
+  if(pollq.nwaiting)
+    wakeup(&pollq.seq);
+  release(&pollq.lock);
+}
+
+// called by clockintr() on every tick.
+void
+polltick(void)
+{
+  if(pollq.ntimed)
+    pollwakeup();
+}
+
+// set the revents of each of the nfds pollfds at addr;
+// returns how many are non-zero.
+static int
+pollscan(uint64 addr, int nfds)
+{
+  struct proc *p = myproc();
+  struct pollfd pfd;
+  struct file *f;
+  int i, n;
+
+  n = 0;
+  for(i = 0; i < nfds; i++){
+    if(copyin(p->pagetable, (char*)&pfd, addr + i*sizeof(pfd), sizeof(pfd)) < 0)
+      return -1;
+    pfd.revents = 0;
+    if(pfd.fd >= 0){
+      if(pfd.fd >= NOFILE || (f = p->fdt->ofile[pfd.fd]) == 0)
+        pfd.revents = POLLNVAL;
+      else
+        pfd.revents = filepoll(f) & (pfd.events | POLLHUP);
+    }
+    if(pfd.revents)
+      n++;
+    if(copyout(p->pagetable, addr + i*sizeof(pfd), (char*)&pfd, sizeof(pfd)) < 0)
+      return -1;
+  }
+  return n;
+}
+
+// timeout is in ticks; -1 waits for ever.
+// returns the number of ready fds, 0 on timeout.
+int
+poll(uint64 addr, int nfds, int timeout)
+{
+  struct proc *p = myproc();
+  uint64 seq;
+  uint start;
+  int n;
+
+  if(nfds < 0 || nfds > NPOLLFD)
+    return -1;
+  acquire(&tickslock);
+  start = ticks;
+  release(&tickslock);
+
+  __atomic_add_fetch(&pollq.npolling, 1, __ATOMIC_SEQ_CST);
+  for(;;){
+    acquire(&pollq.lock);
+    seq = pollq.seq;
+    release(&pollq.lock);
+
+    if((n = pollscan(addr, nfds)) != 0)
+      break;
+    if(timeout == 0 || killed(p)){
+      n = killed(p) ? -1 : 0;
+      break;
+    }
+    if(timeout > 0){
+      acquire(&tickslock);
+      n = ticks - start >= timeout;
+      release(&tickslock);
+      if(n){
+        n = 0;
+        break;
+      }
+    }
+
+    acquire(&pollq.lock);
+    if(pollq.seq == seq){
+      pollq.nwaiting++;
+      if(timeout > 0)
+        pollq.ntimed++;
+      sleep(&pollq.seq, &pollq.lock);
+      pollq.nwaiting--;
+      if(timeout > 0)
+        pollq.ntimed--;
+    }
+    release(&pollq.lock);
+  }
+  __atomic_sub_fetch(&pollq.npolling, 1, __ATOMIC_SEQ_CST);
+  return n;
+}
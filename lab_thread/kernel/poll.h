@@ -0,0 +1,15 @@
+//
+// poll(): wait until some of a set of files are ready.
+//
+
+// events and revents bits
+#define POLLIN   0x001  // read won't block
+#define POLLOUT  0x004  // write won't block
+#define POLLHUP  0x010  // the other end of a pipe is closed
+#define POLLNVAL 0x020  // fd isn't open (revents only)
+
+struct pollfd {
+  int fd;         // ignored if negative
+  short events;   // POLLIN and/or POLLOUT
+  short revents;  // set by poll()
+};
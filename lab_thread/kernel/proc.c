@@ -10,6 +10,10 @@ struct cpu cpus[NCPU];
 
 struct proc proc[NPROC];
 
+// at most one per process.
+struct mm mm[NPROC];
+struct fdtable fdtable[NPROC];
+
 struct proc *initproc;
 
 int nextpid = 1;
@@ -55,6 +59,11 @@ procinit(void)
       initlock(&p->lock, "proc");
       p->state = UNUSED;
       p->kstack = KSTACK((int) (p - proc));
+      p->fpcpu = -1;
+  }
+  for(int i = 0; i < NPROC; i++){
+    initlock(&mm[i].lock, "mm");
+    initlock(&fdtable[i].lock, "fdtable");
   }
 }
 
@@ -102,12 +111,150 @@ allocpid()
   return pid;
 }
 
+// Give p a new address space, holding just its trapframe.
+static int
+mmalloc(struct proc *p)
+{
+  struct mm *m;
+
+  for(m = mm; m < &mm[NPROC]; m++){
+    acquire(&m->lock);
+    if(m->ref == 0){
+      if((m->pagetable = proc_pagetable(p)) == 0){
+        release(&m->lock);
+        return -1;
+      }
+      m->ref = 1;
+      m->sz = 0;
+      m->tfslots = 1;
+      release(&m->lock);
+      p->mm = m;
+      p->pagetable = m->pagetable;
+      p->tfslot = 0;
+      return 0;
+    }
+    release(&m->lock);
+  }
+  return -1;
+}
+
+// Add p to address space m, mapping its trapframe
+// in a free slot.
+static int
+mmshare(struct proc *p, struct mm *m)
+{
+  int slot;
+
+  acquire(&m->lock);
+  for(slot = 0; slot < NPROC; slot++)
+    if((m->tfslots & (1UL << slot)) == 0)
+      break;
+  if(slot == NPROC || mappages(m->pagetable, TRAPFRAME_SLOT(slot), PGSIZE,
+                               (uint64)(p->trapframe), PTE_R | PTE_W) < 0){
+    release(&m->lock);
+    return -1;
+  }
+  m->tfslots |= 1UL << slot;
+  m->ref++;
+  release(&m->lock);
+  p->mm = m;
+  p->pagetable = m->pagetable;
+  p->tfslot = slot;
+  return 0;
+}
+
+// Drop p's use of its address space, freeing
+// the memory if p was the last user. If ctid isn't 0,
+// clear the int there and wake a joining thread: the
+// store and the drop happen together under m->lock, so
+// a joiner that sees the 0 no longer counts p in m->ref.
+static void
+mmput(struct proc *p, uint64 ctid)
+{
+  struct mm *m = p->mm;
+  int zero = 0;
+
+  acquire(&m->lock);
+  if(ctid && (m->ref == 1 ||
+               copyout(m->pagetable, ctid, (char *)&zero, sizeof(zero)) < 0))
+    ctid = 0;
+  uvmunmap(m->pagetable, TRAPFRAME_SLOT(p->tfslot), 1, 0);
+  m->tfslots &= ~(1UL << p->tfslot);
+  if(--m->ref == 0){
+    proc_freepagetable(m->pagetable, m->sz);
+    m->pagetable = 0;
+    m->sz = 0;
+  }
+  release(&m->lock);
+  p->mm = 0;
+  p->pagetable = 0;
+  if(ctid)
+    futexwake(m, ctid, NPROC);
+}
+
+// Give p an empty file table, or share other's.
+static int
+fdtalloc(struct proc *p, struct proc *other)
+{
+  struct fdtable *t;
+
+  if(other){
+    acquire(&other->fdt->lock);
+    other->fdt->ref++;
+    release(&other->fdt->lock);
+    p->fdt = other->fdt;
+    return 0;
+  }
+  for(t = fdtable; t < &fdtable[NPROC]; t++){
+    acquire(&t->lock);
+    if(t->ref == 0){
+      t->ref = 1;
+      release(&t->lock);
+      p->fdt = t;
+      return 0;
+    }
+    release(&t->lock);
+  }
+  return -1;
+}
+
+// Drop p's use of its file table; the last
+// user closes the files, which may sleep.
+static void
+fdtput(struct proc *p)
+{
+  struct fdtable *t = p->fdt;
+
+  acquire(&t->lock);
+  if(t->ref > 1){
+    t->ref--;
+    release(&t->lock);
+    p->fdt = 0;
+    return;
+  }
+  release(&t->lock);
+
+  // no other thread can reach t now.
+  for(int fd = 0; fd < NOFILE; fd++){
+    if(t->ofile[fd]){
+      struct file *f = t->ofile[fd];
+      fileclose(f);
+      t->ofile[fd] = 0;
+    }
+  }
+  acquire(&t->lock);
+  t->ref = 0;
+  release(&t->lock);
+  p->fdt = 0;
+}
+
 // Look in the process table for an UNUSED proc.
 // If found, initialize state required to run in the kernel,
-// and return with p->lock held.
+// and return with p->lock held. The proc gets new memory and
+// file tables, or if share isn't 0, uses share's.
 // If there are no free procs, or a memory allocation fails, return 0.
 static struct proc*
-allocproc(void)
+allocproc(struct proc *share)
 {
   struct proc *p;
 
@@ -132,9 +279,9 @@ found:
     return 0;
   }
 
-  // An empty user page table.
-  p->pagetable = proc_pagetable(p);
-  if(p->pagetable == 0){
+  // An empty user page table, or a slot in share's.
+  if((share ? mmshare(p, share->mm) : mmalloc(p)) < 0 ||
+     fdtalloc(p, share) < 0){
     freeproc(p);
     release(&p->lock);
     return 0;
@@ -155,13 +302,21 @@ found:
 static void
 freeproc(struct proc *p)
 {
+  if(p->mm)
+    mmput(p, 0); // exit() already dropped a thread's
+  if(p->fdt)
+    fdtput(p); // only if allocproc() failed; exit() drops it
   if(p->trapframe)
     kfree((void*)p->trapframe);
   p->trapframe = 0;
-  if(p->pagetable)
-    proc_freepagetable(p->pagetable, p->sz);
-  p->pagetable = 0;
-  p->sz = 0;
+  p->tfslot = 0;
+  p->ctid = 0;
+  p->alarm_interval = 0;
+  p->alarm_ticks = 0;
+  p->alarm_handler = 0;
+  p->fpon = 0;
+  p->fpcpu = -1;
+  p->thread = 0;
   p->pid = 0;
   p->parent = 0;
   p->name[0] = 0;
@@ -210,8 +365,15 @@ proc_pagetable(struct proc *p)
 void
 proc_freepagetable(pagetable_t pagetable, uint64 sz)
 {
+  pte_t *pte;
+
   uvmunmap(pagetable, TRAMPOLINE, 1, 0);
-  uvmunmap(pagetable, TRAPFRAME, 1, 0);
+  // whichever trapframes are still mapped.
+  for(int slot = 0; slot < NPROC; slot++){
+    pte = walk(pagetable, TRAPFRAME_SLOT(slot), 0);
+    if(pte && (*pte & PTE_V))
+      uvmunmap(pagetable, TRAPFRAME_SLOT(slot), 1, 0);
+  }
   uvmfree(pagetable, sz);
 }
 
@@ -234,13 +396,13 @@ userinit(void)
 {
   struct proc *p;
 
-  p = allocproc();
+  p = allocproc(0);
   initproc = p;
   
   // allocate one user page and copy initcode's instructions
   // and data into it.
   uvmfirst(p->pagetable, initcode, sizeof(initcode));
-  p->sz = PGSIZE;
+  p->mm->sz = PGSIZE;
 
   // prepare for the very first "return" from kernel to user.
   p->trapframe->epc = 0;      // user program counter
@@ -254,23 +416,35 @@ userinit(void)
   release(&p->lock);
 }
 
-// Grow or shrink user memory by n bytes.
+// Grow or shrink user memory by n bytes, and
+// set *oldsz to the size before.
 // Return 0 on success, -1 on failure.
 int
-growproc(int n)
+growproc(int n, uint64 *oldsz)
 {
   uint64 sz;
-  struct proc *p = myproc();
+  struct mm *m = myproc()->mm;
 
-  sz = p->sz;
+  // threads may grow memory at the same time.
+  acquire(&m->lock);
+  sz = *oldsz = m->sz;
   if(n > 0){
-    if((sz = uvmalloc(p->pagetable, sz, sz + n, PTE_W)) == 0) {
+    if(sz + n > TRAPFRAME_SLOT(NPROC-1) ||
+       (sz = uvmalloc(m->pagetable, sz, sz + n, PTE_W)) == 0) {
+      release(&m->lock);
       return -1;
     }
   } else if(n < 0){
-    sz = uvmdealloc(p->pagetable, sz, sz + n);
+    // other harts running threads might keep using stale
+    // TLB entries for the freed pages.
+    if(m->ref > 1){
+      release(&m->lock);
+      return -1;
+    }
+    sz = uvmdealloc(m->pagetable, sz, sz + n);
   }
-  p->sz = sz;
+  m->sz = sz;
+  release(&m->lock);
   return 0;
 }
 
@@ -284,28 +458,40 @@ fork(void)
   struct proc *p = myproc();
 
   // Allocate process.
-  if((np = allocproc()) == 0){
+  if((np = allocproc(0)) == 0){
     return -1;
   }
 
   // Copy user memory from parent to child.
-  if(uvmcopy(p->pagetable, np->pagetable, p->sz) < 0){
+  acquire(&p->mm->lock);
+  if(uvmcopy(p->pagetable, np->pagetable, p->mm->sz) < 0){
+    release(&p->mm->lock);
     freeproc(np);
     release(&np->lock);
     return -1;
   }
-  np->sz = p->sz;
+  np->mm->sz = p->mm->sz;
+  release(&p->mm->lock);
 
   // copy saved user registers.
   *(np->trapframe) = *(p->trapframe);
 
+  // fs0-fs11 survive a call, fork() included.
+  if(p->fpon){
+    fpsync(p);
+    np->fp = p->fp;
+    np->fpon = 1;
+  }
+
   // Cause fork to return 0 in the child.
   np->trapframe->a0 = 0;
 
   // increment reference counts on open file descriptors.
+  acquire(&p->fdt->lock);
   for(i = 0; i < NOFILE; i++)
-    if(p->ofile[i])
-      np->ofile[i] = filedup(p->ofile[i]);
+    if(p->fdt->ofile[i])
+      np->fdt->ofile[i] = filedup(p->fdt->ofile[i]);
+  release(&p->fdt->lock);
   np->cwd = idup(p->cwd);
 
   safestrcpy(np->name, p->name, sizeof(p->name));
@@ -325,6 +511,76 @@ fork(void)
   return pid;
 }
 
+// Create a thread that shares the caller's memory and
+// open files, and starts in fn(arg) on the given stack.
+// If ctid isn't 0, the new pid is stored there, and the
+// thread's exit clears the word and wakes futex waiters
+// on it. Threads are children of init, which reaps them.
+int
+clone(uint64 fn, uint64 arg, uint64 stack, uint64 ctid)
+{
+  int pid;
+  struct proc *np;
+  struct proc *p = myproc();
+
+  if(stack % 16 != 0 || ctid % sizeof(int) != 0)
+    return -1;
+
+  if((np = allocproc(p)) == 0){
+    return -1;
+  }
+  pid = np->pid;
+  if(ctid && copyout(p->pagetable, ctid, (char *)&pid, sizeof(pid)) < 0){
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
+
+  // a fresh user context.
+  memset(np->trapframe, 0, sizeof(*np->trapframe));
+  np->trapframe->epc = fn;
+  np->trapframe->sp = stack;
+  np->trapframe->a0 = arg;
+  np->ctid = ctid;
+  np->thread = 1;
+  np->cwd = idup(p->cwd);
+
+  safestrcpy(np->name, p->name, sizeof(p->name));
+
+  release(&np->lock);
+
+  acquire(&wait_lock);
+  np->parent = initproc;
+  release(&wait_lock);
+
+  acquire(&np->lock);
+  np->state = RUNNABLE;
+  release(&np->lock);
+
+  return pid;
+}
+
+// Kill the threads sharing p's memory.
+static void
+killthreads(struct proc *p)
+{
+  struct proc *pp;
+
+  for(pp = proc; pp < &proc[NPROC]; pp++){
+    if(pp == p)
+      continue;
+    acquire(&pp->lock);
+    if(pp->mm == p->mm){
+      pp->killed = 1;
+      if(pp->state == SLEEPING){
+        // Wake thread from sleep().
+        pp->state = RUNNABLE;
+      }
+    }
+    release(&pp->lock);
+  }
+}
+
 // Pass p's abandoned children to init.
 // Caller must hold wait_lock.
 void
@@ -351,14 +607,18 @@ exit(int status)
   if(p == initproc)
     panic("init exiting");
 
-  // Close all open files.
-  for(int fd = 0; fd < NOFILE; fd++){
-    if(p->ofile[fd]){
-      struct file *f = p->ofile[fd];
-      fileclose(f);
-      p->ofile[fd] = 0;
-    }
-  }
+  // A thread's exit ends just that thread, but
+  // the process takes its threads with it.
+  if(!p->thread)
+    killthreads(p);
+
+  // Close all open files, unless other threads use them.
+  fdtput(p);
+
+  // A thread leaves the address space now, rather than when
+  // reaped, so that a joiner may exec() or shrink it at once.
+  if(p->thread)
+    mmput(p, p->ctid);
 
   begin_op();
   iput(p->cwd);
@@ -471,6 +731,47 @@ scheduler(void)
   }
 }
 
+// Floating point is switched lazily. A process starts with
+// sstatus.FS Off, and its first FP instruction traps to
+// usertrap(), which turns on p->fpon. From then on the FP
+// registers are loaded on the way to user space, only if
+// this cpu doesn't already hold them, and saved when the
+// process gives up the cpu, only if it changed them.
+
+// save p's FP registers, if they're loaded on this cpu
+// and p wrote them since.
+void
+fpsync(struct proc *p)
+{
+  uint64 x;
+
+  push_off();
+  x = r_sstatus();
+  if(p->fpon && p->fpcpu == cpuid() && mycpu()->fpowner == p &&
+     (x & SSTATUS_FS) == SSTATUS_FS_DIRTY){
+    fpsave(&p->fp);
+    w_sstatus((x & ~SSTATUS_FS) | SSTATUS_FS_CLEAN);
+  }
+  pop_off();
+}
+
+// make sure this cpu's FP registers are p's, before
+// returning to user space. interrupts are off. returns 1
+// if it loaded them, 0 if this cpu held them already.
+int
+fpload(struct proc *p)
+{
+  struct cpu *c = mycpu();
+
+  if(c->fpowner == p && p->fpcpu == cpuid())
+    return 0;
+  w_sstatus((r_sstatus() & ~SSTATUS_FS) | SSTATUS_FS_CLEAN);
+  fprestore(&p->fp);
+  c->fpowner = p;
+  p->fpcpu = cpuid();
+  return 1;
+}
+
 // Switch to scheduler.  Must hold only p->lock
 // and have changed proc->state. Saves and restores
 // intena because intena is a property of this
@@ -494,6 +795,7 @@ sched(void)
     panic("sched interruptible");
 
   intena = mycpu()->intena;
+  fpsync(p);
   swtch(&p->context, &mycpu()->context);
   mycpu()->intena = intena;
 }
@@ -19,8 +19,15 @@ struct context {
 };
 
 // Per-CPU state.
+// a process's floating-point registers, saved by fpswtch.S.
+struct fpstate {
+  uint64 f[32];
+  uint64 fcsr;
+};
+
 struct cpu {
   struct proc *proc;          // The process running on this cpu, or null.
+  struct proc *fpowner;       // Whose FP registers this cpu last loaded.
   struct context context;     // swtch() here to enter scheduler().
   int noff;                   // Depth of push_off() nesting.
   int intena;                 // Were interrupts enabled before push_off()?
@@ -30,7 +37,8 @@ extern struct cpu cpus[NCPU];
 
 // per-process data for the trap handling code in trampoline.S.
 // sits in a page by itself just under the trampoline page in the
-// user page table. not specially mapped in the kernel page table.
+// user page table (or, for a clone()d thread, in a slot below
+// that). not specially mapped in the kernel page table.
 // uservec in trampoline.S saves user registers in the trapframe,
 // then initializes registers from the trapframe's
 // kernel_sp, kernel_hartid, kernel_satp, and jumps to kernel_trap.
@@ -81,6 +89,23 @@ struct trapframe {
 
 enum procstate { UNUSED, USED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
+// a user address space, shared by a process and the
+// threads it clone()s.
+struct mm {
+  struct spinlock lock;
+  int ref;                     // procs using it
+  pagetable_t pagetable;       // User page table
+  uint64 sz;                   // Size of process memory (bytes)
+  uint64 tfslots;              // bitmap of TRAPFRAME_SLOT()s in use
+};
+
+// open files, shared like struct mm.
+struct fdtable {
+  struct spinlock lock;        // protects ofile[] against other threads
+  int ref;
+  struct file *ofile[NOFILE];  // Open files
+};
+
 // Per-process state
 struct proc {
   struct spinlock lock;
@@ -91,17 +116,26 @@ struct proc {
   int killed;                  // If non-zero, have been killed
   int xstate;                  // Exit status to be returned to parent's wait
   int pid;                     // Process ID
+  int thread;                  // created by clone(); init reaps it
 
   // wait_lock must be held when using this:
   struct proc *parent;         // Parent process
 
   // these are private to the process, so p->lock need not be held.
   uint64 kstack;               // Virtual address of kernel stack
-  uint64 sz;                   // Size of process memory (bytes)
-  pagetable_t pagetable;       // User page table
+  struct mm *mm;               // User memory, maybe shared
+  pagetable_t pagetable;       // mm->pagetable, which only exec changes
   struct trapframe *trapframe; // data page for trampoline.S
+  int tfslot;                  // trapframe is mapped at TRAPFRAME_SLOT(tfslot)
+  uint64 ctid;                 // user address cleared at exit, or 0
+  int alarm_interval;          // sigalarm() period in ticks, or 0
+  int alarm_ticks;             // ticks since the last alarm
+  uint64 alarm_handler;        // user address of the alarm handler
+  int fpon;                    // has used floating point
+  int fpcpu;                   // cpu holding its FP registers, or -1
+  struct fpstate fp;           // FP registers while not loaded
   struct context context;      // swtch() here to run process
-  struct file *ofile[NOFILE];  // Open files
+  struct fdtable *fdt;         // Open files, maybe shared
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
 };
@@ -47,6 +47,10 @@ w_mepc(uint64 x)
 #define SSTATUS_UPIE (1L << 4) // User Previous Interrupt Enable
 #define SSTATUS_SIE (1L << 1)  // Supervisor Interrupt Enable
 #define SSTATUS_UIE (1L << 0)  // User Interrupt Enable
+#define SSTATUS_FS (3L << 13)  // Floating-point unit state:
+#define SSTATUS_FS_OFF (0L << 13)     // FP instructions trap
+#define SSTATUS_FS_CLEAN (2L << 13)   // registers unchanged since set Clean
+#define SSTATUS_FS_DIRTY (3L << 13)   // some register was written
 
 static inline uint64
 r_sstatus()
@@ -256,6 +260,21 @@ r_mcounteren()
   return x;
 }
 
+// Supervisor Counter-Enable
+static inline void 
+w_scounteren(uint64 x)
+{
+  asm volatile("csrw scounteren, %0" : : "r" (x));
+}
+
+static inline uint64
+r_scounteren()
+{
+  uint64 x;
+  asm volatile("csrr %0, scounteren" : "=r" (x) );
+  return x;
+}
+
 // machine-mode cycle counter
 static inline uint64
 r_time()
@@ -43,6 +43,11 @@ start()
   w_pmpaddr0(0x3fffffffffffffull);
   w_pmpcfg0(0xf);
 
+  // let supervisor and user code read the cycle and time
+  // CSRs (rdcycle, rdtime), for cheap timestamps.
+  w_mcounteren(r_mcounteren() | 3);
+  w_scounteren(r_scounteren() | 3);
+
   // ask for clock interrupts.
   timerinit();
 
@@ -20,3 +20,10 @@
 #define SYS_link   19
 #define SYS_mkdir  20
 #define SYS_close  21
+#define SYS_clone  22
+#define SYS_futex  23
+#define SYS_mprotect 24
+#define SYS_sigalarm 25
+#define SYS_sigreturn 26
+#define SYS_fcntl  27
+#define SYS_poll   28
@@ -25,7 +25,7 @@ argfd(int n, int *pfd, struct file **pf)
   struct file *f;
 
   argint(n, &fd);
-  if(fd < 0 || fd >= NOFILE || (f=myproc()->ofile[fd]) == 0)
+  if(fd < 0 || fd >= NOFILE || (f=myproc()->fdt->ofile[fd]) == 0)
     return -1;
   if(pfd)
     *pfd = fd;
@@ -40,17 +40,38 @@ static int
 fdalloc(struct file *f)
 {
   int fd;
-  struct proc *p = myproc();
+  struct fdtable *t = myproc()->fdt;
 
+  acquire(&t->lock);
   for(fd = 0; fd < NOFILE; fd++){
-    if(p->ofile[fd] == 0){
-      p->ofile[fd] = f;
+    if(t->ofile[fd] == 0){
+      t->ofile[fd] = f;
+      release(&t->lock);
       return fd;
     }
   }
+  release(&t->lock);
   return -1;
 }
 
+// Remove fd from the table if it still refers to f; another
+// thread sharing the table may have closed it already.
+// Returns 0 if the caller now owns the table's reference to f.
+static int
+fdclear(int fd, struct file *f)
+{
+  struct fdtable *t = myproc()->fdt;
+
+  acquire(&t->lock);
+  if(t->ofile[fd] != f){
+    release(&t->lock);
+    return -1;
+  }
+  t->ofile[fd] = 0;
+  release(&t->lock);
+  return 0;
+}
+
 uint64
 sys_dup(void)
 {
@@ -102,7 +123,8 @@ sys_close(void)
 
   if(argfd(0, &fd, &f) < 0)
     return -1;
-  myproc()->ofile[fd] = 0;
+  if(fdclear(fd, f) < 0)
+    return -1;
   fileclose(f);
   return 0;
 }
@@ -359,6 +381,7 @@ sys_open(void)
   f->ip = ip;
   f->readable = !(omode & O_WRONLY);
   f->writable = (omode & O_WRONLY) || (omode & O_RDWR);
+  f->nonblock = (omode & O_NONBLOCK) != 0;
 
   if((omode & O_TRUNC) && ip->type == T_FILE){
     itrunc(ip);
@@ -487,19 +510,51 @@ sys_pipe(void)
     return -1;
   fd0 = -1;
   if((fd0 = fdalloc(rf)) < 0 || (fd1 = fdalloc(wf)) < 0){
-    if(fd0 >= 0)
-      p->ofile[fd0] = 0;
-    fileclose(rf);
+    if(fd0 < 0 || fdclear(fd0, rf) == 0)
+      fileclose(rf);
     fileclose(wf);
     return -1;
   }
   if(copyout(p->pagetable, fdarray, (char*)&fd0, sizeof(fd0)) < 0 ||
      copyout(p->pagetable, fdarray+sizeof(fd0), (char *)&fd1, sizeof(fd1)) < 0){
-    p->ofile[fd0] = 0;
-    p->ofile[fd1] = 0;
-    fileclose(rf);
-    fileclose(wf);
+    if(fdclear(fd0, rf) == 0)
+      fileclose(rf);
+    if(fdclear(fd1, wf) == 0)
+      fileclose(wf);
     return -1;
   }
   return 0;
 }
+
+uint64
+sys_fcntl(void)
+{
+  struct file *f;
+  int cmd, arg;
+
+  if(argfd(0, 0, &f) < 0)
+    return -1;
+  argint(1, &cmd);
+  argint(2, &arg);
+
+  switch(cmd){
+  case F_GETFL:
+    return f->nonblock ? O_NONBLOCK : 0;
+  case F_SETFL:
+    f->nonblock = (arg & O_NONBLOCK) != 0;
+    return 0;
+  }
+  return -1;
+}
+
+uint64
+sys_poll(void)
+{
+  uint64 fds;
+  int nfds, timeout;
+
+  argaddr(0, &fds);
+  argint(1, &nfds);
+  argint(2, &timeout);
+  return poll(fds, nfds, timeout);
+}
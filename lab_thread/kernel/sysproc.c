@@ -5,6 +5,8 @@
 #include "memlayout.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "futex.h"
+#include "fcntl.h"
 
 uint64
 sys_exit(void)
@@ -42,8 +44,7 @@ sys_sbrk(void)
   int n;
 
   argint(0, &n);
-  addr = myproc()->sz;
-  if(growproc(n) < 0)
+  if(growproc(n, &addr) < 0)
     return -1;
   return addr;
 }
@@ -91,3 +92,103 @@ sys_uptime(void)
   release(&tickslock);
   return xticks;
 }
+
+uint64
+sys_clone(void)
+{
+  uint64 fn, arg, stack, ctid;
+
+  argaddr(0, &fn);
+  argaddr(1, &arg);
+  argaddr(2, &stack);
+  argaddr(3, &ctid);
+  return clone(fn, arg, stack, ctid);
+}
+
+uint64
+sys_futex(void)
+{
+  uint64 addr;
+  int op, val;
+
+  argaddr(0, &addr);
+  argint(1, &op);
+  argint(2, &val);
+  switch(op){
+  case FUTEX_WAIT:
+    return futexwait(addr, val);
+  case FUTEX_WAKE:
+    return futexwake(myproc()->mm, addr, val);
+  }
+  return -1;
+}
+
+// change the access to the pages in [addr, addr+len) to prot,
+// some of PROT_READ, PROT_WRITE and PROT_EXEC, or PROT_NONE.
+uint64
+sys_mprotect(void)
+{
+  uint64 addr;
+  int len, prot, perm, r;
+  uint64 n, sz;
+  struct proc *p = myproc();
+
+  argaddr(0, &addr);
+  argint(1, &len);
+  argint(2, &prot);
+  if(addr % PGSIZE != 0 || len < 0)
+    return -1;
+  perm = 0;
+  if(prot & PROT_READ)
+    perm |= PTE_R;
+  if(prot & PROT_WRITE)
+    perm |= PTE_R | PTE_W; // risc-v has no write-only pages
+  if(prot & PROT_EXEC)
+    perm |= PTE_X;
+
+  n = PGROUNDUP((uint64)len);
+  acquire(&p->mm->lock);
+  sz = PGROUNDUP(p->mm->sz);
+  // written so as not to wrap for addresses near the top.
+  if(addr >= sz || n > sz - addr)
+    r = -1;
+  else
+    r = uvmprotect(p->pagetable, addr, n, perm);
+  release(&p->mm->lock);
+  return r;
+}
+
+// call handler(frame) every interval ticks of user time;
+// interval 0 turns the alarm off.
+uint64
+sys_sigalarm(void)
+{
+  int interval;
+  uint64 handler;
+  struct proc *p = myproc();
+
+  argint(0, &interval);
+  argaddr(1, &handler);
+  if(interval < 0)
+    return -1;
+  p->alarm_interval = interval;
+  p->alarm_handler = handler;
+  p->alarm_ticks = 0;
+  return 0;
+}
+
+// resume the code an alarm interrupted, from the frame
+// alarmframe() pushed.
+uint64
+sys_sigreturn(void)
+{
+  uint64 frame;
+  struct proc *p = myproc();
+
+  argaddr(0, &frame);
+  // usertrapret() resets the kernel_* fields.
+  if(copyin(p->pagetable, (char *)p->trapframe, frame, sizeof(struct trapframe)) < 0)
+    return -1;
+  // syscall() stores the return value in a0.
+  return p->trapframe->a0;
+}
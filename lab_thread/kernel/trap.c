@@ -15,6 +15,7 @@ extern char trampoline[], uservec[], userret[];
 void kernelvec();
 
 extern int devintr();
+static int alarmframe(struct proc *);
 
 void
 trapinit(void)
@@ -65,6 +66,12 @@ usertrap(void)
     intr_on();
 
     syscall();
+  } else if(r_scause() == 2 && !p->fpon){
+    // illegal instruction: the first floating-point one,
+    // since FS is Off. retry it with zeroed FP registers.
+    memset(&p->fp, 0, sizeof(p->fp));
+    p->fpcpu = -1;
+    p->fpon = 1;
   } else if((which_dev = devintr()) != 0){
     // ok
   } else {
@@ -73,6 +80,15 @@ usertrap(void)
     setkilled(p);
   }
 
+  // call the sigalarm() handler every alarm_interval ticks
+  // of user time.
+  if(which_dev == 2 && p->alarm_interval > 0 &&
+     ++p->alarm_ticks >= p->alarm_interval){
+    p->alarm_ticks = 0;
+    if(alarmframe(p) < 0)
+      setkilled(p);
+  }
+
   if(killed(p))
     exit(-1);
 
@@ -83,6 +99,26 @@ usertrap(void)
   usertrapret();
 }
 
+// push a copy of the trapframe, holding the interrupted user
+// registers, on the user stack, and make the return to user
+// space call the alarm handler with a pointer to it. the
+// handler resumes the interrupted code with sigreturn(frame).
+// alarms stay on while the handler runs, so that it may
+// switch to another user thread before sigreturn().
+static int
+alarmframe(struct proc *p)
+{
+  uint64 sp;
+
+  sp = (p->trapframe->sp - sizeof(struct trapframe)) & ~0xfL;
+  if(copyout(p->pagetable, sp, (char *)p->trapframe, sizeof(struct trapframe)) < 0)
+    return -1;
+  p->trapframe->sp = sp;
+  p->trapframe->a0 = sp;
+  p->trapframe->epc = p->alarm_handler;
+  return 0;
+}
+
 //
 // return to user space
 //
@@ -114,6 +150,15 @@ usertrapret(void)
   unsigned long x = r_sstatus();
   x &= ~SSTATUS_SPP; // clear SPP to 0 for user mode
   x |= SSTATUS_SPIE; // enable interrupts in user mode
+  if(p->fpon){
+    // if this cpu still holds p's registers and p has written
+    // them since they were saved, leave FS Dirty so that
+    // fpsync() saves them. otherwise p->fp matches them.
+    if(fpload(p) || (x & SSTATUS_FS) != SSTATUS_FS_DIRTY)
+      x = (x & ~SSTATUS_FS) | SSTATUS_FS_CLEAN;
+  } else {
+    x &= ~SSTATUS_FS;
+  }
   w_sstatus(x);
 
   // set S Exception Program Counter to the saved user pc.
@@ -126,7 +171,7 @@ usertrapret(void)
   // switches to the user page table, restores user registers,
   // and switches to user mode with sret.
   uint64 trampoline_userret = TRAMPOLINE + (userret - trampoline);
-  ((void (*)(uint64))trampoline_userret)(satp);
+  ((void (*)(uint64, uint64))trampoline_userret)(satp, TRAPFRAME_SLOT(p->tfslot));
 }
 
 // interrupts and exceptions from kernel code go here via kernelvec,
@@ -167,6 +212,7 @@ clockintr()
   ticks++;
   wakeup(&ticks);
   release(&tickslock);
+  polltick();
 }
 
 // check if it's an external interrupt or software interrupt,
@@ -345,6 +345,35 @@ uvmclear(pagetable_t pagetable, uint64 va)
   *pte &= ~PTE_U;
 }
 
+// set the permissions of the user pages in [va, va+len),
+// va page-aligned, to perm, some of PTE_R, PTE_W and PTE_X.
+// perm 0 makes them inaccessible, like uvmclear().
+// returns -1, changing nothing, if a page isn't mapped.
+// this hart's TLB is flushed on the way back to user space;
+// other harts running threads of this page table may use
+// the old permissions until they next enter the kernel.
+int
+uvmprotect(pagetable_t pagetable, uint64 va, uint64 len, int perm)
+{
+  uint64 a;
+  pte_t *pte;
+
+  if(va >= MAXVA || len > MAXVA - va)
+    return -1;
+  for(a = va; a < va + len; a += PGSIZE){
+    if((pte = walk(pagetable, a, 0)) == 0 || (*pte & PTE_V) == 0)
+      return -1;
+  }
+  for(a = va; a < va + len; a += PGSIZE){
+    pte = walk(pagetable, a, 0);
+    if(perm)
+      *pte = (*pte & ~(PTE_R|PTE_W|PTE_X)) | perm | PTE_U;
+    else
+      *pte &= ~PTE_U;
+  }
+  return 0;
+}
+
 // Copy from kernel to user.
 // Copy len bytes from src to virtual address dstva in a given page table.
 // Return 0 on success, -1 on error.
@@ -352,12 +381,17 @@ int
 copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
 {
   uint64 n, va0, pa0;
+  pte_t *pte;
 
   while(len > 0){
     va0 = PGROUNDDOWN(dstva);
-    pa0 = walkaddr(pagetable, va0);
-    if(pa0 == 0)
+    if(va0 >= MAXVA)
+      return -1;
+    // mprotect() may have made the page read-only.
+    pte = walk(pagetable, va0, 0);
+    if(pte == 0 || (*pte & (PTE_V|PTE_U|PTE_W)) != (PTE_V|PTE_U|PTE_W))
       return -1;
+    pa0 = PTE2PA(*pte);
     n = PGSIZE - (dstva - va0);
     if(n > len)
       n = len;
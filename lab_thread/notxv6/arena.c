@@ -0,0 +1,165 @@
+//
+// per-thread bump arenas.
+//
+// A thread's cache for an arena holds the unused tail of
+// the chunk it is carving, and a free list threaded through
+// the first word of each freed object. Only refilling the
+// cache locks the arena: a thread takes the whole spare
+// list if there is one, and otherwise a new chunk.
+//
+// Objects are rounded up to a power of two, or to whole
+// cache lines, so none straddles a line it doesn't need.
+//
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <assert.h>
+#include <pthread.h>
+#include "arena.h"
+
+#define NARENA     8          // arenas in a program
+#define CHUNK      (64*1024)  // bytes carved at a time
+#define CACHELINE  64
+
+struct cache {
+  unsigned gen;         // the arena's gen when this was filled
+  char *next, *end;     // the rest of the current chunk
+  void *free;
+};
+
+static struct arena *arenas[NARENA];
+static int narena;                      // atomic
+static __thread struct cache caches[NARENA];
+
+void
+arena_init(struct arena *a, size_t size)
+{
+  size_t n = sizeof(void *);
+
+  while(n < size && n < CACHELINE)
+    n *= 2;
+  if(size > CACHELINE)
+    n = (size + CACHELINE - 1) / CACHELINE * CACHELINE;
+  assert(n <= CHUNK - CACHELINE);
+  a->size = n;
+  a->gen = 1;           // so that every thread's zeroed cache is stale
+  a->chunks = 0;
+  a->spare = 0;
+  pthread_mutex_init(&a->lock, 0);
+  a->id = __atomic_fetch_add(&narena, 1, __ATOMIC_RELAXED);
+  assert(a->id < NARENA);
+  arenas[a->id] = a;
+}
+
+// this thread's cache for a, emptied if a was reset since
+// the thread last used it.
+static struct cache *
+mycache(struct arena *a)
+{
+  struct cache *c = &caches[a->id];
+  unsigned gen = __atomic_load_n(&a->gen, __ATOMIC_ACQUIRE);
+
+  if(c->gen != gen){
+    c->gen = gen;
+    c->next = c->end = 0;
+    c->free = 0;
+  }
+  return c;
+}
+
+static void
+refill(struct arena *a, struct cache *c)
+{
+  char *chunk;
+
+  pthread_mutex_lock(&a->lock);
+  if(a->spare){
+    c->free = a->spare;
+    a->spare = 0;
+    pthread_mutex_unlock(&a->lock);
+    return;
+  }
+  chunk = aligned_alloc(CACHELINE, CHUNK);
+  assert(chunk);
+  // the chunk's first line links it into the arena's list.
+  *(void **)chunk = a->chunks;
+  a->chunks = chunk;
+  pthread_mutex_unlock(&a->lock);
+  c->next = chunk + CACHELINE;
+  c->end = chunk + CHUNK;
+}
+
+void *
+arena_alloc(struct arena *a)
+{
+  struct cache *c = mycache(a);
+  void *p;
+
+  for(;;){
+    if((p = c->free) != 0){
+      c->free = *(void **)p;
+      return p;
+    }
+    if(c->end - c->next >= (long)a->size){
+      p = c->next;
+      c->next += a->size;
+      return p;
+    }
+    refill(a, c);
+  }
+}
+
+// p may have come from any thread's cache.
+void
+arena_free(struct arena *a, void *p)
+{
+  struct cache *c = mycache(a);
+
+  *(void **)p = c->free;
+  c->free = p;
+}
+
+// hand this thread's free objects to their arenas' spare
+// lists. the unused tail of its chunks waits for a reset.
+void
+arena_thread_exit(void)
+{
+  int n = __atomic_load_n(&narena, __ATOMIC_RELAXED);
+  struct cache *c;
+  struct arena *a;
+  void **tail;
+
+  for(int i = 0; i < n && i < NARENA; i++){
+    c = &caches[i];
+    a = arenas[i];
+    if(c->free && c->gen == __atomic_load_n(&a->gen, __ATOMIC_ACQUIRE)){
+      for(tail = c->free; *tail; tail = *tail)
+        ;
+      pthread_mutex_lock(&a->lock);
+      *tail = a->spare;
+      a->spare = c->free;
+      pthread_mutex_unlock(&a->lock);
+    }
+    c->gen = 0;
+    c->next = c->end = 0;
+    c->free = 0;
+  }
+}
+
+// free every object a ever handed out. no thread may be
+// using a.
+void
+arena_reset(struct arena *a)
+{
+  void *chunk, *next;
+
+  pthread_mutex_lock(&a->lock);
+  for(chunk = a->chunks; chunk; chunk = next){
+    next = *(void **)chunk;
+    free(chunk);
+  }
+  a->chunks = 0;
+  a->spare = 0;
+  __atomic_add_fetch(&a->gen, 1, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&a->lock);
+}
@@ -0,0 +1,26 @@
+// per-thread bump allocation of small fixed-size objects.
+//
+// each thread carves objects out of its own chunk, and keeps
+// the objects it frees on its own free list, so neither
+// arena_alloc() nor arena_free() takes a lock in the common
+// case. memory goes back to the system only in arena_reset().
+// a thread that used an arena should call arena_thread_exit()
+// before it exits.
+
+#include <stddef.h>
+#include <pthread.h>
+
+struct arena {
+  size_t size;           // object size
+  int id;                // which of a thread's caches is this arena's
+  unsigned gen;          // atomic; bumped by arena_reset()
+  pthread_mutex_t lock;  // protects chunks and spare
+  void *chunks;          // every chunk carved so far
+  void *spare;           // free objects handed back by exited threads
+};
+
+void arena_init(struct arena *a, size_t size);
+void *arena_alloc(struct arena *a);
+void arena_free(struct arena *a, void *p);
+void arena_reset(struct arena *a);
+void arena_thread_exit(void);
@@ -3,9 +3,23 @@
 #include <stdio.h>
 #include <assert.h>
 #include <pthread.h>
+#include <string.h>
+#include <limits.h>
+#include <sched.h>
+#include <time.h>
+#include <stdint.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "topo.h"
+
+#define CACHELINE 64
+#define SPINLIMIT 1000  // spins before a waiter yields the CPU
+#define FANIN     4     // arrivals combined at each tree node
 
 static int nthread = 1;
 static int round = 0;
+static int nround = 20000;
+static int spinlimit;   // SPINLIMIT, or 0 if threads outnumber CPUs
 
 struct barrier {
   pthread_mutex_t barrier_mutex;
@@ -14,6 +28,11 @@ struct barrier {
   int round;     // Barrier round
 } bstate;
 
+// a flag or counter on a cache line of its own.
+struct padded {
+  int v;
+} __attribute__((aligned(CACHELINE)));
+
 static void
 barrier_init(void)
 {
@@ -22,7 +41,7 @@ barrier_init(void)
   bstate.nthread = 0;
 }
 
-static void 
+static void
 barrier()
 {
   // YOUR CODE HERE
@@ -33,7 +52,7 @@ barrier()
 
   pthread_mutex_lock(&bstate.barrier_mutex);   // zamknut zamok
   if (++bstate.nthread == nthread) {
-    
+
     ++bstate.round;       // zvysovanie poctu kol
     bstate.nthread = 0;   // vynulovanie nthread
 
@@ -45,7 +64,282 @@ barrier()
   }
   pthread_mutex_unlock(&bstate.barrier_mutex);    // odomkut zamok
 
-  
+
+}
+
+static void
+cond_wait(int id)
+{
+  barrier();
+}
+
+static void
+cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  asm volatile("yield");
+#endif
+}
+
+// one iteration of a spin loop. after spinlimit of them a
+// waiter yields; if threads outnumber CPUs, a spinning waiter
+// would only delay the thread it waits for, so it yields at
+// once.
+static void
+spin(int *spins)
+{
+  if (++*spins < spinlimit)
+    cpu_relax();
+  else
+    sched_yield();
+}
+
+// each thread's sense, flipped at every barrier, for the
+// sense-reversing barriers.
+static struct padded *sense;
+
+//
+// centralized sense-reversing barrier: the last thread to
+// decrement the count resets it and flips the shared sense,
+// which the others spin on.
+//
+
+static struct {
+  struct padded count;
+  struct padded sense;
+} central;
+
+static void
+central_init(void)
+{
+  central.count.v = nthread;
+  central.sense.v = 0;
+}
+
+static void
+central_wait(int id)
+{
+  int s = sense[id].v = !sense[id].v;
+  int spins = 0;
+
+  if (__atomic_sub_fetch(&central.count.v, 1, __ATOMIC_ACQ_REL) == 0) {
+    central.count.v = nthread;
+    __atomic_store_n(&central.sense.v, s, __ATOMIC_RELEASE);
+  } else {
+    while (__atomic_load_n(&central.sense.v, __ATOMIC_ACQUIRE) != s)
+      spin(&spins);
+  }
+}
+
+//
+// combining tree: threads arrive in groups of FANIN at the
+// leaves, and the last to arrive at a node goes on to its
+// parent. whoever completes the root flips its sense, and
+// each winner flips its own node's sense on the way back
+// down, so no line is shared by more than FANIN+1 threads.
+//
+
+struct tnode {
+  int count;
+  int k;                // arrivals expected
+  int sense;
+  struct tnode *parent;
+} __attribute__((aligned(CACHELINE)));
+
+static struct tnode *tree;
+
+static void
+tree_init(void)
+{
+  int width = (nthread + FANIN - 1) / FANIN, n = 0, base = 0, i;
+  int total = 0;
+
+  for (int w = width; ; w = (w + FANIN - 1) / FANIN) {
+    total += w;
+    if (w == 1)
+      break;
+  }
+  free(tree);
+  tree = aligned_alloc(CACHELINE, sizeof(struct tnode) * total);
+  memset(tree, 0, sizeof(struct tnode) * total);
+
+  // the leaves, then each level above them, root last.
+  for (i = 0; i < width; i++)
+    tree[i].k = i < width - 1 ? FANIN : nthread - FANIN * (width - 1);
+  n = width;
+  while (width > 1) {
+    int up = (width + FANIN - 1) / FANIN;
+    for (i = 0; i < width; i++) {
+      tree[base + i].parent = &tree[n + i / FANIN];
+      tree[n + i / FANIN].k++;
+    }
+    base = n;
+    n += up;
+    width = up;
+  }
+  for (i = 0; i < total; i++)
+    tree[i].count = tree[i].k;
+}
+
+static void
+tree_arrive(struct tnode *t, int s)
+{
+  int spins = 0;
+
+  if (__atomic_sub_fetch(&t->count, 1, __ATOMIC_ACQ_REL) == 0) {
+    if (t->parent)
+      tree_arrive(t->parent, s);
+    t->count = t->k;
+    __atomic_store_n(&t->sense, s, __ATOMIC_RELEASE);
+  } else {
+    while (__atomic_load_n(&t->sense, __ATOMIC_ACQUIRE) != s)
+      spin(&spins);
+  }
+}
+
+static void
+tree_wait(int id)
+{
+  int s = sense[id].v = !sense[id].v;
+
+  tree_arrive(&tree[id / FANIN], s);
+}
+
+//
+// dissemination barrier (Hensgen, Finkel and Manber): in
+// round r, thread i signals thread i + 2^r and waits for
+// thread i - 2^r, so after log2(n) rounds every thread has
+// heard from every other. the flags alternate between two
+// sets, and the sense flips every other barrier, so a flag
+// is never reset.
+//
+
+#define MAXROUND 16
+
+struct dthread {
+  int flags[2][MAXROUND];
+  int parity;
+  int sense;
+} __attribute__((aligned(CACHELINE)));
+
+static struct dthread *dissem;
+static int ndround;
+
+static void
+dissem_init(void)
+{
+  free(dissem);
+  dissem = aligned_alloc(CACHELINE, sizeof(struct dthread) * nthread);
+  memset(dissem, 0, sizeof(struct dthread) * nthread);
+  for (int i = 0; i < nthread; i++)
+    dissem[i].sense = 1;
+  for (ndround = 0; (1 << ndround) < nthread; ndround++)
+    ;
+  assert(ndround <= MAXROUND);
+}
+
+static void
+dissem_wait(int id)
+{
+  struct dthread *d = &dissem[id];
+  int p = d->parity, s = d->sense, spins;
+
+  for (int r = 0; r < ndround; r++) {
+    struct dthread *partner = &dissem[(id + (1 << r)) % nthread];
+    __atomic_store_n(&partner->flags[p][r], s, __ATOMIC_RELEASE);
+    spins = 0;
+    while (__atomic_load_n(&d->flags[p][r], __ATOMIC_ACQUIRE) != s)
+      spin(&spins);
+  }
+  if (p == 1)
+    d->sense = !s;
+  d->parity = 1 - p;
+}
+
+//
+// spin-then-futex: a centralized barrier whose waiters spin
+// on a generation number for spinlimit iterations, then sleep
+// on it in the kernel. the last arrival only makes a futex
+// call if someone went to sleep.
+//
+
+static struct {
+  struct padded count;
+  struct padded gen;
+  struct padded nsleep;
+} hybrid;
+
+static void
+hybrid_init(void)
+{
+  hybrid.count.v = nthread;
+  hybrid.gen.v = 0;
+  hybrid.nsleep.v = 0;
+}
+
+static void
+hybrid_wait(int id)
+{
+  int gen = __atomic_load_n(&hybrid.gen.v, __ATOMIC_ACQUIRE);
+
+  if (__atomic_sub_fetch(&hybrid.count.v, 1, __ATOMIC_ACQ_REL) == 0) {
+    hybrid.count.v = nthread;
+    __atomic_store_n(&hybrid.gen.v, gen + 1, __ATOMIC_SEQ_CST);
+    // pairs with the sleeper's increment before it checks gen.
+    if (__atomic_load_n(&hybrid.nsleep.v, __ATOMIC_SEQ_CST) > 0)
+      syscall(SYS_futex, &hybrid.gen.v, FUTEX_WAKE_PRIVATE, INT_MAX, 0, 0, 0);
+    return;
+  }
+  for (int spins = 0; spins < spinlimit; spins++) {
+    if (__atomic_load_n(&hybrid.gen.v, __ATOMIC_ACQUIRE) != gen)
+      return;
+    cpu_relax();
+  }
+  __atomic_add_fetch(&hybrid.nsleep.v, 1, __ATOMIC_SEQ_CST);
+  while (__atomic_load_n(&hybrid.gen.v, __ATOMIC_SEQ_CST) == gen)
+    syscall(SYS_futex, &hybrid.gen.v, FUTEX_WAIT_PRIVATE, gen, 0, 0, 0);
+  __atomic_sub_fetch(&hybrid.nsleep.v, 1, __ATOMIC_RELAXED);
+}
+
+static void
+noinit(void)
+{
+}
+
+struct algo {
+  char *name;
+  void (*init)(void);   // for nthread threads
+  void (*wait)(int id);
+} algos[] = {
+  { "cond",    noinit,       cond_wait },
+  { "central", central_init, central_wait },
+  { "tree",    tree_init,    tree_wait },
+  { "dissem",  dissem_init,  dissem_wait },
+  { "hybrid",  hybrid_init,  hybrid_wait },
+};
+#define NALGO (sizeof(algos) / sizeof(algos[0]))
+
+static struct algo *algo = &algos[0];
+static struct padded *seen;   // the round each thread is in
+static uint64_t *stamp;       // -B: when thread 0 left each barrier
+static int pin;               // -P: PIN_COMPACT or PIN_SCATTER
+static int verbose;           // -v: each thread's time in barriers
+
+// -B -v: what each thread saw, allocated on its own node.
+struct bstat {
+  uint64_t wait;        // ns spent in barriers
+  int cpu;
+};
+static struct bstat **bstats;
+
+static uint64_t
+nsec(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
 }
 
 static void *
@@ -55,39 +349,175 @@ thread(void *xa)
   long delay;
   int i;
 
-  for (i = 0; i < 20000; i++) {
+  topo_pin(n);
+  for (i = 0; i < nround; i++) {
     int t = bstate.round;
-    assert (i == t);
-    barrier();
+    if (algo->wait == cond_wait)
+      assert (i == t);
+    __atomic_store_n(&seen[n].v, i, __ATOMIC_RELAXED);
+    algo->wait(n);
+    // everyone has reached round i, and none can be past i+1.
+    for (int k = 0; k < nthread; k++) {
+      int s = __atomic_load_n(&seen[k].v, __ATOMIC_RELAXED);
+      assert(s == i || s == i + 1);
+    }
     usleep(random() % 100);
   }
 
   return 0;
 }
 
-int
-main(int argc, char *argv[])
+// -B: no delay or checks between barriers. thread 0 notes
+// the time it leaves each one, and with -v every thread
+// times its own waits.
+static void *
+bench_thread(void *xa)
 {
-  pthread_t *tha;
-  void *value;
-  long i;
-  double t1, t0;
+  long n = (long) xa;
+  struct bstat *st = 0;
+  uint64_t t;
 
-  if (argc < 2) {
-    fprintf(stderr, "%s: %s nthread\n", argv[0], argv[0]);
-    exit(-1);
+  topo_pin(n);
+  if (verbose)
+    st = bstats[n] = topo_alloc(sizeof(*st));
+  algo->wait(n);      // everyone has started
+  if (n == 0)
+    stamp[0] = nsec();
+  for (int i = 1; i <= nround; i++) {
+    if (st)
+      t = nsec();
+    algo->wait(n);
+    if (n == 0)
+      stamp[i] = nsec();
+    if (st)
+      st->wait += nsec() - t;
   }
-  nthread = atoi(argv[1]);
-  tha = malloc(sizeof(pthread_t) * nthread);
-  srandom(0);
+  if (st)
+    st->cpu = topo_cpu();
+  return 0;
+}
+
+static void
+start(void *(*fn)(void *))
+{
+  pthread_t *tha = malloc(sizeof(pthread_t) * nthread);
+  void *value;
+  long i;
 
+  memset(sense, 0, sizeof(struct padded) * nthread);
+  memset(seen, 0, sizeof(struct padded) * nthread);
   barrier_init();
+  bstate.round = 0;
+  spinlimit = nthread <= sysconf(_SC_NPROCESSORS_ONLN) ? SPINLIMIT : 0;
+  algo->init();
 
   for(i = 0; i < nthread; i++) {
-    assert(pthread_create(&tha[i], NULL, thread, (void *) i) == 0);
+    assert(pthread_create(&tha[i], NULL, fn, (void *) i) == 0);
   }
   for(i = 0; i < nthread; i++) {
     assert(pthread_join(tha[i], &value) == 0);
   }
+  free(tha);
+}
+
+static int
+cmp64(const void *a, const void *b)
+{
+  uint64_t x = *(uint64_t *) a, y = *(uint64_t *) b;
+  return x < y ? -1 : x > y;
+}
+
+// -B: rounds/sec and the spread of round times for each
+// algorithm, or just -a's, at 1..maxthread threads.
+static void
+bench(int maxthread, int all)
+{
+  uint64_t *d = malloc(sizeof(uint64_t) * nround);
+  double secs;
+
+  printf("%-8s %7s %12s %8s %8s %8s\n", "barrier", "threads",
+         "rounds/sec", "p50 ns", "p99 ns", "p999 ns");
+  for (int a = 0; a < NALGO; a++) {
+    if (!all && &algos[a] != algo)
+      continue;
+    algo = &algos[a];
+    for (nthread = 1; nthread <= maxthread; nthread++) {
+      start(bench_thread);
+      for (int i = 0; i < nround; i++)
+        d[i] = stamp[i + 1] - stamp[i];
+      secs = (stamp[nround] - stamp[0]) / 1e9;
+      qsort(d, nround, sizeof(d[0]), cmp64);
+      printf("%-8s %7d %12.0f %8lu %8lu %8lu\n", algo->name, nthread,
+             nround / secs, d[nround / 2], d[(long) nround * 99 / 100],
+             d[(long) nround * 999 / 1000]);
+      for (int i = 0; verbose && i < nthread; i++) {
+        printf("  thread %d: cpu %d node %d, %.0f ns/barrier waiting\n", i,
+               bstats[i]->cpu, topo_node(bstats[i]->cpu),
+               (double) bstats[i]->wait / nround);
+        topo_free(bstats[i], sizeof(struct bstat));
+      }
+    }
+  }
+  free(d);
+}
+
+static void
+usage(char *prog)
+{
+  fprintf(stderr, "usage: %s [-a cond|central|tree|dissem|hybrid] [-B] "
+          "[-r rounds]\n          [-P none|compact|scatter] [-v] nthread\n", prog);
+  exit(-1);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int c, bmode = 0, all = 1;
+
+  while ((c = getopt(argc, argv, "a:Br:P:v")) != -1) {
+    switch (c) {
+    case 'a':
+      for (algo = 0, c = 0; c < NALGO; c++)
+        if (strcmp(optarg, algos[c].name) == 0)
+          algo = &algos[c];
+      if (algo == 0)
+        usage(argv[0]);
+      all = 0;
+      break;
+    case 'B':
+      bmode = 1;
+      break;
+    case 'P':
+      if ((pin = topo_policy(optarg)) < 0)
+        usage(argv[0]);
+      break;
+    case 'v':
+      verbose = 1;
+      break;
+    case 'r':
+      nround = atoi(optarg);
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+  if (optind != argc - 1 || nround < 1)
+    usage(argv[0]);
+  nthread = atoi(argv[optind]);
+  if (nthread < 1)
+    usage(argv[0]);
+  sense = aligned_alloc(CACHELINE, sizeof(struct padded) * nthread);
+  seen = aligned_alloc(CACHELINE, sizeof(struct padded) * nthread);
+  stamp = malloc(sizeof(uint64_t) * (nround + 1));
+  bstats = malloc(sizeof(struct bstat *) * nthread);
+  srandom(0);
+  topo_init(pin);
+
+  if (bmode) {
+    bench(nthread, all);
+    exit(0);
+  }
+
+  start(thread);
   printf("OK; passed\n");
 }
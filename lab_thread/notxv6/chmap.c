@@ -0,0 +1,587 @@
+//
+// concurrent hash map.
+//
+// The table has a power-of-two number of buckets, each a
+// chain of entries pushed at the head. A put locks the
+// stripe that the key's hash picks; since the table has at
+// least NSTRIPE buckets, one stripe covers a fixed set of
+// buckets however large the table grows. It updates the
+// key's entry in place, or pushes a new one: an upsert, so
+// a key is never in the map twice.
+//
+// Gets lock nothing. Entries are only ever added at the
+// head of a chain, and an entry's key and next never change
+// once it's reachable, so a reader always sees a
+// consistent chain.
+//
+// When a stripe gets more than LOAD entries per bucket, the
+// table doubles. The new table takes over at once, and the
+// old one's buckets move over incrementally (puts find the
+// table pair through a seqcount, so a doubling takes no
+// stripe locks): a put moves
+// its own bucket before touching it, and also moves a few
+// more claimed from a shared cursor. A moved bucket is
+// marked MOVED, and its entries (copied into the new table)
+// are retired. Readers look in the old table while their
+// bucket there hasn't moved.
+//
+// Retired entries and tables are freed by epoch-based
+// reclamation: each thread announces the global epoch when
+// it starts an operation, and something retired in epoch e
+// is freed once every active thread has seen epoch e+2.
+//
+// Entries come from per-thread arenas, and go back to the
+// arena of the thread that frees them.
+//
+// A map made with CHMAP_PACKED chains 64-byte nodes of
+// NSLOT keys and values instead of one-entry nodes, so a
+// lookup usually reads the bucket pointer and one node, and
+// compares the node's keys at once. A node's slots fill in
+// order, each published by storing the node's count; only
+// the head node of a chain has free slots.
+//
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "chmap.h"
+#include "arena.h"
+
+#define NSTRIPE    64    // put locks, and the minimum table size
+#define LOAD       2     // entries per bucket before doubling
+#define LOADPACKED 4     // the same, for CHMAP_PACKED
+#define NSLOT      6     // entries per packed node
+#define NMIGRATE   8     // buckets a put helps move
+#define MAXTHREAD  128   // threads using maps at once
+#define NRETIRE    64    // retirements between attempts to free
+#define CACHELINE  64
+
+struct entry {
+  int key;
+  int value;            // atomic
+  struct entry *next;
+};
+
+struct node {
+  int key[NSLOT];
+  int n;                // slots in use; atomic
+  int pad;              // so the keys load as two vectors
+  int value[NSLOT];     // atomic
+  struct node *next;
+};
+
+_Static_assert(sizeof(struct node) == CACHELINE, "struct node");
+
+struct table {
+  uint64_t mask;        // nbuckets - 1
+  // while this is the old table: a stale helper can only
+  // claim buckets of the table it loaded, which it finds
+  // all claimed already.
+  uint64_t next;        // atomic; next bucket to claim
+  uint64_t nmoved;      // atomic; buckets claimed and moved
+  void *bucket[];        // chains of entries or of nodes
+};
+
+// marks a bucket of an old table whose entries have moved.
+static struct entry moved;
+#define MOVED ((void *)&moved)
+
+static struct arena entries, nodes;
+static pthread_once_t arenas_once = PTHREAD_ONCE_INIT;
+
+struct stripe {
+  pthread_mutex_t lock;
+  long count;           // entries whose hash picks this stripe
+} __attribute__((aligned(CACHELINE)));
+
+struct chmap {
+  struct table *cur;    // atomic
+  struct table *old;    // atomic; non-0 while buckets move
+  uint64_t rseq;        // atomic; odd while cur and old change
+  pthread_mutex_t resize;
+  int packed;
+  int load;             // entries per bucket before doubling
+  struct stripe stripe[NSTRIPE];
+};
+
+//
+// epoch-based reclamation, shared by all maps.
+//
+
+struct retired {
+  void *p;
+  struct arena *a;      // p's arena, or 0 if from malloc
+  uint64_t epoch;
+};
+
+struct ebr {
+  uint64_t epoch;       // atomic; the global epoch when active
+  int active;           // atomic
+  int used;
+  int nretired, maxretired, nsince;
+  struct retired *retired;
+} __attribute__((aligned(CACHELINE)));
+
+static uint64_t global_epoch = 2;
+static struct ebr threads[MAXTHREAD];
+static __thread struct ebr *self;
+
+static struct ebr *
+ebr_self(void)
+{
+  int i;
+
+  if(self)
+    return self;
+  for(i = 0; i < MAXTHREAD; i++){
+    int zero = 0;
+    if(__atomic_compare_exchange_n(&threads[i].used, &zero, 1, 0,
+                                   __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)){
+      self = &threads[i];
+      return self;
+    }
+  }
+  assert(0 && "chmap: too many threads");
+  return 0;
+}
+
+static void
+ebr_enter(void)
+{
+  struct ebr *e = ebr_self();
+
+  __atomic_store_n(&e->active, 1, __ATOMIC_RELAXED);
+  __atomic_store_n(&e->epoch, __atomic_load_n(&global_epoch, __ATOMIC_RELAXED),
+                   __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+static void
+ebr_leave(void)
+{
+  __atomic_store_n(&self->active, 0, __ATOMIC_RELEASE);
+}
+
+// advance the global epoch if every active thread has
+// seen the current one. returns the global epoch.
+static uint64_t
+ebr_advance(void)
+{
+  uint64_t g = __atomic_load_n(&global_epoch, __ATOMIC_SEQ_CST);
+
+  for(int i = 0; i < MAXTHREAD; i++){
+    if(__atomic_load_n(&threads[i].active, __ATOMIC_SEQ_CST) &&
+       __atomic_load_n(&threads[i].epoch, __ATOMIC_SEQ_CST) != g)
+      return g;
+  }
+  __atomic_compare_exchange_n(&global_epoch, &g, g + 1, 0,
+                              __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+  return __atomic_load_n(&global_epoch, __ATOMIC_SEQ_CST);
+}
+
+// free what no reader can still see.
+static void
+ebr_reclaim(struct ebr *e)
+{
+  uint64_t g = ebr_advance();
+  int i, n = 0;
+
+  for(i = 0; i < e->nretired; i++){
+    if(e->retired[i].epoch + 2 > g)
+      e->retired[n++] = e->retired[i];
+    else if(e->retired[i].a)
+      arena_free(e->retired[i].a, e->retired[i].p);
+    else
+      free(e->retired[i].p);
+  }
+  e->nretired = n;
+}
+
+// free p, from arena a or malloc if a is 0, once no thread
+// can be reading it. call inside an operation. never waits
+// for other threads, which may be waiting for a lock that
+// the caller holds.
+static void
+ebr_retire(void *p, struct arena *a)
+{
+  struct ebr *e = self;
+
+  if(++e->nsince >= NRETIRE){
+    e->nsince = 0;
+    ebr_reclaim(e);
+  }
+  if(e->nretired == e->maxretired){
+    e->maxretired = e->maxretired ? 2 * e->maxretired : NRETIRE;
+    e->retired = realloc(e->retired, e->maxretired * sizeof(e->retired[0]));
+    assert(e->retired);
+  }
+  e->retired[e->nretired].p = p;
+  e->retired[e->nretired].a = a;
+  e->retired[e->nretired].epoch = __atomic_load_n(&global_epoch, __ATOMIC_SEQ_CST);
+  e->nretired++;
+}
+
+void
+chmap_thread_exit(void)
+{
+  struct ebr *e = self;
+
+  if(e == 0)
+    return;
+  while(e->nretired > 0)
+    ebr_reclaim(e);
+  free(e->retired);
+  e->retired = 0;
+  e->maxretired = 0;
+  self = 0;
+  __atomic_store_n(&e->used, 0, __ATOMIC_RELEASE);
+  arena_thread_exit();
+}
+
+//
+// the map
+//
+
+static uint32_t
+hash(int key)
+{
+  uint32_t h = key;
+
+  // murmur3's finalizer
+  h ^= h >> 16;
+  h *= 0x85ebca6b;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35;
+  h ^= h >> 16;
+  return h;
+}
+
+static struct table *
+table_new(uint64_t n)
+{
+  struct table *t;
+
+  t = calloc(1, sizeof(*t) + n * sizeof(t->bucket[0]));
+  assert(t);
+  t->mask = n - 1;
+  return t;
+}
+
+static void
+arenas_init(void)
+{
+  arena_init(&entries, sizeof(struct entry));
+  arena_init(&nodes, sizeof(struct node));
+}
+
+struct chmap *
+chmap_new(int flags)
+{
+  struct chmap *m;
+
+  pthread_once(&arenas_once, arenas_init);
+  m = calloc(1, sizeof(*m));
+  assert(m);
+  m->cur = table_new(NSTRIPE);
+  m->packed = (flags & CHMAP_PACKED) != 0;
+  m->load = m->packed ? LOADPACKED : LOAD;
+  pthread_mutex_init(&m->resize, 0);
+  for(int i = 0; i < NSTRIPE; i++)
+    pthread_mutex_init(&m->stripe[i].lock, 0);
+  return m;
+}
+
+// free the chain at b now, or once no reader can see it.
+static void
+chain_free(struct chmap *m, void *b, int retire)
+{
+  struct arena *a = m->packed ? &nodes : &entries;
+  void *next;
+
+  for(; b; b = next){
+    next = m->packed ? (void *)((struct node *)b)->next
+                     : (void *)((struct entry *)b)->next;
+    if(retire)
+      ebr_retire(b, a);
+    else
+      arena_free(a, b);
+  }
+}
+
+// no thread may be using m.
+void
+chmap_free(struct chmap *m)
+{
+  struct table *tables[2] = { m->cur, m->old }, *t;
+  uint64_t i;
+
+  for(int k = 0; k < 2; k++){
+    if((t = tables[k]) == 0)
+      continue;
+    for(i = 0; i <= t->mask; i++){
+      if(t->bucket[i] != MOVED)
+        chain_free(m, t->bucket[i], 0);
+    }
+    free(t);
+  }
+  for(i = 0; i < NSTRIPE; i++)
+    pthread_mutex_destroy(&m->stripe[i].lock);
+  pthread_mutex_destroy(&m->resize);
+  free(m);
+}
+
+// a bit for each of nd's first n slots holding key. the
+// vector loads also read slots a put may be filling, and
+// throw them away; ThreadSanitizer can't see that they're
+// ignored, so it gets the scalar loop.
+static unsigned
+node_match(struct node *nd, int key, int n)
+{
+  unsigned hit;
+
+#if defined(__SSE2__) && !defined(__SANITIZE_THREAD__)
+  __m128i k = _mm_set1_epi32(key);
+  __m128i lo = _mm_loadu_si128((__m128i *)&nd->key[0]);
+  __m128i hi = _mm_loadu_si128((__m128i *)&nd->key[4]);
+  hit = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(lo, k))) |
+        _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(hi, k))) << 4;
+#else
+  hit = 0;
+  for(int i = 0; i < n; i++)
+    hit |= (unsigned)(nd->key[i] == key) << i;
+#endif
+  return hit & ((1u << n) - 1);
+}
+
+// the value of key in the chain b, or 0.
+static int *
+chain_find(struct chmap *m, void *b, int key)
+{
+  struct entry *e;
+  struct node *nd;
+  unsigned hit;
+
+  if(!m->packed){
+    for(e = b; e; e = e->next)
+      if(e->key == key)
+        return &e->value;
+    return 0;
+  }
+  for(nd = b; nd; nd = nd->next){
+    hit = node_match(nd, key, __atomic_load_n(&nd->n, __ATOMIC_ACQUIRE));
+    if(hit)
+      return &nd->value[__builtin_ctz(hit)];
+  }
+  return 0;
+}
+
+// add key, which isn't in the chain at *b, at its head.
+// the caller holds b's stripe.
+static void
+chain_add(struct chmap *m, void **b, int key, int value)
+{
+  struct entry *e;
+  struct node *nd = *b;
+  int i;
+
+  if(!m->packed){
+    e = arena_alloc(&entries);
+    e->key = key;
+    e->value = value;
+    e->next = *b;
+    __atomic_store_n(b, e, __ATOMIC_RELEASE);
+  } else if(nd && (i = nd->n) < NSLOT){
+    nd->key[i] = key;
+    nd->value[i] = value;
+    __atomic_store_n(&nd->n, i + 1, __ATOMIC_RELEASE);
+  } else {
+    nd = arena_alloc(&nodes);
+    nd->key[0] = key;
+    nd->value[0] = value;
+    nd->n = 1;
+    nd->next = *b;
+    __atomic_store_n(b, nd, __ATOMIC_RELEASE);
+  }
+}
+
+// move old bucket i into t. the caller holds i's stripe.
+static void
+move_bucket(struct chmap *m, struct table *old, struct table *t, uint64_t i)
+{
+  struct entry *e;
+  struct node *nd;
+  void *b;
+  int k, v;
+
+  b = __atomic_load_n(&old->bucket[i], __ATOMIC_ACQUIRE);
+  if(b == MOVED)
+    return;
+  if(!m->packed){
+    for(e = b; e; e = e->next){
+      v = __atomic_load_n(&e->value, __ATOMIC_RELAXED);
+      chain_add(m, &t->bucket[hash(e->key) & t->mask], e->key, v);
+    }
+  } else {
+    for(nd = b; nd; nd = nd->next){
+      for(k = 0; k < nd->n; k++){
+        v = __atomic_load_n(&nd->value[k], __ATOMIC_RELAXED);
+        chain_add(m, &t->bucket[hash(nd->key[k]) & t->mask], nd->key[k], v);
+      }
+    }
+  }
+  __atomic_store_n(&old->bucket[i], MOVED, __ATOMIC_RELEASE);
+  chain_free(m, b, 1);
+}
+
+// set cur and old together, as seen by tables().
+// the caller holds m->resize.
+static void
+set_tables(struct chmap *m, struct table *t, struct table *old)
+{
+  __atomic_fetch_add(&m->rseq, 1, __ATOMIC_SEQ_CST);
+  __atomic_store_n(&m->old, old, __ATOMIC_SEQ_CST);
+  __atomic_store_n(&m->cur, t, __ATOMIC_SEQ_CST);
+  __atomic_fetch_add(&m->rseq, 1, __ATOMIC_SEQ_CST);
+}
+
+// a consistent cur and old, for a put: never the half-made
+// pair in which the new old table is still cur.
+static void
+tables(struct chmap *m, struct table **t, struct table **old)
+{
+  uint64_t s;
+
+  do {
+    while((s = __atomic_load_n(&m->rseq, __ATOMIC_ACQUIRE)) & 1)
+      ;
+    *t = __atomic_load_n(&m->cur, __ATOMIC_ACQUIRE);
+    *old = __atomic_load_n(&m->old, __ATOMIC_ACQUIRE);
+  } while(__atomic_load_n(&m->rseq, __ATOMIC_ACQUIRE) != s);
+}
+
+// double the table t, unless another thread already has,
+// or the last doubling hasn't finished.
+static void
+grow(struct chmap *m, struct table *t)
+{
+  struct table *n;
+
+  pthread_mutex_lock(&m->resize);
+  if(m->cur == t && m->old == 0){
+    n = table_new(2 * (t->mask + 1));
+    set_tables(m, n, t);
+  }
+  pthread_mutex_unlock(&m->resize);
+}
+
+// move up to NMIGRATE buckets of the old table, and retire
+// it once all have moved.
+static void
+help_move(struct chmap *m)
+{
+  struct table *old, *t;
+  uint64_t i, n, k;
+
+  tables(m, &t, &old);
+  if(old == 0)
+    return;
+  n = old->mask + 1;
+  i = __atomic_fetch_add(&old->next, NMIGRATE, __ATOMIC_RELAXED);
+  if(i >= n)
+    return;
+  // old stays the old table, and t its successor, until
+  // the buckets just claimed are counted as moved.
+  for(k = i; k < i + NMIGRATE && k < n; k++){
+    struct stripe *s = &m->stripe[k & (NSTRIPE - 1)];
+    pthread_mutex_lock(&s->lock);
+    move_bucket(m, old, t, k);
+    pthread_mutex_unlock(&s->lock);
+  }
+  if(__atomic_add_fetch(&old->nmoved, k - i, __ATOMIC_ACQ_REL) == n){
+    pthread_mutex_lock(&m->resize);
+    set_tables(m, t, 0);
+    pthread_mutex_unlock(&m->resize);
+    ebr_retire(old, 0);
+  }
+}
+
+// insert key, or update its value if present.
+void
+chmap_put(struct chmap *m, int key, int value)
+{
+  uint32_t h = hash(key);
+  struct stripe *s = &m->stripe[h & (NSTRIPE - 1)];
+  struct table *t, *old;
+  void **b;
+  int *v, full;
+
+  ebr_enter();
+  pthread_mutex_lock(&s->lock);
+  // a put adding to a table that is becoming old is fine:
+  // its bucket can't move until the stripe is unlocked.
+  tables(m, &t, &old);
+  if(old)
+    move_bucket(m, old, t, h & old->mask);
+  b = &t->bucket[h & t->mask];
+  if((v = chain_find(m, *b, key)) != 0){
+    __atomic_store_n(v, value, __ATOMIC_RELEASE);
+    full = 0;
+  } else {
+    chain_add(m, b, key, value);
+    s->count++;
+    full = s->count > (long)((t->mask + 1) / NSTRIPE) * m->load;
+  }
+  pthread_mutex_unlock(&s->lock);
+
+  if(old)
+    help_move(m);
+  else if(full)
+    grow(m, t);
+  ebr_leave();
+}
+
+// returns 1 and sets *value if key is present.
+int
+chmap_get(struct chmap *m, int key, int *value)
+{
+  uint32_t h = hash(key);
+  struct table *t, *old;
+  void *b;
+  int *v;
+
+  ebr_enter();
+  for(;;){
+    // cur before old: a doubling publishes old first.
+    t = __atomic_load_n(&m->cur, __ATOMIC_ACQUIRE);
+    old = __atomic_load_n(&m->old, __ATOMIC_ACQUIRE);
+    if(old && old != t){
+      b = __atomic_load_n(&old->bucket[h & old->mask], __ATOMIC_ACQUIRE);
+      if(b != MOVED)
+        break;
+    }
+    b = __atomic_load_n(&t->bucket[h & t->mask], __ATOMIC_ACQUIRE);
+    if(b != MOVED)
+      break;
+    // t itself became the old table; look again.
+  }
+  v = chain_find(m, b, key);
+  if(v && value)
+    *value = __atomic_load_n(v, __ATOMIC_ACQUIRE);
+  ebr_leave();
+  return v != 0;
+}
+
+long
+chmap_size(struct chmap *m)
+{
+  long n = 0;
+
+  for(int i = 0; i < NSTRIPE; i++)
+    n += __atomic_load_n(&m->stripe[i].count, __ATOMIC_RELAXED);
+  return n;
+}
@@ -0,0 +1,17 @@
+// a concurrent hash map from int keys to int values.
+//
+// gets take no locks; puts lock one of a fixed set of
+// stripes. a thread that used a map should call
+// chmap_thread_exit() before it exits.
+
+struct chmap;
+
+// chmap_new() flags
+#define CHMAP_PACKED 1   // several entries to a cache line
+
+struct chmap *chmap_new(int flags);
+void chmap_free(struct chmap *m);
+void chmap_put(struct chmap *m, int key, int value);
+int chmap_get(struct chmap *m, int key, int *value);
+long chmap_size(struct chmap *m);
+void chmap_thread_exit(void);
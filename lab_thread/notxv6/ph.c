@@ -4,6 +4,13 @@
 #include <assert.h>
 #include <pthread.h>
 #include <sys/time.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <math.h>
+#include "chmap.h"
+#include "arena.h"
+#include "topo.h"
 
 #define NBUCKET 5
 #define NKEYS 100000
@@ -14,11 +21,55 @@ struct entry {
   struct entry *next;
 };
 struct entry *table[NBUCKET];
-int keys[NKEYS];
+int *keys;
+int nkeys = NKEYS;
 int nthread = 1;
+struct arena arena;   // the five-bucket table's entries
+
+// the table to run: -b picks the five-bucket table, -p
+// chmap's packed layout.
+enum { FIVEBUCKET, CHMAP, PACKED, NKIND };
+char *tname[NKIND] = { "5-bucket", "chmap", "packed" };
+int kind = CHMAP;
+struct chmap *map;
+int quiet;        // no "keys missing" lines
 
 pthread_mutex_t locks[NBUCKET];
 
+//
+// a workload (-m, -t) runs a mix of gets, inserts and updates
+// for a fixed time against a table preloaded with the keys,
+// instead of the puts-then-gets phases.
+//
+int workload;
+int pget = 100, pinsert, pupdate;   // the mix, in percent
+double seconds = 1;
+int zipf;                           // -d zipf: skewed key choice
+double theta = 0.99;
+int csv;                            // -o csv
+int pin;                            // -P: PIN_COMPACT or PIN_SCATTER
+char *pname[] = { "none", "compact", "scatter" };
+int verbose;                        // -v: per-thread throughput
+volatile int stop;
+
+// log-linear latency histogram: values below HSUB have their
+// own bucket, larger ones HSUB buckets per power of two, so a
+// bucket is at most 1/HSUB wider than the values in it.
+#define HSUB  16
+#define NHIST (60 * HSUB)
+
+// each thread allocates its own, so they're on its node.
+struct stats {
+  long ops;
+  int cpu;              // where the thread ended up
+  long hist[NHIST];
+};
+struct stats **stats;
+
+// zipf constants for nkeys and theta (Gray et al., "Quickly
+// generating billion-record synthetic databases").
+double zetan, zalpha, zeta;
+
 double
 now()
 {
@@ -27,17 +78,25 @@ now()
  return tv.tv_sec + tv.tv_usec / 1000000.0;
 }
 
-static void 
+static uint64_t
+nsec(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void
 insert(int key, int value, struct entry **p, struct entry *n)
 {
-  struct entry *e = malloc(sizeof(struct entry));
+  struct entry *e = arena_alloc(&arena);
   e->key = key;
   e->value = value;
   e->next = n;
   *p = e;
 }
 
-static 
+static
 void put(int key, int value)
 {
   int i = key % NBUCKET;
@@ -76,16 +135,61 @@ get(int key)
   return e;
 }
 
+// empty the five-bucket table.
+static void
+clear(void)
+{
+  for (int i = 0; i < NBUCKET; i++)
+    table[i] = 0;
+  arena_reset(&arena);
+}
+
+// start the selected table over, empty.
+static void
+reset(void)
+{
+  if (map)
+    chmap_free(map);
+  map = 0;
+  if (kind == FIVEBUCKET)
+    clear();
+  else
+    map = chmap_new(kind == PACKED ? CHMAP_PACKED : 0);
+}
+
+static void
+tput(int key, int value)
+{
+  if (kind == FIVEBUCKET)
+    put(key, value);
+  else
+    chmap_put(map, key, value);
+}
+
+static int
+tget(int key)
+{
+  int v;
+
+  if (kind == FIVEBUCKET)
+    return get(key) != 0;
+  return chmap_get(map, key, &v);
+}
+
 static void *
 put_thread(void *xa)
 {
   int n = (int) (long) xa; // thread number
-  int b = NKEYS/nthread;
+  // thread n puts keys [lo, hi); the first nkeys % nthread
+  // threads get one more than the rest.
+  int lo = (long) nkeys * n / nthread;
+  int hi = (long) nkeys * (n + 1) / nthread;
 
-  for (int i = 0; i < b; i++) {
-    put(keys[b*n + i], n);
-  }
+  topo_pin(n);
+  for (int i = lo; i < hi; i++)
+    tput(keys[i], n);
 
+  chmap_thread_exit();
   return NULL;
 }
 
@@ -95,66 +199,368 @@ get_thread(void *xa)
   int n = (int) (long) xa; // thread number
   int missing = 0;
 
-  for (int i = 0; i < NKEYS; i++) {
-    struct entry *e = get(keys[i]);
-    if (e == 0) missing++;
+  topo_pin(n);
+  for (int i = 0; i < nkeys; i++) {
+    if (!tget(keys[i]))
+      missing++;
+  }
+  if (!quiet)
+    printf("%d: %d keys missing\n", n, missing);
+  chmap_thread_exit();
+  return NULL;
+}
+
+static int
+hbucket(uint64_t v)
+{
+  int msb;
+
+  if (v < HSUB)
+    return v;
+  msb = 63 - __builtin_clzll(v);
+  if (msb >= 60 + 3)
+    return NHIST - 1;
+  return (msb - 3) * HSUB + ((v >> (msb - 4)) & (HSUB - 1));
+}
+
+// the smallest value that lands in bucket b.
+static uint64_t
+hvalue(int b)
+{
+  if (b < HSUB)
+    return b;
+  return (uint64_t) (HSUB + b % HSUB) << (b / HSUB - 1);
+}
+
+// the value below which a fraction p of h's samples lie.
+static uint64_t
+percentile(long *h, long total, double p)
+{
+  long want = (long) ceil(p * total), sum = 0;
+
+  for (int b = 0; b < NHIST; b++) {
+    sum += h[b];
+    if (sum >= want && sum > 0)
+      return hvalue(b);
+  }
+  return 0;
+}
+
+// xorshift64*: each thread has its own, so picking a key
+// shares nothing.
+static uint64_t
+rnd(uint64_t *s)
+{
+  *s ^= *s >> 12;
+  *s ^= *s << 25;
+  *s ^= *s >> 27;
+  return *s * 2685821657736338717ULL;
+}
+
+// uniform in [0, 1).
+static double
+rnd01(uint64_t *s)
+{
+  return (rnd(s) >> 11) * (1.0 / (1ULL << 53));
+}
+
+static void
+zipfinit(void)
+{
+  double zeta2 = 1 + pow(0.5, theta);
+
+  zetan = 0;
+  for (int i = 1; i <= nkeys; i++)
+    zetan += 1 / pow(i, theta);
+  zalpha = 1 / (1 - theta);
+  zeta = (1 - pow(2.0 / nkeys, 1 - theta)) / (1 - zeta2 / zetan);
+}
+
+// the index of a key to get or update; with -d zipf, index
+// 0 is the most popular. keys[] is random, so the popular
+// keys are spread over the table.
+static int
+pick(uint64_t *s)
+{
+  double u, uz;
+  long i;
+
+  if (!zipf)
+    return rnd(s) % nkeys;
+  u = rnd01(s);
+  uz = u * zetan;
+  if (uz < 1)
+    return 0;
+  if (uz < 1 + pow(0.5, theta))
+    return 1;
+  i = (long) (nkeys * pow(zeta * u - zeta + 1, zalpha));
+  return i < nkeys ? i : nkeys - 1;
+}
+
+static void *
+mix_thread(void *xa)
+{
+  int n = (int) (long) xa; // thread number
+  struct stats *st;
+  uint64_t s = 0x9e3779b97f4a7c15ULL * (n + 1);
+  uint64_t t0, t1;
+  int op;
+
+  topo_pin(n);
+  st = stats[n] = topo_alloc(sizeof(*st));
+  t0 = nsec();
+  while (!__atomic_load_n(&stop, __ATOMIC_RELAXED)) {
+    op = rnd(&s) % 100;
+    if (op < pget)
+      tget(keys[pick(&s)]);
+    else if (op < pget + pinsert)
+      tput(rnd(&s) & 0x7fffffff, n);   // almost surely a new key
+    else
+      tput(keys[pick(&s)], n);
+    t1 = nsec();
+    st->hist[hbucket(t1 - t0)]++;
+    st->ops++;
+    t0 = t1;
   }
-  printf("%d: %d keys missing\n", n, missing);
+  st->cpu = topo_cpu();
+  chmap_thread_exit();
   return NULL;
 }
 
+// run nthread threads of fn; returns the seconds taken.
+static double
+run(void *(*fn)(void *), pthread_t *tha)
+{
+  void *value;
+  double t0 = now();
+
+  for(int i = 0; i < nthread; i++) {
+    assert(pthread_create(&tha[i], NULL, fn, (void *) (long) i) == 0);
+  }
+  for(int i = 0; i < nthread; i++) {
+    assert(pthread_join(tha[i], &value) == 0);
+  }
+  return now() - t0;
+}
+
+// -c: puts/sec and gets/sec of every table at 1..maxthread
+// threads.
+static void
+compare(int maxthread, pthread_t *tha)
+{
+  double tp, tg;
+
+  quiet = 1;
+  printf("%-8s %7s %12s %12s\n", "table", "threads", "puts/sec", "gets/sec");
+  for (kind = 0; kind < NKIND; kind++) {
+    for (nthread = 1; nthread <= maxthread; nthread++) {
+      reset();
+      tp = run(put_thread, tha);
+      tg = run(get_thread, tha);
+      printf("%-8s %7d %12.0f %12.0f\n", tname[kind], nthread,
+             nkeys / tp, (double) nkeys * nthread / tg);
+    }
+  }
+}
+
+// one timed run of the workload on a freshly loaded table.
+static void
+mix(pthread_t *tha)
+{
+  static long h[NHIST];
+  long ops = 0;
+  double t, r, rmin = 0, rmax = 0;
+
+  reset();
+  run(put_thread, tha);
+
+  stop = 0;
+  for (int i = 0; i < nthread; i++)
+    assert(pthread_create(&tha[i], NULL, mix_thread, (void *) (long) i) == 0);
+  t = now();
+  usleep(seconds * 1000000);
+  __atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+  for (int i = 0; i < nthread; i++)
+    assert(pthread_join(tha[i], NULL) == 0);
+  t = now() - t;
+
+  memset(h, 0, sizeof(h));
+  for (int i = 0; i < nthread; i++) {
+    ops += stats[i]->ops;
+    for (int b = 0; b < NHIST; b++)
+      h[b] += stats[i]->hist[b];
+    r = stats[i]->ops / t;
+    if (i == 0 || r < rmin)
+      rmin = r;
+    if (i == 0 || r > rmax)
+      rmax = r;
+  }
+
+  if (csv) {
+    printf("%s,%d,%d,%s,%.2f,%d,%d,%d,%.3f,%ld,%.0f,%lu,%lu,%lu,%s,%.0f,%.0f\n",
+           tname[kind], nthread, nkeys,
+           zipf ? "zipf" : "uniform", zipf ? theta : 0.0,
+           pget, pinsert, pupdate, t, ops, ops / t,
+           percentile(h, ops, 0.50), percentile(h, ops, 0.99),
+           percentile(h, ops, 0.999), pname[pin], rmin, rmax);
+  } else {
+    printf("%-8s %7d %12.0f %8lu %8lu %8lu\n",
+           tname[kind], nthread, ops / t,
+           percentile(h, ops, 0.50), percentile(h, ops, 0.99),
+           percentile(h, ops, 0.999));
+    for (int i = 0; verbose && i < nthread; i++)
+      printf("  thread %d: cpu %d node %d, %.0f ops/sec\n", i,
+             stats[i]->cpu, topo_node(stats[i]->cpu), stats[i]->ops / t);
+  }
+  for (int i = 0; i < nthread; i++)
+    topo_free(stats[i], sizeof(struct stats));
+}
+
+static void
+usage(char *prog)
+{
+  fprintf(stderr, "Usage: %s [-b] [-p] [-c] [-s] [-k nkeys] [-d uniform|zipf[:theta]]\n"
+          "          [-m get,insert,update] [-t seconds] [-o csv]\n"
+          "          [-P none|compact|scatter] [-v] nthreads\n", prog);
+  exit(-1);
+}
+
 int
 main(int argc, char *argv[])
 {
   pthread_t *tha;
-  void *value;
   double t1, t0;
+  int cmp = 0, sweep = 0, maxthread, c;
 
-
-  if (argc < 2) {
-    fprintf(stderr, "Usage: %s nthreads\n", argv[0]);
+  while ((c = getopt(argc, argv, "bcpsvk:d:m:t:o:P:")) != -1) {
+    switch (c) {
+    case 'b':
+      kind = FIVEBUCKET;
+      break;
+    case 'p':
+      kind = PACKED;
+      break;
+    case 'c':
+      cmp = 1;
+      break;
+    case 's':
+      sweep = 1;
+      break;
+    case 'k':
+      nkeys = atoi(optarg);
+      break;
+    case 'd':
+      if (strncmp(optarg, "zipf", 4) == 0) {
+        zipf = 1;
+        if (optarg[4] == ':')
+          theta = atof(optarg + 5);
+      } else if (strcmp(optarg, "uniform") != 0) {
+        usage(argv[0]);
+      }
+      break;
+    case 'm':
+      workload = 1;
+      if (sscanf(optarg, "%d,%d,%d", &pget, &pinsert, &pupdate) != 3 ||
+          pget < 0 || pinsert < 0 || pupdate < 0 ||
+          pget + pinsert + pupdate != 100) {
+        fprintf(stderr, "%s: -m wants three percentages adding up to 100\n", argv[0]);
+        exit(-1);
+      }
+      break;
+    case 't':
+      workload = 1;
+      seconds = atof(optarg);
+      break;
+    case 'v':
+      verbose = 1;
+      break;
+    case 'P':
+      if ((pin = topo_policy(optarg)) < 0)
+        usage(argv[0]);
+      break;
+    case 'o':
+      if (strcmp(optarg, "csv") != 0)
+        usage(argv[0]);
+      csv = 1;
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+  if (optind != argc - 1)
+    usage(argv[0]);
+  if (zipf && (theta <= 0 || theta == 1 || nkeys < 2)) {
+    fprintf(stderr, "%s: zipf wants a theta > 0 other than 1\n", argv[0]);
     exit(-1);
   }
 
   for (int i = 0; i < NBUCKET; i++) {
     assert(pthread_mutex_init(&locks[i], NULL) == 0);
   }
+  arena_init(&arena, sizeof(struct entry));
+  topo_init(pin);
 
-  nthread = atoi(argv[1]);
+  nthread = atoi(argv[optind]);
+  if (nthread < 1 || nkeys < 1)
+    usage(argv[0]);
+  maxthread = nthread;
   tha = malloc(sizeof(pthread_t) * nthread);
+  keys = malloc(sizeof(int) * nkeys);
   srandom(0);
-  assert(NKEYS % nthread == 0);
-  for (int i = 0; i < NKEYS; i++) {
+  for (int i = 0; i < nkeys; i++) {
     keys[i] = random();
   }
 
+  if (workload || csv || sweep) {
+    workload = 1;
+    stats = malloc(sizeof(struct stats *) * maxthread);
+    if (zipf)
+      zipfinit();
+    quiet = 1;
+    if (csv) {
+      printf("table,threads,keys,dist,theta,get,insert,update,"
+             "seconds,ops,ops_per_sec,p50_ns,p99_ns,p999_ns,"
+             "pin,min_thread_ops_per_sec,max_thread_ops_per_sec\n");
+    } else {
+      printf("%d keys, %s", nkeys, zipf ? "zipf" : "uniform");
+      if (zipf)
+        printf(" %.2f", theta);
+      printf(", %d%% get %d%% insert %d%% update, %.1f s per run\n",
+             pget, pinsert, pupdate, seconds);
+      printf("%-8s %7s %12s %8s %8s %8s\n", "table", "threads", "ops/sec",
+             "p50 ns", "p99 ns", "p999 ns");
+    }
+    for (int k = cmp ? 0 : kind; k <= (cmp ? NKIND - 1 : kind); k++) {
+      kind = k;
+      for (nthread = sweep ? 1 : maxthread; nthread <= maxthread; nthread++)
+        mix(tha);
+    }
+    exit(0);
+  }
+
+  if (cmp) {
+    compare(nthread, tha);
+    exit(0);
+  }
+  reset();
+
   //
   // first the puts
   //
   t0 = now();
-  for(int i = 0; i < nthread; i++) {
-    assert(pthread_create(&tha[i], NULL, put_thread, (void *) (long) i) == 0);
-  }
-  for(int i = 0; i < nthread; i++) {
-    assert(pthread_join(tha[i], &value) == 0);
-  }
+  run(put_thread, tha);
   t1 = now();
 
   printf("%d puts, %.3f seconds, %.0f puts/second\n",
-         NKEYS, t1 - t0, NKEYS / (t1 - t0));
+         nkeys, t1 - t0, nkeys / (t1 - t0));
 
   //
   // now the gets
   //
   t0 = now();
-  for(int i = 0; i < nthread; i++) {
-    assert(pthread_create(&tha[i], NULL, get_thread, (void *) (long) i) == 0);
-  }
-  for(int i = 0; i < nthread; i++) {
-    assert(pthread_join(tha[i], &value) == 0);
-  }
+  run(get_thread, tha);
   t1 = now();
 
   printf("%d gets, %.3f seconds, %.0f gets/second\n",
-         NKEYS*nthread, t1 - t0, (NKEYS*nthread) / (t1 - t0));
+         nkeys*nthread, t1 - t0, ((double) nkeys*nthread) / (t1 - t0));
 }
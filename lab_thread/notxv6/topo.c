@@ -0,0 +1,205 @@
+//
+// CPU topology and thread placement.
+//
+// The topology comes from /sys/devices/system/cpu: each
+// cpuN/topology directory names the CPU's socket
+// (physical_package_id) and core, and a cpuN/nodeM link its
+// NUMA node. CPUs /sys doesn't describe count as a socket
+// and core of their own.
+//
+// There is no libnuma here. Memory lands on the node of the
+// thread that first touches it, so topo_alloc() maps fresh
+// pages and zeroes them from the calling thread.
+//
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include "topo.h"
+
+struct cpu {
+  int id;
+  int pkg;
+  int core;
+  int node;
+  int smt;              // rank among its core's siblings
+  int corerank;         // rank of its core within the socket
+};
+
+static struct cpu *cpus;
+static int ncpu;
+static int policy;
+
+static int
+readint(const char *fmt, int cpu, int dflt)
+{
+  char path[128];
+  FILE *f;
+  int v;
+
+  snprintf(path, sizeof(path), fmt, cpu);
+  if ((f = fopen(path, "r")) == 0)
+    return dflt;
+  if (fscanf(f, "%d", &v) != 1)
+    v = dflt;
+  fclose(f);
+  return v;
+}
+
+static int
+readnode(int cpu)
+{
+  char path[128];
+  struct dirent *d;
+  DIR *dir;
+  int node = 0;
+
+  snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+  if ((dir = opendir(path)) == 0)
+    return 0;
+  while ((d = readdir(dir)) != 0) {
+    if (strncmp(d->d_name, "node", 4) == 0 &&
+        d->d_name[4] >= '0' && d->d_name[4] <= '9') {
+      node = atoi(d->d_name + 4);
+      break;
+    }
+  }
+  closedir(dir);
+  return node;
+}
+
+static int
+bycompact(const void *a, const void *b)
+{
+  const struct cpu *x = a, *y = b;
+
+  if (x->pkg != y->pkg)
+    return x->pkg - y->pkg;
+  if (x->corerank != y->corerank)
+    return x->corerank - y->corerank;
+  return x->smt - y->smt;
+}
+
+static int
+byscatter(const void *a, const void *b)
+{
+  const struct cpu *x = a, *y = b;
+
+  if (x->smt != y->smt)
+    return x->smt - y->smt;
+  if (x->corerank != y->corerank)
+    return x->corerank - y->corerank;
+  return x->pkg - y->pkg;
+}
+
+int
+topo_policy(const char *name)
+{
+  if (strcmp(name, "none") == 0)
+    return PIN_NONE;
+  if (strcmp(name, "compact") == 0)
+    return PIN_COMPACT;
+  if (strcmp(name, "scatter") == 0)
+    return PIN_SCATTER;
+  return -1;
+}
+
+// learn the CPUs this process may use, in the order p
+// places threads on them.
+void
+topo_init(int p)
+{
+  cpu_set_t set;
+  int i, j;
+
+  policy = p;
+  if (policy == PIN_NONE)
+    return;
+  assert(sched_getaffinity(0, sizeof(set), &set) == 0);
+  cpus = calloc(CPU_SETSIZE, sizeof(struct cpu));
+  ncpu = 0;
+  for (i = 0; i < CPU_SETSIZE; i++) {
+    if (!CPU_ISSET(i, &set))
+      continue;
+    cpus[ncpu].id = i;
+    cpus[ncpu].pkg = readint("/sys/devices/system/cpu/cpu%d/topology/physical_package_id", i, i);
+    cpus[ncpu].core = readint("/sys/devices/system/cpu/cpu%d/topology/core_id", i, i);
+    cpus[ncpu].node = readnode(i);
+    ncpu++;
+  }
+  assert(ncpu > 0);
+
+  for (i = 0; i < ncpu; i++) {
+    for (j = 0; j < ncpu; j++) {
+      struct cpu *c = &cpus[j];
+      if (c->pkg != cpus[i].pkg)
+        continue;
+      if (c->core == cpus[i].core && c->id < cpus[i].id)
+        cpus[i].smt++;
+    }
+  }
+  // smt must be known for every CPU before ranking the cores.
+  for (i = 0; i < ncpu; i++) {
+    for (j = 0; j < ncpu; j++) {
+      struct cpu *c = &cpus[j];
+      if (c->pkg == cpus[i].pkg && c->smt == 0 && c->core < cpus[i].core)
+        cpus[i].corerank++;
+    }
+  }
+  qsort(cpus, ncpu, sizeof(cpus[0]), policy == PIN_COMPACT ? bycompact : byscatter);
+}
+
+// pin the calling thread as thread i. returns its CPU, or
+// -1 if not pinning.
+int
+topo_pin(int i)
+{
+  cpu_set_t set;
+
+  if (policy == PIN_NONE)
+    return -1;
+  CPU_ZERO(&set);
+  CPU_SET(cpus[i % ncpu].id, &set);
+  assert(pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0);
+  return cpus[i % ncpu].id;
+}
+
+// the CPU the calling thread is running on.
+int
+topo_cpu(void)
+{
+  return sched_getcpu();
+}
+
+int
+topo_node(int cpu)
+{
+  for (int i = 0; i < ncpu; i++)
+    if (cpus[i].id == cpu)
+      return cpus[i].node;
+  return readnode(cpu);
+}
+
+// n zeroed bytes, on the calling thread's node.
+void *
+topo_alloc(size_t n)
+{
+  void *p;
+
+  p = mmap(0, n, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  assert(p != MAP_FAILED);
+  memset(p, 0, n);
+  return p;
+}
+
+void
+topo_free(void *p, size_t n)
+{
+  munmap(p, n);
+}
@@ -0,0 +1,21 @@
+// CPU topology from /sys, and placing threads on it.
+//
+// a placement policy orders the CPUs this process may run
+// on, and thread i of a benchmark is pinned to the i'th
+// (modulo their number). compact fills the SMT siblings of
+// a core, then the cores of a socket, before moving on;
+// scatter puts consecutive threads on different sockets,
+// then on different cores, and doubles up on a core only
+// when every core has a thread.
+
+#include <stddef.h>
+
+enum { PIN_NONE, PIN_COMPACT, PIN_SCATTER };
+
+int topo_policy(const char *name);
+void topo_init(int policy);
+int topo_pin(int i);
+int topo_cpu(void);
+int topo_node(int cpu);
+void *topo_alloc(size_t n);
+void topo_free(void *p, size_t n);
@@ -0,0 +1,222 @@
+//
+// M:N thread benchmark.
+//
+// usage: mtbench [maxworkers [fibn [sortn]]]
+//
+// computes fib(fibn) (default 24) by spawning a thread
+// for each call down to a cutoff, and quicksorts sortn
+// (default 100000) random ints by spawning a thread for
+// one half of each partition, with 1, 2, ... maxworkers
+// (default 3, as many as qemu has CPUs) workers. reports
+// times and the speedup over one worker.
+//
+
+#include "kernel/types.h"
+#include "user/user.h"
+#include "user/mthread.h"
+
+#define FIB_CUTOFF  12
+#define SORT_CUTOFF 2048
+#define TIMEHZ      10000000  // the time CSR's rate
+
+//
+// fib
+//
+
+struct fibarg {
+  int n;
+  int r;
+};
+
+static int
+sfib(int n)
+{
+  return n < 2 ? n : sfib(n-1) + sfib(n-2);
+}
+
+static void
+pfib(void *arg)
+{
+  struct fibarg *a = arg;
+  struct fibarg x, y;
+  struct mthread *t;
+
+  if(a->n <= FIB_CUTOFF){
+    a->r = sfib(a->n);
+    return;
+  }
+  x.n = a->n - 1;
+  y.n = a->n - 2;
+  if((t = mthread_spawn(pfib, &x)) == 0){
+    pfib(&x);
+    pfib(&y);
+  } else {
+    pfib(&y);
+    mthread_join(t);
+  }
+  a->r = x.r + y.r;
+}
+
+//
+// quicksort
+//
+
+struct sortarg {
+  int *a;
+  int n;
+};
+
+static void
+ssort(int *a, int n)
+{
+  int i, j, p, x;
+
+  while(n > 1){
+    p = a[(n-1)/2];
+    for(i = 0, j = n - 1; ; i++, j--){
+      while(a[i] < p)
+        i++;
+      while(a[j] > p)
+        j--;
+      if(i >= j)
+        break;
+      x = a[i];
+      a[i] = a[j];
+      a[j] = x;
+    }
+    // recurse on the smaller side to bound the depth.
+    if(j + 1 < n - j - 1){
+      ssort(a, j + 1);
+      a += j + 1;
+      n -= j + 1;
+    } else {
+      ssort(a + j + 1, n - j - 1);
+      n = j + 1;
+    }
+  }
+}
+
+static void
+psort(void *arg)
+{
+  struct sortarg *s = arg;
+  struct sortarg l, r;
+  struct mthread *t;
+  int *a = s->a, n = s->n;
+  int i, j, p, x;
+
+  if(n <= SORT_CUTOFF){
+    ssort(a, n);
+    return;
+  }
+  p = a[(n-1)/2];
+  for(i = 0, j = n - 1; ; i++, j--){
+    while(a[i] < p)
+      i++;
+    while(a[j] > p)
+      j--;
+    if(i >= j)
+      break;
+    x = a[i];
+    a[i] = a[j];
+    a[j] = x;
+  }
+  l.a = a;
+  l.n = j + 1;
+  r.a = a + j + 1;
+  r.n = n - j - 1;
+  if((t = mthread_spawn(psort, &l)) == 0)
+    psort(&l);
+  psort(&r);
+  if(t)
+    mthread_join(t);
+}
+
+static void
+fill(int *a, int n)
+{
+  uint x = 1;
+
+  for(int i = 0; i < n; i++){
+    x = x * 1103515245 + 12345;
+    a[i] = x >> 1;
+  }
+}
+
+// print t/base as a decimal with two places.
+static void
+printratio(uint64 t, uint64 base)
+{
+  uint64 r = t ? base * 100 / t : 0;
+
+  printf("%d.%d%d", (int)(r / 100), (int)(r / 10 % 10), (int)(r % 10));
+}
+
+static void
+report(char *what, int nw, uint64 t, uint64 base, struct mthread_stats *st)
+{
+  printf("%s: %d workers, %d ms, speedup ", what, nw, (int)(t / (TIMEHZ / 1000)));
+  printratio(t, base);
+  printf(", %d threads, %d steals, %d parks\n", st->nspawn, st->nsteal, st->npark);
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct mthread_stats st;
+  struct fibarg f;
+  struct sortarg s;
+  uint64 t0, t, fbase = 0, sbase = 0;
+  int maxw = 3, fibn = 24, sortn = 100000, nw, i;
+  int *a;
+
+  if(argc > 1)
+    maxw = atoi(argv[1]);
+  if(argc > 2)
+    fibn = atoi(argv[2]);
+  if(argc > 3)
+    sortn = atoi(argv[3]);
+  if((a = malloc(sortn * sizeof(int))) == 0){
+    fprintf(2, "mtbench: out of memory\n");
+    exit(1);
+  }
+
+  for(nw = 1; nw <= maxw; nw++){
+    f.n = fibn;
+    t0 = rdtime();
+    if(mthread_run(nw, pfib, &f, &st) < 0){
+      fprintf(2, "mtbench: mthread_run failed\n");
+      exit(1);
+    }
+    t = rdtime() - t0;
+    if(f.r != sfib(fibn)){
+      fprintf(2, "mtbench: fib(%d) = %d is wrong\n", fibn, f.r);
+      exit(1);
+    }
+    if(nw == 1)
+      fbase = t;
+    report("fib", nw, t, fbase, &st);
+  }
+
+  for(nw = 1; nw <= maxw; nw++){
+    fill(a, sortn);
+    s.a = a;
+    s.n = sortn;
+    t0 = rdtime();
+    if(mthread_run(nw, psort, &s, &st) < 0){
+      fprintf(2, "mtbench: mthread_run failed\n");
+      exit(1);
+    }
+    t = rdtime() - t0;
+    for(i = 1; i < sortn; i++){
+      if(a[i-1] > a[i]){
+        fprintf(2, "mtbench: not sorted at %d\n", i);
+        exit(1);
+      }
+    }
+    if(nw == 1)
+      sbase = t;
+    report("sort", nw, t, sbase, &st);
+  }
+  exit(0);
+}
@@ -0,0 +1,484 @@
+//
+// M:N thread runtime.
+//
+// mthread_run() starts nworkers kernel threads (the caller
+// is worker 0, the rest come from pthread_create()), and
+// each runs a scheduler loop on its own stack. A worker
+// keeps its runnable threads in a Chase-Lev deque: it
+// pushes and pops at the bottom, newest first, while idle
+// workers steal the oldest from the top. A worker that
+// finds nothing to run or steal sleeps on a futex until
+// someone pushes work.
+//
+// A thread that blocks in mthread_join() or exits switches
+// to its worker's scheduler stack first, and the scheduler
+// then records it as waiting or finished. Doing that once
+// the thread's registers are saved means another worker
+// can never resume a thread that is still running.
+//
+// Each worker finds itself through the tp register, which
+// the kernel keeps per kernel thread and xv6 user code
+// otherwise leaves alone.
+//
+
+#include "kernel/types.h"
+#include "kernel/futex.h"
+#include "user/user.h"
+#include "user/pthread.h"
+#include "user/mthread.h"
+
+#define STACK_SIZE  8192
+#define DEQUE_MIN   256   // initial deque slots, a power of 2
+#define MAXWORKER   16
+#define NSPIN       64    // steal attempts before parking
+
+struct context {
+  uint64 ra;
+  uint64 sp;
+  uint64 s[12];
+};
+
+extern void thread_switch(struct context*, struct context*);
+
+struct mthread {
+  struct context context;
+  void (*fn)(void*);
+  void *arg;
+  int lock;                 // protects done and joiner
+  int done;
+  struct mthread *joiner;   // blocked in mthread_join()
+  struct mthread *next;     // on a worker's free list
+  char *stack;
+};
+
+// a deque's slots. a grown deque leaves the old array to
+// thieves that may still be reading it; it's freed when
+// the run ends.
+struct darray {
+  long size;
+  struct darray *old;
+  struct mthread *slot[];
+};
+
+// what a thread asks its worker to do after switching away.
+enum { NONE, JOIN, EXIT };
+
+struct worker {
+  int id;
+  struct context sched;     // the scheduler loop
+  struct mthread *cur;
+  int after;                // NONE, JOIN or EXIT
+  struct mthread *arg;      // the thread being joined
+  struct mthread *free;     // exited threads, for reuse
+  uint rand;
+  pthread_t pt;
+  struct mthread_stats st;
+
+  // Chase-Lev deque. top and bottom on separate cache
+  // lines from the fields above, which only this worker
+  // touches.
+  __attribute__((aligned(64))) long top;
+  long bottom;
+  struct darray *array;
+} __attribute__((aligned(64)));
+
+static struct worker *workers;
+static int nworkers;
+static struct mthread *root;
+static volatile int done;
+static int nidle;           // workers parked or about to park
+static int parkseq;         // futex word for parked workers
+
+static struct worker *
+self(void)
+{
+  struct worker *w;
+
+  // a thread may move to another worker at any
+  // thread_switch(); don't let the compiler
+  // reuse the value from before one.
+  asm volatile("mv %0, tp" : "=r" (w) : : "memory");
+  return w;
+}
+
+static void
+setself(struct worker *w)
+{
+  asm volatile("mv tp, %0" : : "r" (w));
+}
+
+static void
+lock(int *l)
+{
+  while(__sync_lock_test_and_set(l, 1) != 0)
+    ;
+}
+
+static void
+unlock(int *l)
+{
+  __sync_lock_release(l);
+}
+
+//
+// Chase-Lev deque, with the C11 orderings of Le et al.,
+// "Correct and Efficient Work-Stealing for Weak Memory
+// Models" (PPoPP 2013).
+//
+
+static struct darray *
+darray_alloc(long size)
+{
+  struct darray *a;
+
+  if((a = malloc(sizeof(*a) + size * sizeof(a->slot[0]))) == 0){
+    fprintf(2, "mthread: out of memory\n");
+    exit(1);
+  }
+  a->size = size;
+  a->old = 0;
+  return a;
+}
+
+// only the owner pushes.
+static void
+push(struct worker *w, struct mthread *t)
+{
+  long b, t0, i;
+  struct darray *a, *na;
+
+  b = __atomic_load_n(&w->bottom, __ATOMIC_RELAXED);
+  t0 = __atomic_load_n(&w->top, __ATOMIC_ACQUIRE);
+  a = __atomic_load_n(&w->array, __ATOMIC_RELAXED);
+  if(b - t0 > a->size - 1){
+    na = darray_alloc(2 * a->size);
+    for(i = t0; i < b; i++)
+      na->slot[i & (na->size - 1)] = a->slot[i & (a->size - 1)];
+    na->old = a;
+    __atomic_store_n(&w->array, na, __ATOMIC_RELEASE);
+    a = na;
+  }
+  __atomic_store_n(&a->slot[b & (a->size - 1)], t, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  __atomic_store_n(&w->bottom, b + 1, __ATOMIC_RELAXED);
+}
+
+// only the owner takes.
+static struct mthread *
+take(struct worker *w)
+{
+  long b, t0;
+  struct darray *a;
+  struct mthread *t;
+
+  b = __atomic_load_n(&w->bottom, __ATOMIC_RELAXED) - 1;
+  a = __atomic_load_n(&w->array, __ATOMIC_RELAXED);
+  __atomic_store_n(&w->bottom, b, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  t0 = __atomic_load_n(&w->top, __ATOMIC_RELAXED);
+  if(t0 > b){
+    // empty
+    __atomic_store_n(&w->bottom, b + 1, __ATOMIC_RELAXED);
+    return 0;
+  }
+  t = __atomic_load_n(&a->slot[b & (a->size - 1)], __ATOMIC_RELAXED);
+  if(t0 == b){
+    // the last one; race thieves for it.
+    if(!__atomic_compare_exchange_n(&w->top, &t0, t0 + 1, 0,
+                                    __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+      t = 0;
+    __atomic_store_n(&w->bottom, b + 1, __ATOMIC_RELAXED);
+  }
+  return t;
+}
+
+// any worker may steal. returns 0 if w looked empty or
+// another thief won.
+static struct mthread *
+steal(struct worker *w)
+{
+  long t0, b;
+  struct darray *a;
+  struct mthread *t;
+
+  t0 = __atomic_load_n(&w->top, __ATOMIC_ACQUIRE);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  b = __atomic_load_n(&w->bottom, __ATOMIC_ACQUIRE);
+  if(t0 >= b)
+    return 0;
+  a = __atomic_load_n(&w->array, __ATOMIC_ACQUIRE);
+  t = __atomic_load_n(&a->slot[t0 & (a->size - 1)], __ATOMIC_RELAXED);
+  if(!__atomic_compare_exchange_n(&w->top, &t0, t0 + 1, 0,
+                                  __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+    return 0;
+  return t;
+}
+
+//
+// parking. a worker counts itself idle, notes parkseq,
+// looks for work once more, and sleeps only if parkseq
+// hasn't moved. a worker that makes work bumps parkseq
+// if anyone is idle.
+//
+
+static void
+wakeworkers(int n)
+{
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if(__atomic_load_n(&nidle, __ATOMIC_RELAXED) > 0){
+    __atomic_fetch_add(&parkseq, 1, __ATOMIC_SEQ_CST);
+    futex(&parkseq, FUTEX_WAKE, n);
+  }
+}
+
+// make t runnable on w, and tell idle workers.
+static void
+ready(struct worker *w, struct mthread *t)
+{
+  push(w, t);
+  wakeworkers(1);
+}
+
+static struct mthread *
+findwork(struct worker *w)
+{
+  struct mthread *t;
+  int i, v;
+
+  if((t = take(w)) != 0)
+    return t;
+  for(i = 0; i < nworkers - 1; i++){
+    w->rand = w->rand * 1103515245 + 12345;
+    v = (w->rand >> 16) % nworkers;
+    if(v != w->id && (t = steal(&workers[v])) != 0){
+      w->st.nsteal++;
+      return t;
+    }
+  }
+  return 0;
+}
+
+static void
+park(struct worker *w)
+{
+  int seq, i;
+
+  __atomic_fetch_add(&nidle, 1, __ATOMIC_SEQ_CST);
+  seq = __atomic_load_n(&parkseq, __ATOMIC_SEQ_CST);
+  for(i = 0; i < nworkers; i++){
+    if(__atomic_load_n(&workers[i].top, __ATOMIC_SEQ_CST) <
+       __atomic_load_n(&workers[i].bottom, __ATOMIC_SEQ_CST))
+      break;
+  }
+  if(i == nworkers && !done){
+    w->st.npark++;
+    futex(&parkseq, FUTEX_WAIT, seq);
+  }
+  __atomic_fetch_sub(&nidle, 1, __ATOMIC_SEQ_CST);
+}
+
+// the scheduler loop of each worker.
+static void *
+workerloop(void *arg)
+{
+  struct worker *w = arg;
+  struct mthread *t, *j;
+  int spins = 0;
+
+  setself(w);
+  while(!done){
+    if((t = findwork(w)) == 0){
+      if(++spins >= NSPIN){
+        park(w);
+        spins = 0;
+      }
+      continue;
+    }
+    spins = 0;
+
+    w->cur = t;
+    w->after = NONE;
+    thread_switch(&w->sched, &t->context);
+    w->cur = 0;
+
+    // t's registers are saved; now it's safe to let
+    // another worker resume it.
+    if(w->after == JOIN){
+      lock(&w->arg->lock);
+      if(w->arg->done){
+        unlock(&w->arg->lock);
+        push(w, t);
+      } else {
+        w->arg->joiner = t;
+        unlock(&w->arg->lock);
+      }
+    } else if(w->after == EXIT){
+      if(t == root){
+        done = 1;
+        wakeworkers(nworkers);
+        break;
+      }
+      lock(&t->lock);
+      t->done = 1;
+      j = t->joiner;
+      unlock(&t->lock);
+      if(j)
+        ready(w, j);
+    }
+  }
+  return 0;
+}
+
+// switch from the current thread to the scheduler, which
+// carries out after once the thread's registers are saved.
+// the thread may come back on a different worker.
+static void
+toscheduler(int after, struct mthread *arg)
+{
+  struct worker *w = self();
+
+  w->after = after;
+  w->arg = arg;
+  thread_switch(&w->cur->context, &w->sched);
+}
+
+static void
+mthread_start(void)
+{
+  struct mthread *t = self()->cur;
+
+  t->fn(t->arg);
+  toscheduler(EXIT, 0);
+}
+
+static struct mthread *
+tcreate(struct worker *w, void (*fn)(void*), void *arg)
+{
+  struct mthread *t;
+
+  if((t = w->free) != 0){
+    w->free = t->next;
+  } else {
+    if((t = malloc(sizeof(*t))) == 0)
+      return 0;
+    if((t->stack = malloc(STACK_SIZE)) == 0){
+      free(t);
+      return 0;
+    }
+  }
+  memset(&t->context, 0, sizeof(t->context));
+  t->context.ra = (uint64)mthread_start;
+  t->context.sp = (uint64)(t->stack + STACK_SIZE) & ~15L;
+  t->fn = fn;
+  t->arg = arg;
+  t->lock = 0;
+  t->done = 0;
+  t->joiner = 0;
+  w->st.nspawn++;
+  return t;
+}
+
+static void
+tfree(struct worker *w, struct mthread *t)
+{
+  t->next = w->free;
+  w->free = t;
+}
+
+// start a thread running fn(arg). call from inside
+// mthread_run(). returns 0 if out of memory.
+struct mthread *
+mthread_spawn(void (*fn)(void*), void *arg)
+{
+  struct worker *w = self();
+  struct mthread *t;
+
+  if((t = tcreate(w, fn, arg)) != 0)
+    ready(w, t);
+  return t;
+}
+
+// wait for t to finish. each thread must be joined once,
+// by one other thread.
+void
+mthread_join(struct mthread *t)
+{
+  lock(&t->lock);
+  if(!t->done){
+    unlock(&t->lock);
+    toscheduler(JOIN, t);
+  } else {
+    unlock(&t->lock);
+  }
+  tfree(self(), t);
+}
+
+// which worker is running the calling thread.
+int
+mthread_worker(void)
+{
+  return self()->id;
+}
+
+// run fn(arg) as the first thread of nworkers workers, and
+// return once it finishes. returns -1 if the workers can't
+// be started.
+int
+mthread_run(int n, void (*fn)(void*), void *arg, struct mthread_stats *st)
+{
+  struct worker *w;
+  struct darray *a;
+  struct mthread *t;
+  int i;
+
+  if(n < 1 || n > MAXWORKER)
+    return -1;
+  // malloc() doesn't align to 64 bytes.
+  if((w = malloc((n + 1) * sizeof(*w))) == 0)
+    return -1;
+  workers = (struct worker*)(((uint64)w + 63) & ~63L);
+  memset(workers, 0, n * sizeof(*workers));
+  nworkers = n;
+  done = 0;
+  for(i = 0; i < n; i++){
+    workers[i].id = i;
+    workers[i].rand = i + 1;
+    workers[i].array = darray_alloc(DEQUE_MIN);
+  }
+
+  if((root = tcreate(&workers[0], fn, arg)) == 0)
+    return -1;
+  push(&workers[0], root);
+  for(i = 1; i < n; i++){
+    if(pthread_create(&workers[i].pt, 0, workerloop, &workers[i]) < 0){
+      fprintf(2, "mthread: cannot start worker %d\n", i);
+      exit(1);
+    }
+  }
+  workerloop(&workers[0]);
+  for(i = 1; i < n; i++)
+    pthread_join(workers[i].pt, 0);
+
+  if(st)
+    memset(st, 0, sizeof(*st));
+  for(i = 0; i < n; i++){
+    if(st){
+      st->nspawn += workers[i].st.nspawn;
+      st->nsteal += workers[i].st.nsteal;
+      st->npark += workers[i].st.npark;
+    }
+    while((a = workers[i].array) != 0){
+      workers[i].array = a->old;
+      free(a);
+    }
+    while((t = workers[i].free) != 0){
+      workers[i].free = t->next;
+      free(t->stack);
+      free(t);
+    }
+  }
+  free(root->stack);
+  free(root);
+  free(w);
+  return 0;
+}
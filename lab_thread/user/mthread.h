@@ -0,0 +1,16 @@
+// M:N threads: user-level threads run by a few kernel
+// threads (workers) that steal work from each other.
+// link with mthread.o and uthread_switch.o.
+
+struct mthread;
+
+struct mthread_stats {
+  int nspawn;   // threads created
+  int nsteal;   // threads taken from another worker
+  int npark;    // times a worker slept for want of work
+};
+
+int mthread_run(int, void (*)(void*), void*, struct mthread_stats*);
+struct mthread *mthread_spawn(void (*)(void*), void*);
+void mthread_join(struct mthread*);
+int mthread_worker(void);
@@ -0,0 +1,180 @@
+//
+// notxv6/ph.c, running on xv6 kernel threads.
+//
+// usage: ph nthreads
+//
+// fewer keys than the host version, since each get walks
+// a bucket's whole list and qemu is much slower.
+//
+
+#include "kernel/types.h"
+#include "user/user.h"
+#include "user/pthread.h"
+
+#define NBUCKET 5
+#define NKEYS 10000
+
+struct entry {
+  int key;
+  int value;
+  struct entry *next;
+};
+struct entry *table[NBUCKET];
+int keys[NKEYS];
+int nthread = 1;
+
+pthread_mutex_t locks[NBUCKET];
+
+static uint64 seed;
+
+static int
+random(void)
+{
+  seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+  return (seed >> 33) & 0x7fffffff;
+}
+
+static void 
+insert(int key, int value, struct entry **p, struct entry *n)
+{
+  struct entry *e = malloc(sizeof(struct entry));
+  e->key = key;
+  e->value = value;
+  e->next = n;
+  *p = e;
+}
+
+static 
+void put(int key, int value)
+{
+  int i = key % NBUCKET;
+
+  // is the key already present?
+  struct entry *e = 0;
+  for (e = table[i]; e != 0; e = e->next) {
+    if (e->key == key)
+      break;
+  }
+  if(e){
+    // update the existing key.
+    e->value = value;
+  } else {
+    // the key is new.
+    pthread_mutex_lock(&locks[i]);
+    insert(key, value, &table[i], table[i]);
+    pthread_mutex_unlock(&locks[i]);
+  }
+}
+
+static struct entry*
+get(int key)
+{
+  int i = key % NBUCKET;
+
+  struct entry *e = 0;
+  for (e = table[i]; e != 0; e = e->next) {
+    if (e->key == key) break;
+  }
+
+  return e;
+}
+
+static void *
+put_thread(void *xa)
+{
+  int n = (int) (long) xa; // thread number
+  int b = NKEYS/nthread;
+
+  for (int i = 0; i < b; i++) {
+    put(keys[b*n + i], n);
+  }
+
+  return 0;
+}
+
+// printf() writes a byte at a time, so main prints
+// the results rather than the threads.
+static void *
+get_thread(void *xa)
+{
+  int missing = 0;
+
+  for (int i = 0; i < NKEYS; i++) {
+    struct entry *e = get(keys[i]);
+    if (e == 0) missing++;
+  }
+  return (void *) (long) missing;
+}
+
+// ticks are about 1/10th of a second.
+static int
+persec(int n, int ticks)
+{
+  return ticks > 0 ? n * 10 / ticks : 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  pthread_t *tha;
+  void *value;
+  int t1, t0;
+
+  if (argc < 2) {
+    fprintf(2, "Usage: %s nthreads\n", argv[0]);
+    exit(1);
+  }
+
+  for (int i = 0; i < NBUCKET; i++) {
+    pthread_mutex_init(&locks[i], 0);
+  }
+
+  nthread = atoi(argv[1]);
+  if (nthread <= 0 || NKEYS % nthread != 0) {
+    fprintf(2, "ph: nthreads must divide %d\n", NKEYS);
+    exit(1);
+  }
+  tha = malloc(sizeof(pthread_t) * nthread);
+  seed = 0;
+  for (int i = 0; i < NKEYS; i++) {
+    keys[i] = random();
+  }
+
+  //
+  // first the puts
+  //
+  t0 = uptime();
+  for(int i = 0; i < nthread; i++) {
+    if (pthread_create(&tha[i], 0, put_thread, (void *) (long) i) < 0) {
+      fprintf(2, "ph: pthread_create failed\n");
+      exit(1);
+    }
+  }
+  for(int i = 0; i < nthread; i++) {
+    pthread_join(tha[i], &value);
+  }
+  t1 = uptime();
+
+  printf("%d puts, %d ticks, %d puts/second\n",
+         NKEYS, t1 - t0, persec(NKEYS, t1 - t0));
+
+  //
+  // now the gets
+  //
+  t0 = uptime();
+  for(int i = 0; i < nthread; i++) {
+    if (pthread_create(&tha[i], 0, get_thread, (void *) (long) i) < 0) {
+      fprintf(2, "ph: pthread_create failed\n");
+      exit(1);
+    }
+  }
+  for(int i = 0; i < nthread; i++) {
+    pthread_join(tha[i], &value);
+    printf("%d: %d keys missing\n", i, (int) (long) value);
+  }
+  t1 = uptime();
+
+  printf("%d gets, %d ticks, %d gets/second\n",
+         NKEYS*nthread, t1 - t0, persec(NKEYS*nthread, t1 - t0));
+  exit(0);
+}
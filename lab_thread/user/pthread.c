@@ -0,0 +1,104 @@
+//
+// pthread-lite: kernel threads from clone(), and mutexes
+// and join that sleep in futex() rather than spin.
+//
+
+#include "kernel/types.h"
+#include "kernel/futex.h"
+#include "user/user.h"
+#include "user/pthread.h"
+
+#define STACK_SIZE (4*4096)
+
+struct pthread {
+  int tid;              // the kernel clears it when the thread exits
+  void *(*fn)(void*);
+  void *arg;
+  void *ret;
+  char *stack;
+};
+
+static void
+pthread_start(void *a)
+{
+  struct pthread *t = a;
+
+  t->ret = t->fn(t->arg);
+  exit(0);
+}
+
+// attr is ignored.
+int
+pthread_create(pthread_t *tp, void *attr, void *(*fn)(void*), void *arg)
+{
+  struct pthread *t;
+  uint64 sp;
+
+  if((t = malloc(sizeof(*t))) == 0)
+    return -1;
+  if((t->stack = malloc(STACK_SIZE)) == 0){
+    free(t);
+    return -1;
+  }
+  t->fn = fn;
+  t->arg = arg;
+  t->ret = 0;
+  sp = (uint64)(t->stack + STACK_SIZE) & ~15L;
+  if(clone(pthread_start, t, (void*)sp, &t->tid) < 0){
+    free(t->stack);
+    free(t);
+    return -1;
+  }
+  *tp = t;
+  return 0;
+}
+
+// wait for t to exit, then free its stack.
+int
+pthread_join(pthread_t t, void **ret)
+{
+  int tid;
+
+  while((tid = __atomic_load_n(&t->tid, __ATOMIC_ACQUIRE)) != 0)
+    futex(&t->tid, FUTEX_WAIT, tid);
+  if(ret)
+    *ret = t->ret;
+  free(t->stack);
+  free(t);
+  return 0;
+}
+
+int
+pthread_mutex_init(pthread_mutex_t *m, void *attr)
+{
+  m->state = 0;
+  return 0;
+}
+
+// Drepper's "Futexes Are Tricky" mutex: unlock only
+// enters the kernel if some locker may be asleep.
+int
+pthread_mutex_lock(pthread_mutex_t *m)
+{
+  int c;
+
+  if((c = __sync_val_compare_and_swap(&m->state, 0, 1)) == 0)
+    return 0;
+  if(c != 2)
+    c = __atomic_exchange_n(&m->state, 2, __ATOMIC_ACQUIRE);
+  while(c != 0){
+    futex(&m->state, FUTEX_WAIT, 2);
+    c = __atomic_exchange_n(&m->state, 2, __ATOMIC_ACQUIRE);
+  }
+  return 0;
+}
+
+int
+pthread_mutex_unlock(pthread_mutex_t *m)
+{
+  if(__atomic_fetch_sub(&m->state, 1, __ATOMIC_RELEASE) != 1){
+    __atomic_store_n(&m->state, 0, __ATOMIC_RELEASE);
+    futex(&m->state, FUTEX_WAKE, 1);
+  }
+  return 0;
+}
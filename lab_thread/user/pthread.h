@@ -0,0 +1,16 @@
+// a small subset of POSIX threads, built on clone() and futex().
+// link with pthread.o (part of ULIB).
+
+typedef struct pthread *pthread_t;
+
+typedef struct {
+  int state;  // 0 unlocked, 1 locked, 2 locked and maybe waiters
+} pthread_mutex_t;
+
+#define PTHREAD_MUTEX_INITIALIZER { 0 }
+
+int pthread_create(pthread_t*, void*, void *(*)(void*), void*);
+int pthread_join(pthread_t, void**);
+int pthread_mutex_init(pthread_mutex_t*, void*);
+int pthread_mutex_lock(pthread_mutex_t*);
+int pthread_mutex_unlock(pthread_mutex_t*);
@@ -0,0 +1,102 @@
+//
+// uthread context-switch variants.
+//
+// usage: switchbench [switches]
+//
+// two threads take turns `switches` (default 100000) times
+// with thread_yield(), thread_yield_inline(), thread_yield()
+// between threads marked with thread_setfp() that keep a
+// running sum in floating point, and thread_switch_to().
+// reports cycles and nanoseconds per switch.
+//
+
+#include "kernel/types.h"
+#include "user/user.h"
+#include "user/uthread.h"
+
+#define NSPERTICK 100  // the time CSR runs at 10 MHz
+
+static int iters;
+static struct thread *peer[2];
+static int fpok = 1;
+
+static void
+yielder(void *arg)
+{
+  for(int i = 0; i < iters; i++)
+    thread_yield();
+}
+
+static void
+inliner(void *arg)
+{
+  for(int i = 0; i < iters; i++)
+    thread_yield_inline();
+}
+
+static void
+fpyielder(void *arg)
+{
+  double sum = 0, step = (int)(uint64)arg + 1;
+
+  for(int i = 0; i < iters; i++){
+    sum += step;
+    thread_yield();
+  }
+  if(sum != step * iters)
+    fpok = 0;
+}
+
+static void
+handoff(void *arg)
+{
+  struct thread *other = peer[1 - (int)(uint64)arg];
+
+  for(int i = 0; i < iters; i++)
+    thread_switch_to(other);
+}
+
+static void
+run(char *what, void (*fn)(void*), int fp)
+{
+  uint64 c0, t0, c, t;
+  int i;
+
+  for(i = 0; i < 2; i++){
+    if((peer[i] = thread_create(fn, (void*)(uint64)i)) == 0){
+      fprintf(2, "switchbench: thread_create failed\n");
+      exit(1);
+    }
+    if(fp)
+      thread_setfp(peer[i]);
+  }
+  c0 = rdcycle();
+  t0 = rdtime();
+  thread_join(peer[0]);
+  thread_join(peer[1]);
+  c = rdcycle() - c0;
+  t = rdtime() - t0;
+  printf("%s: %d switches, %d cycles/switch, %d ns/switch\n", what, 2 * iters,
+         (int)(c / (2 * iters)), (int)(t * NSPERTICK / (2 * iters)));
+}
+
+int
+main(int argc, char *argv[])
+{
+  iters = (argc > 1 ? atoi(argv[1]) : 100000) / 2;
+  if(iters <= 0){
+    fprintf(2, "usage: switchbench [switches]\n");
+    exit(1);
+  }
+
+  thread_init();
+  run("yield", yielder, 0);
+  run("inline", inliner, 0);
+  run("fp", fpyielder, 1);
+  if(!fpok){
+    fprintf(2, "switchbench: FP registers were lost\n");
+    exit(1);
+  }
+  run("switch_to", handoff, 0);
+  exit(0);
+}
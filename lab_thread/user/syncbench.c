@@ -0,0 +1,163 @@
+//
+// uthread handoff benchmark.
+//
+// usage: syncbench [rounds [bufsize]]
+//
+// two threads pass a token back and forth `rounds` (default
+// 100000) times through an unbuffered channel, a pair of
+// semaphores, and a mutex and condition variable; then a
+// producer sends `rounds` values to a consumer through a
+// channel of bufsize (default 16) slots. reports the time
+// per handoff, from the time CSR.
+//
+
+#include "kernel/types.h"
+#include "user/user.h"
+#include "user/uthread.h"
+
+#define NSPERTICK 100  // the time CSR runs at 10 MHz
+
+static int rounds;
+
+static struct tchan *ping, *pong;
+static struct tsem sping, spong;
+static struct tmutex mu;
+static struct tcond cv;
+static int turn;
+static uint64 sum;
+
+static void
+chanpong(void *arg)
+{
+  int v;
+
+  while(tchan_recv(ping, &v))
+    tchan_send(pong, &v);
+}
+
+static void
+sempong(void *arg)
+{
+  for(int i = 0; i < rounds; i++){
+    tsem_down(&sping);
+    tsem_up(&spong);
+  }
+}
+
+static void
+condpong(void *arg)
+{
+  tmutex_lock(&mu);
+  for(int i = 0; i < rounds; i++){
+    while(turn != 1)
+      tcond_wait(&cv, &mu);
+    turn = 0;
+    tcond_signal(&cv);
+  }
+  tmutex_unlock(&mu);
+}
+
+static void
+consumer(void *arg)
+{
+  int v;
+
+  while(tchan_recv(ping, &v))
+    sum += v;
+}
+
+static void
+report(char *what, uint64 t, int handoffs)
+{
+  printf("%s: %d handoffs, %d ns/handoff\n", what, handoffs,
+         (int)(t * NSPERTICK / handoffs));
+}
+
+static struct thread *
+spawn(void (*fn)(void*))
+{
+  struct thread *t;
+
+  if((t = thread_create(fn, 0)) == 0){
+    fprintf(2, "syncbench: thread_create failed\n");
+    exit(1);
+  }
+  return t;
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct thread *t;
+  int bufsize = 16, i, v;
+  uint64 t0;
+
+  rounds = argc > 1 ? atoi(argv[1]) : 100000;
+  if(argc > 2)
+    bufsize = atoi(argv[2]);
+  if(rounds <= 0 || bufsize < 0){
+    fprintf(2, "usage: syncbench [rounds [bufsize]]\n");
+    exit(1);
+  }
+  thread_init();
+
+  ping = tchan_make(0, sizeof(int));
+  pong = tchan_make(0, sizeof(int));
+  t = spawn(chanpong);
+  t0 = rdtime();
+  for(i = 0; i < rounds; i++){
+    tchan_send(ping, &i);
+    tchan_recv(pong, &v);
+  }
+  t0 = rdtime() - t0;
+  tchan_close(ping);
+  thread_join(t);
+  tchan_free(ping);
+  tchan_free(pong);
+  report("channel ping-pong", t0, 2 * rounds);
+
+  tsem_init(&sping, 0);
+  tsem_init(&spong, 0);
+  t = spawn(sempong);
+  t0 = rdtime();
+  for(i = 0; i < rounds; i++){
+    tsem_up(&sping);
+    tsem_down(&spong);
+  }
+  t0 = rdtime() - t0;
+  thread_join(t);
+  report("semaphore ping-pong", t0, 2 * rounds);
+
+  tmutex_init(&mu);
+  tcond_init(&cv);
+  t = spawn(condpong);
+  t0 = rdtime();
+  tmutex_lock(&mu);
+  for(i = 0; i < rounds; i++){
+    turn = 1;
+    tcond_signal(&cv);
+    while(turn != 0)
+      tcond_wait(&cv, &mu);
+  }
+  tmutex_unlock(&mu);
+  t0 = rdtime() - t0;
+  thread_join(t);
+  report("condvar ping-pong", t0, 2 * rounds);
+
+  ping = tchan_make(bufsize, sizeof(int));
+  t = spawn(consumer);
+  t0 = rdtime();
+  for(i = 0; i < rounds; i++)
+    tchan_send(ping, &i);
+  tchan_close(ping);
+  thread_join(t);
+  t0 = rdtime() - t0;
+  tchan_free(ping);
+  if(sum != (uint64)rounds * (rounds - 1) / 2){
+    fprintf(2, "syncbench: consumer lost values\n");
+    exit(1);
+  }
+  printf("producer/consumer (%d slots): %d values, %d ns/value\n",
+         bufsize, rounds, (int)(t0 * NSPERTICK / rounds));
+  exit(0);
+}
@@ -2,6 +2,7 @@
 #include "kernel/stat.h"
 #include "user/user.h"
 #include "kernel/param.h"
+#include "user/pthread.h"
 
 // Memory allocator by Kernighan and Ritchie,
 // The C programming Language, 2nd ed.  Section 8.7.
@@ -20,9 +21,10 @@ typedef union header Header;
 
 static Header base;
 static Header *freep;
+static pthread_mutex_t lock; // threads share the free list
 
-void
-free(void *ap)
+static void
+bfree(void *ap)
 {
   Header *bp, *p;
 
@@ -56,10 +58,18 @@ morecore(uint nu)
     return 0;
   hp = (Header*)p;
   hp->s.size = nu;
-  free((void*)(hp + 1));
+  bfree((void*)(hp + 1));
   return freep;
 }
 
+void
+free(void *ap)
+{
+  pthread_mutex_lock(&lock);
+  bfree(ap);
+  pthread_mutex_unlock(&lock);
+}
+
 void*
 malloc(uint nbytes)
 {
@@ -67,6 +77,7 @@ malloc(uint nbytes)
   uint nunits;
 
   nunits = (nbytes + sizeof(Header) - 1)/sizeof(Header) + 1;
+  pthread_mutex_lock(&lock);
   if((prevp = freep) == 0){
     base.s.ptr = freep = prevp = &base;
     base.s.size = 0;
@@ -81,10 +92,13 @@ malloc(uint nbytes)
         p->s.size = nunits;
       }
       freep = prevp;
+      pthread_mutex_unlock(&lock);
       return (void*)(p + 1);
     }
     if(p == freep)
-      if((p = morecore(nunits)) == 0)
+      if((p = morecore(nunits)) == 0){
+        pthread_mutex_unlock(&lock);
         return 0;
+      }
   }
 }
@@ -1,4 +1,6 @@
 struct stat;
+struct sigframe;
+struct pollfd;
 
 // system calls
 int fork(void);
@@ -22,6 +24,13 @@ int getpid(void);
 char* sbrk(int);
 int sleep(int);
 int uptime(void);
+int clone(void (*)(void*), void*, void*, int*);
+int futex(int*, int, int);
+int mprotect(void*, int, int);
+int sigalarm(int, void (*)(struct sigframe*));
+int sigreturn(struct sigframe*);
+int fcntl(int, int, int);
+int poll(struct pollfd*, int, int);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -38,4 +47,6 @@ void* malloc(uint);
 void free(void*);
 int atoi(const char*);
 int memcmp(const void *, const void *, uint);
+uint64 rdtime(void);
+uint64 rdcycle(void);
 void *memcpy(void *, const void *, uint);
@@ -7,6 +7,8 @@
 #include "kernel/syscall.h"
 #include "kernel/memlayout.h"
 #include "kernel/riscv.h"
+#include "kernel/poll.h"
+#include "user/pthread.h"
 
 //
 // Tests xv6 system calls.  usertests without arguments runs them all
@@ -675,6 +677,59 @@ void dirtest(char *s)
   }
 }
 
+static void *
+joinexec_thread(void *arg)
+{
+  return arg;
+}
+
+// once pthread_join() returns, the thread must no longer
+// count as a user of the address space: exec() and a
+// shrinking sbrk() refuse while other threads run.
+void
+joinexec(char *s)
+{
+  char *echoargv[] = { "echo", "OK", 0 };
+  pthread_t t;
+  int i, pid, xstatus;
+
+  for(i = 0; i < 20; i++){
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      if(sbrk(4096) == (char*)-1)
+        exit(1);
+      if(pthread_create(&t, 0, joinexec_thread, 0) < 0){
+        printf("%s: pthread_create failed\n", s);
+        exit(1);
+      }
+      pthread_join(t, 0);
+      if(sbrk(-4096) == (char*)-1){
+        printf("%s: sbrk(-4096) failed after join\n", s);
+        exit(1);
+      }
+      if(pthread_create(&t, 0, joinexec_thread, 0) < 0){
+        printf("%s: pthread_create failed\n", s);
+        exit(1);
+      }
+      pthread_join(t, 0);
+      close(1);
+      if(open("joinexec.out", O_CREATE|O_WRONLY) != 1)
+        exit(1);
+      exec("echo", echoargv);
+      fprintf(2, "%s: exec failed after join\n", s);
+      exit(1);
+    }
+    wait(&xstatus);
+    unlink("joinexec.out");
+    if(xstatus != 0)
+      exit(xstatus);
+  }
+}
+
 void
 exectest(char *s)
 {
@@ -2263,6 +2318,149 @@ sbrkarg(char *s)
   } 
 }
 
+// mprotect() a page read-only, then inaccessible.
+void
+mprotecttest(char *s)
+{
+  char *a;
+  int fds[2], xstatus;
+  uint64 pad;
+
+  // a page-aligned page at the end of memory.
+  pad = PGSIZE - (uint64)sbrk(0) % PGSIZE;
+  a = sbrk(pad + PGSIZE) + pad;
+  a[0] = 'x';
+  if(mprotect(a, PGSIZE, PROT_READ) < 0){
+    printf("%s: mprotect failed\n", s);
+    exit(1);
+  }
+  if(a[0] != 'x'){
+    printf("%s: lost contents\n", s);
+    exit(1);
+  }
+
+  // the kernel mustn't write to it either.
+  if(pipe(fds) < 0){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  write(fds[1], "y", 1);
+  if(read(fds[0], a, 1) != -1){
+    printf("%s: read() into read-only page succeeded\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+
+  for(int prot = PROT_READ; prot >= PROT_NONE; prot--){
+    int pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      if(prot == PROT_NONE){
+        mprotect(a, PGSIZE, PROT_NONE);
+        printf("%s: read %x from inaccessible page\n", s, a[0]);
+      } else {
+        a[0] = 'z';
+        printf("%s: wrote to read-only page\n", s);
+      }
+      exit(1);
+    }
+    wait(&xstatus);
+    if(xstatus != -1)  // did kernel kill child?
+      exit(1);
+  }
+
+  if(mprotect(a, PGSIZE, PROT_READ|PROT_WRITE) < 0){
+    printf("%s: mprotect failed\n", s);
+    exit(1);
+  }
+  a[0] = 'w';
+  if(mprotect(a + PGSIZE, PGSIZE, PROT_READ) != -1){
+    printf("%s: mprotect beyond sz succeeded\n", s);
+    exit(1);
+  }
+}
+
+// O_NONBLOCK pipes, and poll() on them.
+void
+polltest(char *s)
+{
+  struct pollfd pfd[2];
+  char buf[64];
+  int fds[2], n, t0;
+
+  if(pipe(fds) < 0){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  fcntl(fds[0], F_SETFL, O_NONBLOCK);
+  fcntl(fds[1], F_SETFL, O_NONBLOCK);
+  if(fcntl(fds[0], F_GETFL, 0) != O_NONBLOCK){
+    printf("%s: F_GETFL lost O_NONBLOCK\n", s);
+    exit(1);
+  }
+  if(read(fds[0], buf, 1) != -EAGAIN){
+    printf("%s: read of empty pipe didn't return -EAGAIN\n", s);
+    exit(1);
+  }
+
+  pfd[0].fd = fds[0];
+  pfd[0].events = POLLIN;
+  pfd[1].fd = fds[1];
+  pfd[1].events = POLLOUT;
+  if(poll(pfd, 2, 0) != 1 || pfd[0].revents != 0 || pfd[1].revents != POLLOUT){
+    printf("%s: empty pipe: wrong revents %x %x\n", s, pfd[0].revents, pfd[1].revents);
+    exit(1);
+  }
+  t0 = uptime();
+  if(poll(pfd, 1, 2) != 0 || uptime() - t0 < 2){
+    printf("%s: poll() didn't time out\n", s);
+    exit(1);
+  }
+
+  // fill the pipe without blocking.
+  for(n = 0; write(fds[1], buf, sizeof(buf)) > 0; n++)
+    ;
+  if(n == 0 || write(fds[1], buf, 1) != -EAGAIN){
+    printf("%s: write to full pipe didn't return -EAGAIN\n", s);
+    exit(1);
+  }
+  if(poll(pfd, 2, -1) != 1 || pfd[0].revents != POLLIN || pfd[1].revents != 0){
+    printf("%s: full pipe: wrong revents %x %x\n", s, pfd[0].revents, pfd[1].revents);
+    exit(1);
+  }
+
+  // a writer in another process wakes a blocked poll().
+  while(read(fds[0], buf, sizeof(buf)) > 0)
+    ;
+  if(fork() == 0){
+    sleep(2);
+    write(fds[1], "x", 1);
+    exit(0);
+  }
+  if(poll(pfd, 1, -1) != 1 || pfd[0].revents != POLLIN){
+    printf("%s: poll() missed a write\n", s);
+    exit(1);
+  }
+  wait(0);
+
+  close(fds[1]);
+  read(fds[0], buf, sizeof(buf));
+  if(poll(pfd, 1, 0) != 1 || pfd[0].revents != (POLLIN|POLLHUP)){
+    printf("%s: closed pipe: wrong revents %x\n", s, pfd[0].revents);
+    exit(1);
+  }
+  pfd[1].fd = fds[1];
+  if(poll(&pfd[1], 1, 0) != 1 || pfd[1].revents != POLLNVAL){
+    printf("%s: closed fd: wrong revents %x\n", s, pfd[1].revents);
+    exit(1);
+  }
+  close(fds[0]);
+}
+
 void
 validatetest(char *s)
 {
@@ -2593,6 +2791,7 @@ struct test {
   {createtest, "createtest"},
   {dirtest, "dirtest"},
   {exectest, "exectest"},
+  {joinexec, "joinexec"},
   {pipe1, "pipe1"},
   {killstatus, "killstatus"},
   {preempt, "preempt"},
@@ -2624,6 +2823,8 @@ struct test {
   {MAXVAplus, "MAXVAplus"},
   {sbrkfail, "sbrkfail"},
   {sbrkarg, "sbrkarg"},
+  {mprotecttest, "mprotecttest"},
+  {polltest, "polltest"},
   {validatetest, "validatetest"},
   {bsstest, "bsstest"},
   {bigargtest, "bigargtest"},
@@ -36,3 +36,10 @@ entry("getpid");
 entry("sbrk");
 entry("sleep");
 entry("uptime");
+entry("clone");
+entry("futex");
+entry("mprotect");
+entry("sigalarm");
+entry("sigreturn");
+entry("fcntl");
+entry("poll");
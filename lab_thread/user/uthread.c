@@ -1,118 +1,13 @@
 #include "kernel/types.h"
 #include "kernel/stat.h"
 #include "user/user.h"
-
-/* Possible states of a thread: */
-#define FREE        0x0
-#define RUNNING     0x1
-#define RUNNABLE    0x2
-
-#define STACK_SIZE  8192
-#define MAX_THREAD  4
-
-struct thread_context {
-  uint64 ra;
-  uint64 sp;
-
-  // calle-saved
-  uint64 s0;
-  uint64 s1;
-  uint64 s2;
-  uint64 s3;
-  uint64 s4;
-  uint64 s5;
-  uint64 s6;
-  uint64 s7;
-  uint64 s8;
-  uint64 s9;
-  uint64 s10;
-  uint64 s11;
-};
-
-struct thread {
-  char       stack[STACK_SIZE]; /* the thread's stack */
-  int        state;             /* FREE, RUNNING, RUNNABLE */
-  struct thread_context context;
-};
-struct thread all_thread[MAX_THREAD];
-struct thread *current_thread;
-extern void thread_switch(struct thread_context *, struct thread_context *);
-              
-void 
-thread_init(void)
-{
-  // main() is thread 0, which will make the first invocation to
-  // thread_schedule().  it needs a stack so that the first thread_switch() can
-  // save thread 0's state.  thread_schedule() won't run the main thread ever
-  // again, because its state is set to RUNNING, and thread_schedule() selects
-  // a RUNNABLE thread.
-  current_thread = &all_thread[0];
-  current_thread->state = RUNNING;
-}
-
-void 
-thread_schedule(void)
-{
-  struct thread *t, *next_thread;
-
-  /* Find another runnable thread. */
-  next_thread = 0;
-  t = current_thread + 1;
-  for(int i = 0; i < MAX_THREAD; i++){
-    if(t >= all_thread + MAX_THREAD)
-      t = all_thread;
-    if(t->state == RUNNABLE) {
-      next_thread = t;
-      break;
-    }
-    t = t + 1;
-  }
-
-  if (next_thread == 0) {
-    printf("thread_schedule: no runnable threads\n");
-    exit(-1);
-  }
-
-  if (current_thread != next_thread) {         /* switch threads?  */
-    next_thread->state = RUNNING;
-    t = current_thread;
-    current_thread = next_thread;
-    /* YOUR CODE HERE
-     * Invoke thread_switch to switch from t to next_thread:
-     * thread_switch(??, ??);
-     */
-    thread_switch(&t->context, &next_thread->context);
-    
-  } else
-    next_thread = 0;
-}
-
-void 
-thread_create(void (*func)())
-{
-  struct thread *t;
-
-  for (t = all_thread; t < all_thread + MAX_THREAD; t++) {
-    if (t->state == FREE) break;
-  }
-  t->state = RUNNABLE;
-  // YOUR CODE HERE
-  t->context.ra = (uint64) func;
-  t->context.sp = (uint64) (t->stack + STACK_SIZE);
-}
-
-void 
-thread_yield(void)
-{
-  current_thread->state = RUNNABLE;
-  thread_schedule();
-}
+#include "user/uthread.h"
 
 volatile int a_started, b_started, c_started;
 volatile int a_n, b_n, c_n;
 
 void 
-thread_a(void)
+thread_a(void *arg)
 {
   int i;
   printf("thread_a started\n");
@@ -127,12 +22,11 @@ thread_a(void)
   }
   printf("thread_a: exit after %d\n", a_n);
 
-  current_thread->state = FREE;
-  thread_schedule();
+  thread_exit();
 }
 
 void 
-thread_b(void)
+thread_b(void *arg)
 {
   int i;
   printf("thread_b started\n");
@@ -147,12 +41,11 @@ thread_b(void)
   }
   printf("thread_b: exit after %d\n", b_n);
 
-  current_thread->state = FREE;
-  thread_schedule();
+  thread_exit();
 }
 
 void 
-thread_c(void)
+thread_c(void *arg)
 {
   int i;
   printf("thread_c started\n");
@@ -167,8 +60,7 @@ thread_c(void)
   }
   printf("thread_c: exit after %d\n", c_n);
 
-  current_thread->state = FREE;
-  thread_schedule();
+  thread_exit();
 }
 
 int 
@@ -177,9 +69,11 @@ main(int argc, char *argv[])
   a_started = b_started = c_started = 0;
   a_n = b_n = c_n = 0;
   thread_init();
-  thread_create(thread_a);
-  thread_create(thread_b);
-  thread_create(thread_c);
+  thread_create(thread_a, 0);
+  thread_create(thread_b, 0);
+  thread_create(thread_c, 0);
+  // main never goes back on the run queue, so this
+  // runs the threads until none is left, and exits.
   thread_schedule();
   exit(0);
 }
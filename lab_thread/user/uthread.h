@@ -0,0 +1,118 @@
+// user-level threads. they all run on the process's one
+// kernel thread, and switch only when one yields, blocks
+// in thread_join(), or exits, or with thread_preempt() when
+// its time slice ends. a preempted thread may be holding
+// malloc()'s lock, so with preemption on, threads other
+// than the runtime shouldn't call malloc() or free().
+
+struct thread;
+struct twaiter;
+
+void thread_init(void);
+struct thread *thread_create(void (*)(void*), void*);
+struct thread *thread_create_stack(void (*)(void*), void*, int);
+void thread_yield(void);
+int thread_join(struct thread*);
+void thread_exit(void) __attribute__((noreturn));
+void thread_schedule(void);
+struct thread *thread_self(void);
+int thread_preempt(int);
+int thread_switch_to(struct thread*);
+void thread_setfp(struct thread*);
+int thread_yield_begin(void**, void**);
+void thread_yield_end(void);
+int thread_iowait(int, int);
+int thread_read(int, void*, int);
+int thread_write(int, const void*, int);
+
+// for building blocking primitives.
+void thread_critical(void);
+void thread_endcritical(void);
+void thread_park(void);
+void thread_ready(struct thread*);
+
+// uthreadsync.c: primitives that park threads on FIFO
+// wait queues, and pass a released lock, semaphore unit
+// or channel value straight to the thread that waited
+// longest, so that no other thread can barge in first.
+struct twaitq {
+  struct twaiter *head, *tail;
+};
+
+struct tmutex {
+  int locked;
+  struct twaitq q;
+};
+
+struct tcond {
+  struct twaitq q;
+};
+
+struct tsem {
+  int count;
+  struct twaitq q;
+};
+
+struct tchan;
+
+void tmutex_init(struct tmutex*);
+void tmutex_lock(struct tmutex*);
+void tmutex_unlock(struct tmutex*);
+void tcond_init(struct tcond*);
+void tcond_wait(struct tcond*, struct tmutex*);
+void tcond_signal(struct tcond*);
+void tcond_broadcast(struct tcond*);
+void tsem_init(struct tsem*, int);
+void tsem_down(struct tsem*);
+void tsem_up(struct tsem*);
+struct tchan *tchan_make(int, int);
+int tchan_send(struct tchan*, void*);
+int tchan_recv(struct tchan*, void*);
+void tchan_close(struct tchan*);
+void tchan_free(struct tchan*);
+
+// thread_yield() for hot loops. the switch is inline and
+// tells the compiler that every register but sp and s0 (the
+// frame pointer) is lost, so only the values live at this
+// point get saved, rather than all of s0-s11 every time.
+// it saves only ra, sp and s0 in the context, but restores
+// s1-s11 too, so that it can resume a thread that
+// thread_switch() saved.
+static inline void
+thread_yield_inline(void)
+{
+  void *from, *to;
+
+  if(thread_yield_begin(&from, &to) == 0)
+    return;
+  register void *a0 asm("a0") = from;
+  register void *a1 asm("a1") = to;
+  asm volatile(
+    "lla t0, 1f\n"
+    "sd t0, 0(a0)\n"
+    "sd sp, 8(a0)\n"
+    "sd s0, 16(a0)\n"
+    "ld ra, 0(a1)\n"
+    "ld sp, 8(a1)\n"
+    "ld s0, 16(a1)\n"
+    "ld s1, 24(a1)\n"
+    "ld s2, 32(a1)\n"
+    "ld s3, 40(a1)\n"
+    "ld s4, 48(a1)\n"
+    "ld s5, 56(a1)\n"
+    "ld s6, 64(a1)\n"
+    "ld s7, 72(a1)\n"
+    "ld s8, 80(a1)\n"
+    "ld s9, 88(a1)\n"
+    "ld s10, 96(a1)\n"
+    "ld s11, 104(a1)\n"
+    "jr ra\n"
+    "1:\n"
+    : "+r" (a0), "+r" (a1)
+    :
+    : "ra", "t0", "t1", "t2", "t3", "t4", "t5", "t6",
+      "a2", "a3", "a4", "a5", "a6", "a7",
+      "s1", "s2", "s3", "s4", "s5", "s6", "s7", "s8", "s9", "s10", "s11",
+      "memory");
+  thread_yield_end();
+}
@@ -0,0 +1,80 @@
+//
+// uthread context-switch benchmark.
+//
+// usage: uthreadbench [maxthreads [switches [stacksize]]]
+//
+// for 2, 10, 100, ... maxthreads (default 10000) threads,
+// each thread yields until the threads have made about
+// `switches` (default 1000000) switches between them.
+// the threads get one-page stacks unless stacksize says
+// otherwise; 10000 of the default 8 KiB would not fit
+// in xv6's memory alongside their guard pages.
+//
+
+#include "kernel/types.h"
+#include "user/user.h"
+#include "user/uthread.h"
+
+static int iters, stacksize = 4096;
+
+static void
+yielder(void *arg)
+{
+  for(int i = 0; i < iters; i++)
+    thread_yield();
+}
+
+static void
+run(int n, int switches)
+{
+  static struct thread **t;
+  static int maxt;
+  int t0, t1, i;
+
+  if(n > maxt){
+    free(t);
+    if((t = malloc(n * sizeof(*t))) == 0){
+      fprintf(2, "uthreadbench: out of memory\n");
+      exit(1);
+    }
+    maxt = n;
+  }
+  iters = switches / n;
+  if(iters == 0)
+    iters = 1;
+
+  for(i = 0; i < n; i++){
+    if((t[i] = thread_create_stack(yielder, 0, stacksize)) == 0){
+      fprintf(2, "uthreadbench: thread_create failed at %d\n", i);
+      exit(1);
+    }
+  }
+  t0 = uptime();
+  for(i = 0; i < n; i++)
+    thread_join(t[i]);
+  t1 = uptime();
+
+  // ticks are about 1/10th of a second.
+  printf("%d threads: %d switches, %d ticks, %d switches/sec\n",
+         n, n * iters, t1 - t0,
+         t1 > t0 ? (int)((uint64)n * iters * 10 / (t1 - t0)) : 0);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int maxthreads = 10000, switches = 1000000;
+
+  if(argc > 1)
+    maxthreads = atoi(argv[1]);
+  if(argc > 2)
+    switches = atoi(argv[2]);
+  if(argc > 3)
+    stacksize = atoi(argv[3]);
+
+  thread_init();
+  run(2, switches);
+  for(int n = 10; n <= maxthreads; n *= 10)
+    run(n, switches);
+  exit(0);
+}
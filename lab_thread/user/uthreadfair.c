@@ -0,0 +1,125 @@
+//
+// uthread preemption benchmark.
+//
+// usage: uthreadfair [quantum [ncpu [nyield [ticks]]]]
+//
+// runs ncpu (default 3) threads that spin without yielding
+// alongside nyield (default 2) threads that yield after
+// every bit of work, for `ticks` (default 30) timer ticks,
+// switching every `quantum` ticks (default 1; 0 turns off
+// preemption). reports how evenly the spinners shared the
+// CPU, as Jain's index (1.000 is perfectly fair), and how
+// long a yielder waited to run again.
+//
+
+#include "kernel/types.h"
+#include "user/user.h"
+#include "user/uthread.h"
+
+#define MAXT   32
+#define TIMEHZ 10000000  // the time CSR's rate
+
+static uint64 deadline;
+static uint64 spins[MAXT];
+static uint64 nyields[MAXT], latsum[MAXT], latmax[MAXT];
+
+static void
+spinner(void *arg)
+{
+  int id = (int)(uint64)arg;
+  uint64 n = 0;
+
+  while(rdtime() < deadline)
+    n++;
+  spins[id] = n;
+}
+
+static void
+yielder(void *arg)
+{
+  int id = (int)(uint64)arg;
+  uint64 t0, lat;
+  volatile int work;
+
+  while((t0 = rdtime()) < deadline){
+    for(work = 0; work < 1000; work++)
+      ;
+    thread_yield();
+    lat = rdtime() - t0;
+    nyields[id]++;
+    latsum[id] += lat;
+    if(lat > latmax[id])
+      latmax[id] = lat;
+  }
+}
+
+// x/1000 as a decimal.
+static void
+printmilli(char *s, uint64 x)
+{
+  printf("%s%d.%d%d%d", s, (int)(x / 1000), (int)(x / 100 % 10),
+         (int)(x / 10 % 10), (int)(x % 10));
+}
+
+int
+main(int argc, char *argv[])
+{
+  int quantum = 1, ncpu = 3, nyield = 2, ticks = 30;
+  struct thread *t[2*MAXT];
+  uint64 sum, sumsq, min, max, ny, lsum, lmax;
+  int i, npreempt;
+
+  if(argc > 1)
+    quantum = atoi(argv[1]);
+  if(argc > 2)
+    ncpu = atoi(argv[2]);
+  if(argc > 3)
+    nyield = atoi(argv[3]);
+  if(argc > 4)
+    ticks = atoi(argv[4]);
+  if(ncpu < 1 || ncpu > MAXT || nyield < 0 || nyield > MAXT){
+    fprintf(2, "uthreadfair: at most %d threads of each kind\n", MAXT);
+    exit(1);
+  }
+
+  thread_init();
+  // timer ticks are about 1/10th of a second.
+  deadline = rdtime() + (uint64)ticks * (TIMEHZ / 10);
+  for(i = 0; i < ncpu; i++)
+    t[i] = thread_create(spinner, (void*)(uint64)i);
+  for(i = 0; i < nyield; i++)
+    t[ncpu+i] = thread_create(yielder, (void*)(uint64)i);
+  thread_preempt(quantum);
+  for(i = 0; i < ncpu + nyield; i++)
+    thread_join(t[i]);
+  npreempt = thread_preempt(0);
+
+  sum = sumsq = max = 0;
+  min = spins[0];
+  for(i = 0; i < ncpu; i++){
+    sum += spins[i];
+    // scaled down so that the squares can't overflow.
+    sumsq += (spins[i] >> 10) * (spins[i] >> 10);
+    if(spins[i] < min)
+      min = spins[i];
+    if(spins[i] > max)
+      max = spins[i];
+  }
+  printf("quantum %d: %d preemptions\n", quantum, npreempt);
+  printf("spinners: min %d max %d avg %d", (int)min, (int)max, (int)(sum / ncpu));
+  printmilli(", fairness ",
+             sumsq ? (sum >> 10) * (sum >> 10) * 1000 / (ncpu * sumsq) : 0);
+  printf("\n");
+
+  ny = lsum = lmax = 0;
+  for(i = 0; i < nyield; i++){
+    ny += nyields[i];
+    lsum += latsum[i];
+    if(latmax[i] > lmax)
+      lmax = latmax[i];
+  }
+  if(ny > 0)
+    printf("yielders: %d yields, latency avg %d us max %d us\n", (int)ny,
+           (int)(lsum / ny / (TIMEHZ / 1000000)), (int)(lmax / (TIMEHZ / 1000000)));
+  exit(0);
+}
@@ -0,0 +1,86 @@
+//
+// uthread I/O test.
+//
+// usage: uthreadio [nlines]
+//
+// a child process writes nlines (default 5) lines, a tick
+// apart, to each of two pipes. in this process a thread
+// reads each pipe with thread_read() while a third thread
+// yields 1000 times; none of them should hold up the others.
+// once the third thread is done, all threads wait, and the
+// process should sleep in poll() rather than exit.
+//
+
+#include "kernel/types.h"
+#include "user/user.h"
+#include "user/uthread.h"
+
+static int nlines = 5;
+static int rfd[2], nread[2];
+static int nwork, nwork_first;
+
+static void
+reader(void *arg)
+{
+  int i = (int)(uint64)arg;
+  char c;
+
+  while(thread_read(rfd[i], &c, 1) == 1){
+    if(c == '\n' && nread[i]++ == 0 && nwork_first == 0)
+      nwork_first = nwork;
+  }
+}
+
+static void
+worker(void *arg)
+{
+  for(nwork = 0; nwork < 1000; nwork++)
+    thread_yield();
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct thread *r0, *r1, *w;
+  int p0[2], p1[2], i;
+
+  if(argc > 1)
+    nlines = atoi(argv[1]);
+  if(pipe(p0) < 0 || pipe(p1) < 0){
+    fprintf(2, "uthreadio: pipe failed\n");
+    exit(1);
+  }
+
+  if(fork() == 0){
+    close(p0[0]);
+    close(p1[0]);
+    for(i = 0; i < nlines; i++){
+      sleep(1);
+      write(p0[1], "a line\n", 7);
+      write(p1[1], "another\n", 8);
+    }
+    exit(0);
+  }
+  close(p0[1]);
+  close(p1[1]);
+  rfd[0] = p0[0];
+  rfd[1] = p1[0];
+
+  thread_init();
+  r0 = thread_create(reader, (void*)0);
+  r1 = thread_create(reader, (void*)1);
+  w = thread_create(worker, 0);
+  if(r0 == 0 || r1 == 0 || w == 0){
+    fprintf(2, "uthreadio: thread_create failed\n");
+    exit(1);
+  }
+  thread_join(r0);
+  thread_join(r1);
+  thread_join(w);
+  wait(0);
+  // the first line takes a tick to arrive, by when the
+  // worker should have yielded many times.
+  printf("uthreadio: read %d lines, worker yielded %d times before the first\n",
+         nread[0] + nread[1], nwork_first);
+  exit(0);
+}
@@ -0,0 +1,642 @@
+//
+// user-level thread runtime.
+//
+// struct threads are allocated as needed and recorded in a
+// table that grows by doubling; joined threads give back
+// their stacks and go on a free list for the next
+// thread_create(). Runnable threads wait in an intrusive
+// FIFO run queue, so picking the next one is O(1).
+//
+// Stacks are carved from page-aligned chunks of memory
+// from sbrk(), each with an inaccessible guard page below
+// it, so that overflowing a stack faults rather than
+// scribbling on whatever lies below. Freed stacks are
+// reused most-recently-freed first, while still warm in
+// the cache and TLB.
+//
+// With thread_preempt(), a sigalarm() handler also switches
+// threads every quantum ticks, unless it interrupted the
+// runtime itself.
+//
+// Threads marked with thread_setfp() also have fs0-fs11 and
+// fcsr switched, which the others needn't pay for, and the
+// rest of the FP registers too when preempted.
+//
+// thread_read() and thread_write() block only the calling
+// thread: if the file isn't ready, the thread waits on a
+// list of fds that the scheduler poll()s now and then, and
+// sleeps on in the kernel once no thread can run.
+//
+
+#include "kernel/types.h"
+#include "kernel/fcntl.h"
+#include "kernel/poll.h"
+#include "user/user.h"
+#include "user/uthread.h"
+
+/* Possible states of a thread: */
+#define FREE        0x0
+#define RUNNING     0x1
+#define RUNNABLE    0x2
+#define BLOCKED     0x3   /* in thread_join() or thread_park() */
+#define ZOMBIE      0x4   /* exited, not yet joined */
+
+#define STACK_SIZE  8192
+#define PAGE        4096
+#define POOL_CHUNK  (64*PAGE)  /* sbrk() at least this much at once */
+#define IOPOLL_MAX  64    /* fds per poll(); more waiters take turns */
+#define IOPOLL_EVERY 64   /* poll the fds every this many switches */
+
+struct thread_context {
+  uint64 ra;
+  uint64 sp;
+
+  // calle-saved
+  uint64 s0;
+  uint64 s1;
+  uint64 s2;
+  uint64 s3;
+  uint64 s4;
+  uint64 s5;
+  uint64 s6;
+  uint64 s7;
+  uint64 s8;
+  uint64 s9;
+  uint64 s10;
+  uint64 s11;
+};
+
+struct thread {
+  struct thread_context context;
+  int        state;             /* FREE, RUNNING, RUNNABLE, ... */
+  int        id;                /* index in all_thread */
+  char       *stack;            /* 0 for the main thread */
+  int        stacksize;
+  void       (*fn)(void*);
+  void       *arg;
+  struct thread *next;          /* run queue or free list */
+  struct thread *prev;          /* run queue */
+  int        usefp;             /* switch FP registers too */
+  uint64     fpregs[13];        /* fs0-fs11, fcsr */
+  struct thread *joiner;        /* blocked in thread_join() */
+};
+
+// a free stack, recorded at its own top.
+struct stack {
+  struct stack *next;
+  int size;
+};
+
+// a thread blocked in thread_iowait(), on its own stack.
+struct iowait {
+  struct thread *t;
+  int fd;
+  int events;
+  int revents;
+  struct iowait *next;
+};
+
+static struct stack *freestacks;
+static char *pool_next, *pool_end;
+
+static struct thread **all_thread;
+static int nall, maxall;
+static struct thread *freelist;
+static struct thread *runq_head, *runq_tail;
+static struct thread main_thread;
+static struct thread *current_thread;
+static volatile int inruntime;  /* preempt() mustn't switch now */
+static struct iowait *iowait_head, *iowait_tail;
+static uint nswitch;
+extern void thread_switch(struct thread_context *, struct thread_context *);
+extern void thread_fpsave(uint64 *);
+extern void thread_fpload(uint64 *);
+extern void thread_fptmpsave(uint64 *);
+extern void thread_fptmpload(uint64 *);
+
+// preempt() runs on top of whatever it interrupted, so the
+// compiler mustn't move run queue updates across these.
+static void
+rt_enter(void)
+{
+  inruntime = 1;
+  __atomic_signal_fence(__ATOMIC_SEQ_CST);
+}
+
+static void
+rt_leave(void)
+{
+  __atomic_signal_fence(__ATOMIC_SEQ_CST);
+  inruntime = 0;
+}
+
+static void
+runq_push(struct thread *t)
+{
+  t->state = RUNNABLE;
+  t->next = 0;
+  t->prev = runq_tail;
+  if(runq_tail)
+    runq_tail->next = t;
+  else
+    runq_head = t;
+  runq_tail = t;
+}
+
+static void
+runq_remove(struct thread *t)
+{
+  if(t->prev)
+    t->prev->next = t->next;
+  else
+    runq_head = t->next;
+  if(t->next)
+    t->next->prev = t->prev;
+  else
+    runq_tail = t->prev;
+}
+
+static struct thread *
+runq_pop(void)
+{
+  struct thread *t = runq_head;
+
+  if(t)
+    runq_remove(t);
+  return t;
+}
+
+// a stack of size bytes (a multiple of PAGE), above a
+// guard page. returns the stack's lowest address.
+static char *
+stack_alloc(int size)
+{
+  struct stack *s, **ps;
+  char *p, *guard;
+  int n, pad;
+
+  for(ps = &freestacks; (s = *ps) != 0; ps = &s->next){
+    if(s->size == size){
+      *ps = s->next;
+      return (char*)(s + 1) - size;
+    }
+  }
+
+  if(pool_end - pool_next < PAGE + size){
+    // the rest of the old chunk is lost; malloc() may have
+    // left the break unaligned.
+    n = PAGE + size > POOL_CHUNK ? PAGE + size : POOL_CHUNK;
+    pad = (PAGE - (uint64)sbrk(0) % PAGE) % PAGE;
+    if((p = sbrk(pad + n)) == (char*)-1)
+      return 0;
+    pool_next = p + pad;
+    pool_end = pool_next + n;
+  }
+  guard = pool_next;
+  if(mprotect(guard, PAGE, PROT_NONE) < 0)
+    return 0;
+  pool_next += PAGE + size;
+  return guard + PAGE;
+}
+
+static void
+stack_free(char *stack, int size)
+{
+  struct stack *s = (struct stack *)(stack + size) - 1;
+
+  s->size = size;
+  s->next = freestacks;
+  freestacks = s;
+}
+
+// record t in all_thread, growing it if full.
+static int
+table_add(struct thread *t)
+{
+  struct thread **nt;
+
+  if(nall == maxall){
+    int n = maxall ? 2*maxall : 16;
+    if((nt = malloc(n * sizeof(*nt))) == 0)
+      return -1;
+    if(all_thread){
+      memmove(nt, all_thread, nall * sizeof(*nt));
+      free(all_thread);
+    }
+    all_thread = nt;
+    maxall = n;
+  }
+  t->id = nall;
+  all_thread[nall++] = t;
+  return 0;
+}
+
+void 
+thread_init(void)
+{
+  // main() is thread 0. it runs on the process's own stack,
+  // and only goes on the run queue when it yields.
+  current_thread = &main_thread;
+  current_thread->state = RUNNING;
+  if(all_thread == 0)
+    table_add(current_thread);
+}
+
+struct thread *
+thread_self(void)
+{
+  return current_thread;
+}
+
+// poll the fds of the first IOPOLL_MAX threads in
+// thread_iowait(), waiting at most timeout ticks (-1 for
+// ever), and make those whose fds are ready runnable.
+static int
+iopoll(int timeout)
+{
+  struct pollfd pfd[IOPOLL_MAX];
+  struct iowait *w, **pw;
+  int i, n;
+
+  for(n = 0, w = iowait_head; w && n < IOPOLL_MAX; n++, w = w->next){
+    pfd[n].fd = w->fd;
+    pfd[n].events = w->events;
+  }
+  if((n = poll(pfd, n, timeout)) <= 0)
+    return n;
+
+  iowait_tail = 0;
+  for(i = 0, pw = &iowait_head; (w = *pw) != 0; i++){
+    if(i < IOPOLL_MAX && pfd[i].revents){
+      w->revents = pfd[i].revents;
+      *pw = w->next;
+      runq_push(w->t);
+    } else {
+      iowait_tail = w;
+      pw = &w->next;
+    }
+  }
+  return n;
+}
+
+// make t the current thread. returns the old one, whose
+// context the caller must switch from; FP registers have
+// been switched already.
+static struct thread *
+become(struct thread *t)
+{
+  struct thread *old = current_thread;
+
+  t->state = RUNNING;
+  if(old->usefp)
+    thread_fpsave(old->fpregs);
+  if(t->usefp)
+    thread_fpload(t->fpregs);
+  current_thread = t;
+  return old;
+}
+
+// pop the next thread from the run queue.
+static struct thread *
+pick(void)
+{
+  struct thread *t;
+
+  if(iowait_head){
+    // don't let busy threads starve the waiters, and sleep
+    // in the kernel if all threads wait.
+    if(++nswitch % IOPOLL_EVERY == 0)
+      iopoll(0);
+    while(runq_head == 0 && iopoll(-1) > 0)
+      ;
+  }
+  t = runq_pop();
+  if (t == 0) {
+    printf("thread_schedule: no runnable threads\n");
+    exit(-1);
+  }
+  return t;
+}
+
+// run the next thread from the run queue. the caller has
+// already queued, blocked, or exited the current thread.
+static void 
+sched(void)
+{
+  struct thread *t, *next_thread;
+
+  next_thread = pick();
+  if (current_thread != next_thread) {         /* switch threads?  */
+    t = become(next_thread);
+    thread_switch(&t->context, &next_thread->context);
+  } else {
+    next_thread->state = RUNNING;
+  }
+}
+
+void
+thread_schedule(void)
+{
+  rt_enter();
+  sched();
+  rt_leave();
+}
+
+// a new thread's first thread_switch() returns here,
+// still inside the runtime.
+static void
+thread_start(void)
+{
+  rt_leave();
+  current_thread->fn(current_thread->arg);
+  thread_exit();
+}
+
+// stacksize is rounded up to whole pages.
+// returns 0 if out of memory.
+struct thread *
+thread_create_stack(void (*fn)(void*), void *arg, int stacksize)
+{
+  struct thread *t;
+
+  if(stacksize <= 0)
+    return 0;
+  stacksize = (stacksize + PAGE - 1) / PAGE * PAGE;
+
+  rt_enter();
+  if((t = freelist) != 0){
+    freelist = t->next;
+  } else {
+    if((t = malloc(sizeof(*t))) == 0){
+      rt_leave();
+      return 0;
+    }
+    if(table_add(t) < 0){
+      free(t);
+      rt_leave();
+      return 0;
+    }
+  }
+  if((t->stack = stack_alloc(stacksize)) == 0){
+    t->state = FREE;
+    t->next = freelist;
+    freelist = t;
+    rt_leave();
+    return 0;
+  }
+
+  memset(&t->context, 0, sizeof(t->context));
+  t->context.ra = (uint64) thread_start;
+  t->context.sp = (uint64) (t->stack + stacksize);
+  t->stacksize = stacksize;
+  t->fn = fn;
+  t->arg = arg;
+  t->joiner = 0;
+  t->usefp = 0;
+  memset(t->fpregs, 0, sizeof(t->fpregs));
+  runq_push(t);
+  rt_leave();
+  return t;
+}
+
+struct thread *
+thread_create(void (*fn)(void*), void *arg)
+{
+  return thread_create_stack(fn, arg, STACK_SIZE);
+}
+
+void 
+thread_yield(void)
+{
+  rt_enter();
+  runq_push(current_thread);
+  sched();
+  rt_leave();
+}
+
+// thread_yield_inline()'s way in and out of the runtime.
+// returns 0 if no other thread is runnable; otherwise
+// stays in the runtime for the caller to switch from *from
+// to *to, and leave with thread_yield_end().
+int
+thread_yield_begin(void **from, void **to)
+{
+  struct thread *t;
+
+  rt_enter();
+  if(runq_head == 0 && iowait_head == 0){
+    rt_leave();
+    return 0;
+  }
+  runq_push(current_thread);
+  t = pick();
+  if(t == current_thread){
+    t->state = RUNNING;
+    rt_leave();
+    return 0;
+  }
+  *to = &t->context;
+  *from = &become(t)->context;
+  return 1;
+}
+
+void
+thread_yield_end(void)
+{
+  rt_leave();
+}
+
+// hand the CPU straight to t, which must be runnable,
+// without consulting the run queue; the caller goes to
+// the back of it. returns -1 if t isn't runnable.
+int
+thread_switch_to(struct thread *t)
+{
+  struct thread *old;
+
+  if(t == current_thread)
+    return 0;
+  rt_enter();
+  if(t->state != RUNNABLE){
+    rt_leave();
+    return -1;
+  }
+  runq_remove(t);
+  runq_push(current_thread);
+  old = become(t);
+  thread_switch(&old->context, &t->context);
+  rt_leave();
+  return 0;
+}
+
+// have thread_schedule() switch t's floating-point
+// registers as well. call before t uses floating point.
+void
+thread_setfp(struct thread *t)
+{
+  t->usefp = 1;
+}
+
+void
+thread_exit(void)
+{
+  struct thread *t = current_thread;
+
+  rt_enter();
+  t->state = ZOMBIE;
+  if(t->joiner)
+    runq_push(t->joiner);
+  sched();
+  // not reached: a ZOMBIE never runs again.
+  exit(-1);
+}
+
+// wait for t to exit, then reclaim it. t may not be
+// joined twice.
+int
+thread_join(struct thread *t)
+{
+  if(t == current_thread || t->state == FREE || t->joiner)
+    return -1;
+  rt_enter();
+  while(t->state != ZOMBIE){
+    t->joiner = current_thread;
+    current_thread->state = BLOCKED;
+    sched();
+  }
+
+  // t has switched away for good, so its stack is free.
+  stack_free(t->stack, t->stacksize);
+  t->stack = 0;
+  t->state = FREE;
+  t->next = freelist;
+  freelist = t;
+  rt_leave();
+  return 0;
+}
+
+// code between thread_critical() and thread_endcritical()
+// won't be preempted. sections don't nest.
+void
+thread_critical(void)
+{
+  rt_enter();
+}
+
+void
+thread_endcritical(void)
+{
+  rt_leave();
+}
+
+// block the current thread until some other thread passes it
+// to thread_ready(). call inside a critical section, which
+// continues when the thread runs again.
+void
+thread_park(void)
+{
+  current_thread->state = BLOCKED;
+  sched();
+}
+
+// make a parked thread runnable. call inside a critical section.
+void
+thread_ready(struct thread *t)
+{
+  runq_push(t);
+}
+
+// block the current thread until fd has some of events
+// (POLLIN, POLLOUT) ready; returns poll()'s revents.
+int
+thread_iowait(int fd, int events)
+{
+  struct pollfd pfd;
+  struct iowait w;
+
+  pfd.fd = fd;
+  pfd.events = events;
+  if(poll(&pfd, 1, 0) != 0)
+    return pfd.revents;
+
+  w.t = current_thread;
+  w.fd = fd;
+  w.events = events;
+  w.revents = 0;
+  w.next = 0;
+  rt_enter();
+  if(iowait_tail)
+    iowait_tail->next = &w;
+  else
+    iowait_head = &w;
+  iowait_tail = &w;
+  current_thread->state = BLOCKED;
+  sched();
+  rt_leave();
+  return w.revents;
+}
+
+// read() that blocks only the calling thread.
+int
+thread_read(int fd, void *buf, int n)
+{
+  int r;
+
+  do {
+    if(thread_iowait(fd, POLLIN) & POLLNVAL)
+      return -1;
+  } while((r = read(fd, buf, n)) == -EAGAIN);
+  return r;
+}
+
+// write() that blocks only the calling thread. on a file
+// without O_NONBLOCK, writing more than a pipe has room
+// for may still block the process.
+int
+thread_write(int fd, const void *buf, int n)
+{
+  int i, r;
+
+  for(i = 0; i < n; i += r){
+    if(thread_iowait(fd, POLLOUT) & POLLNVAL)
+      return -1;
+    if((r = write(fd, (char*)buf + i, n - i)) == -EAGAIN)
+      r = 0;
+    else if(r < 0)
+      return i > 0 ? i : -1;
+  }
+  return n;
+}
+
+static uint npreempt;
+
+// the sigalarm() handler. the interrupted thread goes to
+// the back of the run queue, and continues from f when it
+// next runs.
+static void
+preempt(struct sigframe *f)
+{
+  uint64 fptmp[20];
+
+  if(!inruntime && runq_head){
+    npreempt++;
+    // unlike at a call, the caller-saved FP registers may be
+    // live here, and thread_yield() keeps only fs0-fs11.
+    if(current_thread->usefp)
+      thread_fptmpsave(fptmp);
+    thread_yield();
+    if(current_thread->usefp)
+      thread_fptmpload(fptmp);
+  }
+  sigreturn(f);
+}
+
+// switch threads every quantum ticks, or cooperatively
+// only if quantum is 0. returns the number of preemptions
+// so far.
+int
+thread_preempt(int quantum)
+{
+  sigalarm(quantum, quantum > 0 ? preempt : 0);
+  return npreempt;
+}
@@ -0,0 +1,319 @@
+//
+// blocking synchronization for uthreads: mutexes, condition
+// variables, counting semaphores and Go-style channels.
+//
+// A thread that has to wait records itself in a struct
+// twaiter on its own stack, joins the object's FIFO queue,
+// and parks. Whoever releases the object hands it straight
+// to the first waiter -- the lock stays locked, the
+// semaphore unit or channel value goes to that waiter --
+// and makes it runnable.
+//
+
+#include "kernel/types.h"
+#include "user/user.h"
+#include "user/uthread.h"
+
+struct twaiter {
+  struct thread *t;
+  struct twaiter *next;
+  void *data;     // channel value to send, or space to receive it
+  int ok;         // 0 if the channel closed instead
+};
+
+static void
+wq_push(struct twaitq *q, struct twaiter *w)
+{
+  w->next = 0;
+  if(q->tail)
+    q->tail->next = w;
+  else
+    q->head = w;
+  q->tail = w;
+}
+
+static struct twaiter *
+wq_pop(struct twaitq *q)
+{
+  struct twaiter *w = q->head;
+
+  if(w){
+    q->head = w->next;
+    if(q->head == 0)
+      q->tail = 0;
+  }
+  return w;
+}
+
+// join q and park; returns once another thread readied us.
+// caller is in a critical section.
+static void
+wq_wait(struct twaitq *q, struct twaiter *w)
+{
+  w->t = thread_self();
+  wq_push(q, w);
+  thread_park();
+}
+
+//
+// mutexes
+//
+
+void
+tmutex_init(struct tmutex *m)
+{
+  m->locked = 0;
+  m->q.head = m->q.tail = 0;
+}
+
+static void
+mutex_lock(struct tmutex *m)
+{
+  struct twaiter w;
+
+  if(!m->locked)
+    m->locked = 1;
+  else
+    wq_wait(&m->q, &w);  // tmutex_unlock() left it locked for us
+}
+
+static void
+mutex_unlock(struct tmutex *m)
+{
+  struct twaiter *w;
+
+  if((w = wq_pop(&m->q)) != 0)
+    thread_ready(w->t);
+  else
+    m->locked = 0;
+}
+
+void
+tmutex_lock(struct tmutex *m)
+{
+  thread_critical();
+  mutex_lock(m);
+  thread_endcritical();
+}
+
+void
+tmutex_unlock(struct tmutex *m)
+{
+  thread_critical();
+  mutex_unlock(m);
+  thread_endcritical();
+}
+
+//
+// condition variables
+//
+
+void
+tcond_init(struct tcond *c)
+{
+  c->q.head = c->q.tail = 0;
+}
+
+// release m and wait for a signal, then take m again.
+void
+tcond_wait(struct tcond *c, struct tmutex *m)
+{
+  struct twaiter w;
+
+  thread_critical();
+  w.t = thread_self();
+  wq_push(&c->q, &w);
+  mutex_unlock(m);
+  thread_park();
+  mutex_lock(m);
+  thread_endcritical();
+}
+
+void
+tcond_signal(struct tcond *c)
+{
+  struct twaiter *w;
+
+  thread_critical();
+  if((w = wq_pop(&c->q)) != 0)
+    thread_ready(w->t);
+  thread_endcritical();
+}
+
+void
+tcond_broadcast(struct tcond *c)
+{
+  struct twaiter *w;
+
+  thread_critical();
+  while((w = wq_pop(&c->q)) != 0)
+    thread_ready(w->t);
+  thread_endcritical();
+}
+
+//
+// counting semaphores
+//
+
+void
+tsem_init(struct tsem *s, int count)
+{
+  s->count = count;
+  s->q.head = s->q.tail = 0;
+}
+
+void
+tsem_down(struct tsem *s)
+{
+  struct twaiter w;
+
+  thread_critical();
+  if(s->count > 0)
+    s->count--;
+  else
+    wq_wait(&s->q, &w);  // tsem_up() gave us its unit
+  thread_endcritical();
+}
+
+void
+tsem_up(struct tsem *s)
+{
+  struct twaiter *w;
+
+  thread_critical();
+  if((w = wq_pop(&s->q)) != 0)
+    thread_ready(w->t);
+  else
+    s->count++;
+  thread_endcritical();
+}
+
+//
+// channels: a ring of cap values of size bytes each. with
+// cap 0, a send waits for a receiver and vice versa.
+//
+
+struct tchan {
+  int cap, size;
+  int head, n;          // ring of n values from buf[head]
+  int closed;
+  struct twaitq sendq;  // senders waiting for room or a receiver
+  struct twaitq recvq;  // receivers waiting for a value
+  char *buf;
+};
+
+struct tchan *
+tchan_make(int cap, int size)
+{
+  struct tchan *ch;
+
+  if(cap < 0 || size <= 0)
+    return 0;
+  thread_critical();  // a preempted malloc() would hold its lock
+  if((ch = malloc(sizeof(*ch) + cap * size)) != 0){
+    memset(ch, 0, sizeof(*ch));
+    ch->cap = cap;
+    ch->size = size;
+    ch->buf = (char*)(ch + 1);
+  }
+  thread_endcritical();
+  return ch;
+}
+
+void
+tchan_free(struct tchan *ch)
+{
+  thread_critical();
+  free(ch);
+  thread_endcritical();
+}
+
+// returns 0, or -1 if the channel is closed.
+int
+tchan_send(struct tchan *ch, void *v)
+{
+  struct twaiter w, *r;
+
+  thread_critical();
+  if(ch->closed){
+    thread_endcritical();
+    return -1;
+  }
+  if((r = wq_pop(&ch->recvq)) != 0){
+    // the ring is empty; hand v straight to the receiver.
+    memmove(r->data, v, ch->size);
+    r->ok = 1;
+    thread_ready(r->t);
+  } else if(ch->n < ch->cap){
+    memmove(ch->buf + (ch->head + ch->n) % ch->cap * ch->size, v, ch->size);
+    ch->n++;
+  } else {
+    w.data = v;
+    wq_wait(&ch->sendq, &w);
+    if(!w.ok){
+      thread_endcritical();
+      return -1;
+    }
+  }
+  thread_endcritical();
+  return 0;
+}
+
+// returns 1 with a value in v, or 0 once the channel is
+// closed and drained.
+int
+tchan_recv(struct tchan *ch, void *v)
+{
+  struct twaiter w, *s;
+
+  thread_critical();
+  if(ch->n > 0){
+    memmove(v, ch->buf + ch->head * ch->size, ch->size);
+    ch->head = (ch->head + 1) % ch->cap;
+    ch->n--;
+    // the longest-waiting sender now fits.
+    if((s = wq_pop(&ch->sendq)) != 0){
+      memmove(ch->buf + (ch->head + ch->n) % ch->cap * ch->size, s->data, ch->size);
+      ch->n++;
+      s->ok = 1;
+      thread_ready(s->t);
+    }
+  } else if((s = wq_pop(&ch->sendq)) != 0){
+    // unbuffered: take the value straight from the sender.
+    memmove(v, s->data, ch->size);
+    s->ok = 1;
+    thread_ready(s->t);
+  } else if(ch->closed){
+    thread_endcritical();
+    return 0;
+  } else {
+    w.data = v;
+    wq_wait(&ch->recvq, &w);
+    if(!w.ok){
+      thread_endcritical();
+      return 0;
+    }
+  }
+  thread_endcritical();
+  return 1;
+}
+
+// wake everyone waiting; receivers still get any
+// buffered values.
+void
+tchan_close(struct tchan *ch)
+{
+  struct twaiter *w;
+
+  thread_critical();
+  ch->closed = 1;
+  while((w = wq_pop(&ch->sendq)) != 0){
+    w->ok = 0;
+    thread_ready(w->t);
+  }
+  while((w = wq_pop(&ch->recvq)) != 0){
+    w->ok = 0;
+    thread_ready(w->t);
+  }
+  thread_endcritical();
+}